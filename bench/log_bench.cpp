@@ -0,0 +1,329 @@
+//! Logging latency and throughput benchmarks
+//!
+//! Usage: log_bench [--json] [--filter text] [--calls N] [--threads N] [--dir path]
+//!
+//! Latency runs report the mean cost of a call and p50/p99/p99.9 of samples of 16 consecutive calls,
+//! single calls are too close to the clock resolution. Throughput runs write the same number of records
+//! from 1, 2, 4 ... N threads. --json prints one JSON object per result for regression tracking.
+//!
+#include "log/log.h"
+#include "log/async_log.h"
+#include "log/binary_log.h"
+#include "log/dedup_log.h"
+#include "log/sharded_log.h"
+#include "log/std_log.h"
+#ifndef _WIN32
+#include "log/mapped_file.h"
+#endif
+#ifdef LOG_BENCH_LOG4CPLUS
+#include "log/log4cplus.h"
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/thread/thread.hpp>
+
+SET_LOGGING_MODULE("bench");
+
+namespace
+{
+
+//! Calls timed together per latency sample
+const std::size_t g_Batch = 16;
+
+//! Keeps the formatting results alive
+volatile std::size_t g_Sink;
+
+#ifdef _WIN32
+const char g_NullDevice[] = "NUL";
+#else
+const char g_NullDevice[] = "/dev/null";
+#endif
+
+struct Options
+{
+    bool json = false;
+    std::string filter;
+    std::size_t calls = 200000;
+    unsigned threads = std::max(1u, boost::thread::hardware_concurrency());
+    boost::filesystem::path folder = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("log_bench-%%%%-%%%%");
+};
+
+struct Result
+{
+    std::string name;
+    unsigned threads;
+    std::size_t calls;
+    double nsPerCall;
+    double p50;
+    double p99;
+    double p999;
+    bool latency;   //!< percentiles are measured
+};
+
+void Report(const Options& options, const Result& result)
+{
+    const auto perSecond = result.nsPerCall > 0 ? 1e9 / result.nsPerCall : 0;
+    if (options.json && result.latency)
+    {
+        std::printf("{\"name\":\"%s\",\"threads\":%u,\"calls\":%zu,\"ns_per_call\":%.2f,\"p50_ns\":%.2f,\"p99_ns\":%.2f,\"p999_ns\":%.2f,\"calls_per_second\":%.0f}\n",
+            result.name.c_str(), result.threads, result.calls, result.nsPerCall, result.p50, result.p99, result.p999, perSecond);
+    }
+    else if (options.json)
+    {
+        std::printf("{\"name\":\"%s\",\"threads\":%u,\"calls\":%zu,\"ns_per_call\":%.2f,\"calls_per_second\":%.0f}\n",
+            result.name.c_str(), result.threads, result.calls, result.nsPerCall, perSecond);
+    }
+    else if (result.latency)
+    {
+        std::printf("%-32s %7u %10.1f %10.1f %10.1f %10.1f %14.0f\n",
+            result.name.c_str(), result.threads, result.nsPerCall, result.p50, result.p99, result.p999, perSecond);
+    }
+    else
+    {
+        std::printf("%-32s %7u %10.1f %10s %10s %10s %14.0f\n",
+            result.name.c_str(), result.threads, result.nsPerCall, "-", "-", "-", perSecond);
+    }
+    std::fflush(stdout);
+}
+
+double Elapsed(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+{
+    return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+}
+
+double Percentile(const std::vector<double>& sorted, double percent)
+{
+    if (sorted.empty())
+        return 0;
+    const auto index = static_cast<std::size_t>(percent / 100 * static_cast<double>(sorted.size() - 1));
+    return sorted[index];
+}
+
+//! Single thread latency of call(i)
+Result MeasureLatency(const std::string& name, std::size_t calls, const std::function<void(std::size_t)>& call)
+{
+    for (std::size_t i = 0; i < std::min<std::size_t>(calls / 10, 10000); ++i)
+        call(i);
+
+    std::vector<double> samples;
+    samples.reserve(calls / g_Batch + 1);
+
+    std::size_t i = 0;
+    const auto start = std::chrono::steady_clock::now();
+    while (i < calls)
+    {
+        const auto begin = std::chrono::steady_clock::now();
+        for (std::size_t j = 0; j < g_Batch; ++j)
+            call(i++);
+        samples.push_back(Elapsed(begin, std::chrono::steady_clock::now()) / g_Batch);
+    }
+    const auto total = Elapsed(start, std::chrono::steady_clock::now());
+
+    std::sort(samples.begin(), samples.end());
+    return Result{ name, 1, i, total / static_cast<double>(i), Percentile(samples, 50), Percentile(samples, 99), Percentile(samples, 99.9), true };
+}
+
+//! Aggregate throughput of threads calling call(i), reported as the cost per call of the whole process
+Result MeasureThroughput(const std::string& name, unsigned threads, std::size_t calls, const std::function<void(std::size_t)>& call)
+{
+    std::atomic<bool> go(false);
+    std::atomic<unsigned> ready(0);
+    std::vector<boost::thread> workers;
+
+    const auto perThread = calls / threads;
+    for (unsigned t = 0; t < threads; ++t)
+    {
+        workers.emplace_back([&, t](){
+            ++ready;
+            while (!go.load())
+                boost::this_thread::yield();
+            for (std::size_t i = 0; i < perThread; ++i)
+                call(t * perThread + i);
+        });
+    }
+
+    while (ready.load() != threads)
+        boost::this_thread::yield();
+
+    const auto start = std::chrono::steady_clock::now();
+    go = true;
+    for (auto& worker : workers)
+        worker.join();
+    const auto total = Elapsed(start, std::chrono::steady_clock::now());
+
+    const auto done = perThread * threads;
+    return Result{ name, threads, done, total / static_cast<double>(done), 0, 0, 0, false };
+}
+
+//! Sinks covered by the latency and scaling runs, new backends are registered here
+struct Sink
+{
+    std::string name;
+    std::function<std::unique_ptr<ILog>(const boost::filesystem::path& folder)> create;
+};
+
+std::vector<Sink> GetSinks()
+{
+    std::vector<Sink> sinks;
+    sinks.push_back({ "std_file", [](const boost::filesystem::path& folder){
+        return std::unique_ptr<ILog>(new logging::Std(ILog::Level::Info, (folder / "std.log").string().c_str()));
+    }});
+    sinks.push_back({ "dedup_std_file", [](const boost::filesystem::path& folder){
+        return std::unique_ptr<ILog>(new logging::DedupLog(std::unique_ptr<ILog>(new logging::Std(ILog::Level::Info, (folder / "dedup.log").string().c_str()))));
+    }});
+#ifdef __linux__
+    sinks.push_back({ "std_file_uring", [](const boost::filesystem::path& folder){
+        logging::FlushPolicy policy;
+        policy.writer = logging::FlushPolicy::Writer::Uring;
+        return std::unique_ptr<ILog>(new logging::Std(ILog::Level::Info, (folder / "std_uring.log").string().c_str(), policy));
+    }});
+    sinks.push_back({ "std_file_direct", [](const boost::filesystem::path& folder){
+        logging::FlushPolicy policy;
+        policy.writer = logging::FlushPolicy::Writer::Direct;
+        return std::unique_ptr<ILog>(new logging::Std(ILog::Level::Info, (folder / "std_direct.log").string().c_str(), policy));
+    }});
+#endif
+    sinks.push_back({ "std_null", [](const boost::filesystem::path&){
+        return std::unique_ptr<ILog>(new logging::Std(ILog::Level::Info, g_NullDevice));
+    }});
+    sinks.push_back({ "async_std_null", [](const boost::filesystem::path&){
+        return std::unique_ptr<ILog>(new logging::AsyncLog(std::unique_ptr<ILog>(new logging::Std(ILog::Level::Info, g_NullDevice))));
+    }});
+#ifndef _WIN32
+    sinks.push_back({ "mapped_file", [](const boost::filesystem::path& folder){
+        return std::unique_ptr<ILog>(new logging::MappedFile(ILog::Level::Info, (folder / "mapped.log").string().c_str()));
+    }});
+#endif
+    sinks.push_back({ "sharded", [](const boost::filesystem::path& folder){
+        return std::unique_ptr<ILog>(new logging::Sharded(ILog::Level::Info, (folder / "sharded.log").string().c_str()));
+    }});
+    sinks.push_back({ "binary", [](const boost::filesystem::path& folder){
+        return std::unique_ptr<ILog>(new logging::Binary(ILog::Level::Info, (folder / "binary.log").string().c_str()));
+    }});
+#ifdef LOG_BENCH_LOG4CPLUS
+    sinks.push_back({ "log4cplus", [](const boost::filesystem::path& folder){
+        // file appender only, the basic configuration would also print every record to stdout
+        const auto properties = (folder / "log4cplus.properties").string();
+        std::ofstream(properties)
+            << "log4cplus.rootLogger=INFO, file\n"
+            << "log4cplus.appender.file=log4cplus::FileAppender\n"
+            << "log4cplus.appender.file.File=" << (folder / "log4cplus.log").generic_string() << "\n"
+            << "log4cplus.appender.file.Append=true\n"
+            << "log4cplus.appender.file.layout=log4cplus::PatternLayout\n"
+            << "log4cplus.appender.file.layout.ConversionPattern=[%-5p][%D{%Y-%m-%d %H:%M:%S.%q}][%c] [%t] %m%n\n";
+        return std::unique_ptr<ILog>(new logging::Log4cplus(properties));
+    }});
+#endif
+    return sinks;
+}
+
+bool Parse(int argc, char* argv[], Options& options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (arg == "--json")
+            options.json = true;
+        else if (arg == "--filter" && hasValue)
+            options.filter = argv[++i];
+        else if (arg == "--calls" && hasValue)
+            options.calls = std::max<std::size_t>(std::stoul(argv[++i]), g_Batch);
+        else if (arg == "--threads" && hasValue)
+            options.threads = std::max(1u, static_cast<unsigned>(std::stoul(argv[++i])));
+        else if (arg == "--dir" && hasValue)
+            options.folder = argv[++i];
+        else
+            return false;
+    }
+    return true;
+}
+
+} // anonymous namespace
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    if (!Parse(argc, argv, options))
+    {
+        std::cerr << "usage: log_bench [--json] [--filter text] [--calls N] [--threads N] [--dir path]" << std::endl;
+        return 1;
+    }
+
+    boost::filesystem::create_directories(options.folder);
+
+    const auto selected = [&options](const std::string& name) {
+        return options.filter.empty() || name.find(options.filter) != std::string::npos;
+    };
+
+    if (!options.json)
+        std::printf("%-32s %7s %10s %10s %10s %10s %14s\n", "benchmark", "threads", "ns/call", "p50", "p99", "p99.9", "calls/s");
+
+    // formatting only, the sink is not involved
+    if (selected("txt_scalars"))
+    {
+        Report(options, MeasureLatency("txt_scalars", options.calls, [](std::size_t i){
+            g_Sink = TXT("value %1% of %2%: %3%", i, 3.14, "text").size();
+        }));
+    }
+    if (selected("txt_containers"))
+    {
+        const std::vector<int> vector = { 1, 2, 3, 4, 5, 6, 7, 8 };
+        const std::map<std::string, int> map = { { "one", 1 }, { "two", 2 }, { "three", 3 } };
+        Report(options, MeasureLatency("txt_containers", options.calls, [&](std::size_t){
+            g_Sink = TXT("vector %1% map %2%", vector, map).size();
+        }));
+    }
+    if (selected("disabled_level"))
+    {
+        logging::Std std(ILog::Level::Info, g_NullDevice);
+        ILog* logger = &std;
+        Report(options, MeasureLatency("disabled_level", options.calls, [logger](std::size_t i){
+            LDEBUG(logger, CURRENT_MODULE_ID, "disabled %1%", i);
+        }));
+    }
+
+    for (const auto& entry : GetSinks())
+    {
+        const auto latency = entry.name + "_latency";
+        if (selected(latency))
+        {
+            const auto log = entry.create(options.folder);
+            ILog* logger = log.get();
+            Report(options, MeasureLatency(latency, options.calls, [logger](std::size_t i){
+                LINFO(logger, CURRENT_MODULE_ID, "record %1% value %2%", i, 3.14);
+            }));
+        }
+
+        const auto throughput = entry.name + "_throughput";
+        if (!selected(throughput))
+            continue;
+
+        for (unsigned threads = 1; ; threads = std::min(threads * 2, options.threads))
+        {
+            const auto log = entry.create(options.folder);
+            ILog* logger = log.get();
+            Report(options, MeasureThroughput(throughput, threads, options.calls, [logger](std::size_t i){
+                LINFO(logger, CURRENT_MODULE_ID, "record %1% value %2%", i, 3.14);
+            }));
+            if (threads == options.threads)
+                break;
+        }
+    }
+
+    boost::system::error_code error;
+    boost::filesystem::remove_all(options.folder, error);
+    return 0;
+}
@@ -0,0 +1,240 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+#include <boost/container/small_vector.hpp>
+#include <boost/utility/string_ref.hpp>
+
+namespace logging
+{
+
+//! Log message arguments captured in binary form
+//!
+//! Stores the format string pointer and a compact copy of the arguments,
+//! the format is expanded later by the sink or by the writer thread.
+//! Structured arguments hold a message instead of a format and alternate keys and values,
+//! see logging::Fields; sinks that don't know them get "message key=value ...".
+//!
+//! \class Arguments
+//!
+class Arguments
+{
+public:
+
+    //! Argument types
+    struct Type
+    {
+        enum Value : unsigned char
+        {
+            Bool        = 0,
+            Char        = 1,
+            Signed      = 2,
+            Unsigned    = 3,
+            Double      = 4,
+            String      = 5,
+            Pointer     = 6,
+        };
+    };
+
+    //! Tag of structured arguments
+    struct Structured {};
+
+    Arguments() : m_Format(), m_Count(), m_Structured() {}
+
+    //! Format must have static storage duration, i.e. be a string literal
+    explicit Arguments(const char* format) : m_Format(format), m_Count(), m_Structured() {}
+
+    //! Format is copied
+    explicit Arguments(const std::string& format) : m_Format(), m_Count(), m_Structured(), m_FormatCopy(format) {}
+
+    //! Message must be a string literal, add keys and values in turn
+    Arguments(const char* message, Structured) : m_Format(message), m_Count(), m_Structured(true) {}
+
+    //! Message is copied
+    Arguments(const std::string& message, Structured) : m_Format(), m_Count(), m_Structured(true), m_FormatCopy(message) {}
+
+    //! Format and raw payload are copied, e.g. when read back from a binary log
+    Arguments(const std::string& format, const char* data, std::size_t size, bool structured = false)
+        : m_Format(), m_Count(), m_Structured(structured), m_FormatCopy(format), m_Data(data, data + size)
+    {
+        Visit([this](const auto&){ ++m_Count; });
+    }
+
+    void Add(bool value)                { Put(Type::Bool, value); }
+    void Add(char value)                { Put(Type::Char, value); }
+    void Add(signed char value)         { Put(Type::Char, static_cast<char>(value)); }
+    void Add(unsigned char value)       { Put(Type::Char, static_cast<char>(value)); }
+    void Add(float value)               { Put(Type::Double, static_cast<double>(value)); }
+    void Add(double value)              { Put(Type::Double, value); }
+    void Add(long double value)         { Put(Type::Double, static_cast<double>(value)); }
+    void Add(const void* value)         { Put(Type::Pointer, value); }
+    void Add(const char* value)         { AddString(value ? value : "(null)", value ? std::strlen(value) : 6); }
+    void Add(const std::string& value)  { AddString(value.data(), value.size()); }
+    void Add(boost::string_ref value)   { AddString(value.data(), value.size()); }
+
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type Add(T value)
+    {
+        Put(Type::Signed, static_cast<std::int64_t>(value));
+    }
+
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value>::type Add(T value)
+    {
+        Put(Type::Unsigned, static_cast<std::uint64_t>(value));
+    }
+
+    //! Format string
+    const char* GetFormat() const { return m_Format ? m_Format : m_FormatCopy.c_str(); }
+
+    //! Format is a string literal, the pointer stays valid after the arguments are gone
+    bool IsFormatStatic() const { return m_Format != nullptr; }
+
+    //! Nothing captured
+    bool IsEmpty() const { return !m_Format && m_FormatCopy.empty(); }
+
+    //! Message with key/value pairs instead of a format
+    bool IsStructured() const { return m_Structured; }
+
+    //! Number of captured arguments
+    std::size_t GetCount() const { return m_Count; }
+
+    //! Raw argument payload
+    const char* GetData() const { return m_Data.data(); }
+    std::size_t GetSize() const { return m_Data.size(); }
+
+    //! Expand format with captured arguments, structured ones as "message key=value ..."
+    std::string Format() const;
+
+    //! Call visitor with each argument as bool, char, std::int64_t, std::uint64_t, double, boost::string_ref or const void*
+    template <typename Visitor>
+    void Visit(Visitor&& visitor) const
+    {
+        Visit(m_Data.data(), m_Data.size(), visitor);
+    }
+
+    //! Payload is well formed: known types, values and string lengths within the size; check data read back before visiting it
+    static bool IsValid(const char* data, std::size_t size)
+    {
+        const char* it = data;
+        const char* const end = it + size;
+        while (it != end)
+        {
+            const auto type = static_cast<Type::Value>(*it++);
+            std::size_t length = 0;
+            switch (type)
+            {
+            case Type::Bool:        length = sizeof(bool); break;
+            case Type::Char:        length = sizeof(char); break;
+            case Type::Signed:      length = sizeof(std::int64_t); break;
+            case Type::Unsigned:    length = sizeof(std::uint64_t); break;
+            case Type::Double:      length = sizeof(double); break;
+            case Type::Pointer:     length = sizeof(const void*); break;
+            case Type::String:
+            {
+                std::uint32_t string;
+                if (static_cast<std::size_t>(end - it) < sizeof(string))
+                    return false;
+                std::memcpy(&string, it, sizeof(string));
+                length = sizeof(string) + string;
+                break;
+            }
+            default:
+                return false;
+            }
+            if (static_cast<std::size_t>(end - it) < length)
+                return false;
+            if (type == Type::Bool && static_cast<unsigned char>(*it) > 1)
+                return false;
+            it += length;
+        }
+        return true;
+    }
+
+    //! Visit a raw payload, doesn't allocate
+    template <typename Visitor>
+    static void Visit(const char* data, std::size_t size, Visitor&& visitor)
+    {
+        const char* it = data;
+        const char* const end = it + size;
+        while (it != end)
+        {
+            const auto type = static_cast<Type::Value>(*it++);
+            switch (type)
+            {
+            case Type::Bool:        visitor(Get<bool>(it)); break;
+            case Type::Char:        visitor(Get<char>(it)); break;
+            case Type::Signed:      visitor(Get<std::int64_t>(it)); break;
+            case Type::Unsigned:    visitor(Get<std::uint64_t>(it)); break;
+            case Type::Double:      visitor(Get<double>(it)); break;
+            case Type::Pointer:     visitor(Get<const void*>(it)); break;
+            case Type::String:
+            {
+                const auto size = Get<std::uint32_t>(it);
+                visitor(boost::string_ref(it, size));
+                it += size;
+                break;
+            }
+            }
+        }
+    }
+
+    //! Call visitor with each key as boost::string_ref and its value as Visit would, structured arguments only
+    template <typename Visitor>
+    void VisitFields(Visitor&& visitor) const
+    {
+        boost::string_ref key;
+        bool isKey = true;
+        Visit([&](const auto& value) {
+            if (isKey)
+                key = ToKey(value);
+            else
+                visitor(key, value);
+            isKey = !isKey;
+        });
+    }
+
+private:
+    static boost::string_ref ToKey(boost::string_ref value) { return value; }
+
+    template <typename T>
+    static boost::string_ref ToKey(const T&) { return boost::string_ref(); }
+
+    template <typename T>
+    void Put(Type::Value type, const T& value)
+    {
+        const auto offset = m_Data.size();
+        m_Data.resize(offset + 1 + sizeof(T));
+        m_Data[offset] = static_cast<char>(type);
+        std::memcpy(&m_Data[offset + 1], &value, sizeof(T));
+        ++m_Count;
+    }
+
+    void AddString(const char* data, std::size_t size)
+    {
+        const auto length = static_cast<std::uint32_t>(size);
+        Put(Type::String, length);
+        m_Data.insert(m_Data.end(), data, data + length);
+    }
+
+    template <typename T>
+    static T Get(const char*& it)
+    {
+        T value;
+        std::memcpy(&value, it, sizeof(T));
+        it += sizeof(T);
+        return value;
+    }
+
+private:
+    const char* m_Format;
+    std::size_t m_Count;
+    bool m_Structured;
+    std::string m_FormatCopy;
+    boost::container::small_vector<char, 96> m_Data;
+};
+
+} // namespace logging
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "log.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+namespace logging
+{
+
+//! Asynchronous logger decorator
+//!
+//! Callers push records into a bounded lock-free multi-producer queue,
+//! a dedicated writer thread drains it into the wrapped sink. Deferred arguments reach the sink as
+//! they are, it expands them on the writer thread or keeps the binary form.
+//! Module names of records without a call site are interned, so a runtime string may go away once
+//! Write returns; formats that are not string literals are copied by Capture and Fields.
+//!
+//! \class AsyncLog
+//!
+class AsyncLog : public ILog
+{
+public:
+
+    //! Queue overflow policies
+    struct Overflow
+    {
+        enum Value
+        {
+            Block       = 0, //!< wait until the writer thread frees a slot
+            Drop        = 1, //!< discard the record
+            DropBelow   = 2, //!< discard records less severe than the threshold, wait for the rest
+        };
+    };
+
+    AsyncLog(std::unique_ptr<ILog> log, std::size_t capacity = 8192, Overflow::Value overflow = Overflow::Block, ILog::Level::Value threshold = ILog::Level::Info);
+    ~AsyncLog();
+
+    virtual bool IsEnabled(const char* module, Level::Value level) const override;
+    virtual boost::filesystem::path GetLogFolder(const char* module) const override;
+    virtual void Write(const char* module, ILog::Level::Value level, const std::string& text, const char* file, unsigned line, const char* function) override;
+    virtual void Write(const char* module, ILog::Level::Value level, const Arguments& arguments, const char* file, unsigned line, const char* function) override;
+    virtual void Write(const char* module, ILog::Level::Value level, const char* text, std::size_t size, const char* file, unsigned line, const char* function) override;
+    virtual void Write(const CallSite& site, const std::string& text) override;
+    virtual void Write(const CallSite& site, const char* text, std::size_t size) override;
+    virtual void Write(const CallSite& site, const Arguments& arguments) override;
+    virtual void Write(const Record& record) override;
+    virtual void SetLevel(Level::Value level) override;
+    virtual void SetLevels(const boost::property_tree::ptree& settings) override;
+
+    //! Wait until all records queued before this call are written and flush the sink
+    virtual void Flush() override;
+
+    //! Number of records discarded by the overflow policy
+    std::uint64_t GetDropped() const;
+
+    //! Keep the cache line alignment of the queue indexes for heap instances, plain new does not before C++17
+    static void* operator new(std::size_t size);
+    static void operator delete(void* pointer);
+
+private:
+    struct Cell
+    {
+        std::atomic<std::size_t> m_Sequence;
+        Record m_Record;
+    };
+
+    void Push(Record&& record);
+    bool TryPush(Record& record);
+    std::size_t Drain();
+    void Wake();
+    void Run();
+
+private:
+    const std::unique_ptr<ILog> m_Log;
+    const Overflow::Value m_Overflow;
+    const ILog::Level::Value m_Threshold;
+    const std::size_t m_Mask;
+    std::unique_ptr<Cell[]> m_Cells;
+
+    alignas(64) std::atomic<std::size_t> m_Head;
+    alignas(64) std::size_t m_Tail;
+    std::vector<Record> m_Batch;        //!< records taken by the writer thread, handed to the sink at once
+    std::atomic<std::size_t> m_Written;
+    std::atomic<std::uint64_t> m_Dropped;
+
+    std::atomic<bool> m_Sleeping;
+    std::atomic<bool> m_Stopped;
+    std::atomic<unsigned> m_FlushWaiters;
+    boost::mutex m_Mutex;
+    boost::condition_variable m_Wakeup;
+    boost::condition_variable m_Flushed;
+    boost::thread m_Thread;
+};
+
+} // namespace logging
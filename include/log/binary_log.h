@@ -0,0 +1,100 @@
+#pragma once
+
+#include "log.h"
+#include "log/std_log.h"
+
+#include <cstdint>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/functional/hash.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+namespace logging
+{
+
+namespace detail
+{
+    class OutputBuffer;
+} // namespace detail
+
+//! Compact binary file sink
+//!
+//! Records are length prefixed; module, function, format and thread names are interned, timestamps are
+//! varint deltas and deferred arguments keep their raw payload. The file is split into self-contained
+//! blocks and file.idx maps the start time of every block to its offset, so a reader can seek to a time
+//! window. Records from LOG_* call sites refer to the site, defined once per block, instead of repeating the
+//! level, module, function and format. log_decode (see Decode) renders the file in the Std text layout.
+//! Levels may be set per module, as for Std.
+//!
+//! \class Binary
+//!
+class Binary : public ILog
+{
+public:
+    Binary(ILog::Level::Value level, const char* file, const FlushPolicy& policy = FlushPolicy(), std::size_t block = 1024 * 1024);
+    ~Binary();
+
+    using ILog::Write;
+
+    virtual bool IsEnabled(const char* module, Level::Value level) const override;
+    virtual boost::filesystem::path GetLogFolder(const char* module) const override;
+    virtual void Write(const char* module, ILog::Level::Value level, const std::string& text, const char* file, unsigned line, const char* function) override;
+    virtual void Write(const char* module, ILog::Level::Value level, const char* text, std::size_t size, const char* file, unsigned line, const char* function) override;
+    virtual void Write(const char* module, ILog::Level::Value level, const logging::Arguments& arguments, const char* file, unsigned line, const char* function) override;
+    virtual void Write(const CallSite& site, const std::string& text) override;
+    virtual void Write(const CallSite& site, const char* text, std::size_t size) override;
+    virtual void Write(const CallSite& site, const Arguments& arguments) override;
+    virtual void Write(const Record& record) override;
+    virtual void SetLevel(Level::Value level) override;
+    virtual void SetLevels(const boost::property_tree::ptree& settings) override;
+    virtual void Flush() override;
+
+private:
+    void Append(const char* module, ILog::Level::Value level, boost::string_ref text, const Arguments* arguments, const char* function, std::uint64_t time, const boost::thread::id& thread);
+    void Append(const CallSite& site, boost::string_ref text, const Arguments* arguments, std::uint64_t time, const boost::thread::id& thread);
+    std::uint64_t Intern(const CallSite& site);
+    std::uint64_t Intern(const char* text);
+    std::uint64_t Intern(const boost::thread::id& thread);
+    void StartBlock(std::uint64_t time);
+    void Put(const std::string& body);
+    void RunFlusher();
+
+private:
+    const FlushPolicy m_Policy;
+    const std::size_t m_BlockSize;
+    const std::string m_FileName;
+    const std::unique_ptr<detail::PublishedLevels> m_Levels;
+
+    std::ofstream m_File;
+    std::ofstream m_Index;
+    std::unique_ptr<detail::OutputBuffer> m_Buffer;
+    std::ostream m_Output;
+
+    std::uint64_t m_BlockStart;
+    std::uint64_t m_Time;
+    std::uint64_t m_NextId;
+    std::unordered_map<const char*, std::pair<std::uint64_t, std::string>> m_Strings;
+    std::unordered_map<boost::thread::id, std::uint64_t, boost::hash<boost::thread::id>> m_Threads;
+    std::vector<std::uint64_t> m_Sites;     //!< file ids by CallSite id, 0 if not defined in this block
+    std::string m_Body;
+    std::string m_Definition;
+
+    boost::mutex m_Mutex;
+    boost::condition_variable m_Stop;
+    bool m_Stopped;
+    boost::thread m_Flusher;
+};
+
+//! Render records of a Binary log with time in [from, to] (nanoseconds since the epoch) in the Std text layout,
+//! uses file.idx to skip the blocks before the window if it exists. Decoding stops at a partial trailing record,
+//! a damaged record is dropped and decoding goes on at the next block listed in file.idx
+void Decode(const std::string& file, std::ostream& out, std::uint64_t from = 0, std::uint64_t to = std::numeric_limits<std::uint64_t>::max());
+
+} // namespace logging
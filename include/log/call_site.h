@@ -0,0 +1,91 @@
+#pragma once
+
+#include "log/logger.h"
+
+#include <atomic>
+#include <cstddef>
+
+namespace logging
+{
+
+//! Static descriptor of a logging statement
+//!
+//! Every LOG_* macro defines one in static storage, constant initialized when the format is a literal.
+//! The site registers itself on the first hit and gets a process-wide id, sinks may use the id
+//! to keep per-site state (rendered prefixes, counters) or to write it instead of the strings.
+//!
+//! \class CallSite
+//!
+class CallSite
+{
+public:
+    constexpr CallSite(const char* module, ILog::Level::Value level, const char* file, unsigned line, const char* format)
+        : m_Module(module)
+        , m_Level(level)
+        , m_File(file)
+        , m_Line(line)
+        , m_Format(format)
+        , m_Function(nullptr)
+        , m_Id(0)
+    {
+    }
+
+    CallSite(const CallSite&) = delete;
+    CallSite& operator = (const CallSite&) = delete;
+
+    //! Register the site on the first hit
+    const CallSite& Hit(const char* function)
+    {
+        if (!m_Id.load(std::memory_order_acquire))
+            Register(function);
+        return *this;
+    }
+
+    const char* GetModule() const { return m_Module; }
+    ILog::Level::Value GetLevel() const { return m_Level; }
+    const char* GetFile() const { return m_File; }
+    unsigned GetLine() const { return m_Line; }
+    const char* GetFunction() const { return m_Function; }
+
+    //! Format string literal, nullptr if the site was not given a literal
+    const char* GetFormat() const { return m_Format; }
+
+    //! Site id, starts from 1, 0 until registered
+    unsigned GetId() const { return m_Id.load(std::memory_order_acquire); }
+
+    //! Registered site by id, nullptr if unknown
+    static const CallSite* Find(unsigned id);
+
+    //! Number of registered sites
+    static std::size_t GetCount();
+
+private:
+    void Register(const char* function);
+
+private:
+    const char* const m_Module;
+    const ILog::Level::Value m_Level;
+    const char* const m_File;
+    const unsigned m_Line;
+    const char* const m_Format;
+    const char* m_Function;
+    std::atomic<unsigned> m_Id;
+};
+
+namespace detail
+{
+    //! Only string literals are kept as the site format
+    template <std::size_t N>
+    constexpr const char* FormatOf(const char (&format)[N])
+    {
+        return format;
+    }
+
+    template <typename T>
+    constexpr const char* FormatOf(const T& /*format*/)
+    {
+        return nullptr;
+    }
+} // namespace detail
+
+} // namespace logging
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+
+namespace logging
+{
+
+//! Low cost wall clock for log records
+//!
+//! Reads the monotonic clock and adds an offset anchored to the system clock. The anchor is refreshed
+//! once a minute, so wall clock adjustments show up without a system clock read on every record.
+//! Timestamps are raw nanoseconds since the Unix epoch (UTC), sinks render them when and if they need to.
+//!
+//! \class Clock
+//!
+class Clock
+{
+public:
+    //! Current time in nanoseconds since the epoch
+    static std::uint64_t Now();
+};
+
+} // namespace logging
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include <boost/utility/string_ref.hpp>
+
+namespace logging
+{
+
+//! Rendered fields of a thread at one moment, immutable and shared by every record written until they change
+//!
+//! A record keeps a reference, not a copy: capturing the context is a counter increment.
+//!
+//! \class ContextSnapshot
+//!
+class ContextSnapshot
+{
+public:
+    ContextSnapshot() = default;
+    explicit ContextSnapshot(std::shared_ptr<const std::string> text) : m_Text(std::move(text)) {}
+
+    //! Fields as "key=value key=value", empty if there were none
+    boost::string_ref GetText() const { return m_Text ? boost::string_ref(*m_Text) : boost::string_ref(); }
+    operator boost::string_ref() const { return GetText(); }
+
+    bool IsEmpty() const { return !m_Text || m_Text->empty(); }
+
+private:
+    std::shared_ptr<const std::string> m_Text;
+};
+
+//! Key/value field attached to every record the thread writes while in scope
+//!
+//! Fields form a per-thread stack, nothing is prepended to the messages. Sinks ask for the rendered
+//! fields of the writing thread, the text is rebuilt only when a field is entered or left and records
+//! share it through a ContextSnapshot.
+//! Text values are kept by pointer and must outlive the scope, temporary strings and numbers are stored.
+//!
+//! \class ScopedContext
+//!
+class ScopedContext
+{
+public:
+    ScopedContext(const char* key, boost::string_ref value);
+
+    //! Temporary strings would dangle as a view, they are moved in
+    ScopedContext(const char* key, std::string&& value)
+        : m_Storage(std::move(value))
+        , m_Key(key)
+        , m_Value(m_Storage)
+    {
+        Enter();
+    }
+
+    template <typename T, typename = typename std::enable_if<std::is_arithmetic<T>::value>::type>
+    ScopedContext(const char* key, T value)
+        : m_Storage(std::to_string(value))
+        , m_Key(key)
+        , m_Value(m_Storage)
+    {
+        Enter();
+    }
+
+    ~ScopedContext();
+
+    ScopedContext(const ScopedContext&) = delete;
+    ScopedContext& operator = (const ScopedContext&) = delete;
+
+    const char* GetKey() const { return m_Key; }
+    boost::string_ref GetValue() const { return m_Value; }
+
+    //! Enclosing field, nullptr for the outermost one
+    const ScopedContext* GetOuter() const { return m_Outer; }
+
+    //! Innermost field of the thread, nullptr if there is none
+    static const ScopedContext* GetCurrent();
+
+    //! Fields of the thread as "key=value key=value", outermost first, empty if there are none
+    static boost::string_ref GetText();
+
+    //! Fields of the thread as a shared snapshot, for records written later or on another thread
+    static const ContextSnapshot& GetSnapshot();
+
+private:
+    void Enter();
+
+private:
+    const std::string m_Storage;
+    const char* const m_Key;
+    const boost::string_ref m_Value;
+    const ScopedContext* m_Outer;
+};
+
+} // namespace logging
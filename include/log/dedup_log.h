@@ -0,0 +1,118 @@
+#pragma once
+
+#include "log.h"
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+namespace logging
+{
+
+//! Duplicate collapsing decorator, writes a repeating message once per window
+//!
+//! Messages are keyed on module, level, call site and a hash of the text, or of the format and the binary
+//! arguments, so a repeat costs a hash lookup and no formatting. The first occurrence is written and opens
+//! a window, repeats within it are counted and dropped. When the window expires, on the next occurrence
+//! or by the sweeper thread, a "last message repeated N times" record is written at the same call site.
+//! Flush and destruction write the pending counts out.
+//!
+//! \class DedupLog
+//!
+class DedupLog : public ILog
+{
+public:
+
+    struct Settings
+    {
+        unsigned window = 1000;         //!< milliseconds repeats are collapsed for after a message is written
+        std::size_t capacity = 4096;    //!< messages tracked at once, others pass unchecked until some expire
+    };
+
+    explicit DedupLog(std::unique_ptr<ILog> log);
+    DedupLog(std::unique_ptr<ILog> log, const Settings& settings);
+    ~DedupLog();
+
+    virtual bool IsEnabled(const char* module, Level::Value level) const override;
+    virtual boost::filesystem::path GetLogFolder(const char* module) const override;
+    virtual void Write(const char* module, ILog::Level::Value level, const std::string& text, const char* file, unsigned line, const char* function) override;
+    virtual void Write(const char* module, ILog::Level::Value level, const char* text, std::size_t size, const char* file, unsigned line, const char* function) override;
+    virtual void Write(const char* module, ILog::Level::Value level, const Arguments& arguments, const char* file, unsigned line, const char* function) override;
+    virtual void Write(const CallSite& site, const std::string& text) override;
+    virtual void Write(const CallSite& site, const char* text, std::size_t size) override;
+    virtual void Write(const CallSite& site, const Arguments& arguments) override;
+    virtual void Write(const Record& record) override;
+    virtual void Write(const Record& record, RenderedLine& line) override;
+    virtual void WriteBatch(const Record* records, std::size_t count) override;
+    virtual void SetLevel(Level::Value level) override;
+    virtual void SetLevels(const boost::property_tree::ptree& settings) override;
+
+    //! Write pending repeat counts and flush the sink
+    virtual void Flush() override;
+
+private:
+    struct Key
+    {
+        const char* module;
+        ILog::Level::Value level;
+        const void* site;       //!< call site, or the file for records written without one
+        unsigned line;
+        std::uint64_t hash;
+
+        bool operator == (const Key& other) const
+        {
+            return hash == other.hash && module == other.module && level == other.level && site == other.site && line == other.line;
+        }
+    };
+
+    struct KeyHash
+    {
+        std::size_t operator () (const Key& key) const { return static_cast<std::size_t>(key.hash); }
+    };
+
+    //! Message of an open window
+    struct Entry
+    {
+        Record record;          //!< first occurrence, its time opens the window
+        std::uint64_t count;    //!< repeats dropped since
+        std::uint64_t last;     //!< time of the last repeat
+    };
+
+    struct Shard
+    {
+        boost::mutex m_Mutex;
+        std::unordered_map<Key, Entry, KeyHash> m_Entries;
+    };
+
+    //! Message is written, repeats within the window are counted instead; make builds the record kept for the summary
+    template <typename Make>
+    bool Pass(const Key& key, std::uint64_t time, Make&& make);
+
+    //! Pass calling before ahead of writing the summary of an expired window
+    template <typename Make, typename Before>
+    bool Pass(const Key& key, std::uint64_t time, Make&& make, Before&& before);
+
+    //! Write counts of windows expired by the time, all of them if forced
+    void Expire(std::uint64_t time, bool force);
+    void WriteRepeated(const Entry& entry);
+    void Run();
+
+private:
+    const std::unique_ptr<ILog> m_Log;
+    const Settings m_Settings;
+    const std::uint64_t m_Window;   //!< nanoseconds
+
+    static const std::size_t s_Shards = 16;
+    Shard m_Shards[s_Shards];
+
+    boost::mutex m_Mutex;
+    boost::condition_variable m_Stop;
+    bool m_Stopped;
+    boost::thread m_Sweeper;
+};
+
+} // namespace logging
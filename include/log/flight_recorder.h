@@ -0,0 +1,77 @@
+#pragma once
+
+#include "log.h"
+
+#include <cstdint>
+#include <memory>
+
+namespace logging
+{
+
+//! Flight recorder decorator, keeps recent records the wrapped sink does not write
+//!
+//! Records below the level of the wrapped sink go to a per-thread ring of fixed-size slots instead, the ring is
+//! written only by its thread, so recording takes no lock and no allocation. The ring of an exited thread keeps
+//! its records until a new thread takes it over, so the number of rings follows the threads recording at once. Deferred arguments with a literal
+//! format are kept in binary form and expanded only when dumped. The rings are dumped to the wrapped sink,
+//! ordered by time, before a record at the trigger level and on Dump(); DumpTo() and the crash handler
+//! write them to a file descriptor without allocating.
+//!
+//! \class FlightRecorder
+//!
+class FlightRecorder : public ILog
+{
+public:
+
+    struct Settings
+    {
+        std::size_t records = 1024;                         //!< records kept per thread
+        ILog::Level::Value level = ILog::Level::Trace;      //!< most verbose level recorded
+        ILog::Level::Value trigger = ILog::Level::Error;    //!< written records at this level or above dump the rings first
+    };
+
+    explicit FlightRecorder(std::unique_ptr<ILog> log);
+    FlightRecorder(std::unique_ptr<ILog> log, const Settings& settings);
+    ~FlightRecorder();
+
+    virtual bool IsEnabled(const char* module, Level::Value level) const override;
+    virtual boost::filesystem::path GetLogFolder(const char* module) const override;
+    virtual void Write(const char* module, ILog::Level::Value level, const std::string& text, const char* file, unsigned line, const char* function) override;
+    virtual void Write(const char* module, ILog::Level::Value level, const char* text, std::size_t size, const char* file, unsigned line, const char* function) override;
+    virtual void Write(const char* module, ILog::Level::Value level, const Arguments& arguments, const char* file, unsigned line, const char* function) override;
+    virtual void Write(const CallSite& site, const std::string& text) override;
+    virtual void Write(const CallSite& site, const char* text, std::size_t size) override;
+    virtual void Write(const CallSite& site, const Arguments& arguments) override;
+    virtual void Write(const Record& record) override;
+    virtual void SetLevel(Level::Value level) override;
+    virtual void SetLevels(const boost::property_tree::ptree& settings) override;
+    virtual void Flush() override;
+
+    //! Write records recorded since the last dump to the wrapped sink
+    void Dump();
+
+#ifndef _WIN32
+    //! Write all recorded records to the descriptor, async-signal-safe, arguments are printed after the format
+    void DumpTo(int fd) const;
+
+    //! Dump to the descriptor on SIGSEGV, SIGBUS, SIGILL, SIGFPE and SIGABRT, then re-raise the signal
+    void InstallCrashHandler(int fd = 2);
+#endif
+
+private:
+    class Ring;
+    struct Pool;
+
+    //! Record is written to the wrapped sink, after dumping the rings if it is at the trigger level
+    bool Pass(const char* module, ILog::Level::Value level);
+    Ring& GetRing();
+
+private:
+    const std::unique_ptr<ILog> m_Log;
+    const Settings m_Settings;
+    const unsigned m_Instance;
+
+    const std::shared_ptr<Pool> m_Pool;     //!< shared with the threads holding rings, they free them on exit
+};
+
+} // namespace logging
@@ -0,0 +1,175 @@
+#pragma once
+
+#include "log/logger.h"
+#include "log/static_format.h"
+
+#include <cstddef>
+#include <deque>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace logging
+{
+namespace detail
+{
+
+//! Per-thread formatting buffer, reused by every log call of the thread
+//!
+//! Buffers keep their capacity, so formatting does not allocate in steady state. Nested log calls,
+//! e.g. from operator<< of an argument, get the next buffer of the thread instead of clobbering this one.
+//!
+class ScopedBuffer
+{
+public:
+    //! Capacity above which a buffer is released after use, one huge message should not pin the memory
+    static const std::size_t s_MaxRetained = 64 * 1024;
+
+    ScopedBuffer()
+        : m_Buffer(Acquire())
+    {
+        m_Buffer.clear();
+    }
+
+    ~ScopedBuffer()
+    {
+        if (m_Buffer.capacity() > s_MaxRetained)
+            std::string().swap(m_Buffer);
+        --GetDepth();
+    }
+
+    ScopedBuffer(const ScopedBuffer&) = delete;
+    ScopedBuffer& operator = (const ScopedBuffer&) = delete;
+
+    std::string& Get()
+    {
+        return m_Buffer;
+    }
+
+private:
+    static std::string& Acquire()
+    {
+        auto& depth = GetDepth();
+        auto& pool = GetPool();
+        if (depth == pool.size())
+            pool.emplace_back();
+        return pool[depth++];
+    }
+
+    static std::size_t& GetDepth()
+    {
+        static thread_local std::size_t depth = 0;
+        return depth;
+    }
+
+    static std::deque<std::string>& GetPool()
+    {
+        static thread_local std::deque<std::string> pool;
+        return pool;
+    }
+
+private:
+    std::string& m_Buffer;
+};
+
+template <typename Tuple, std::size_t Index>
+void AppendArgument(std::string& out, const Tuple& args, const FormatSegment& segment)
+{
+    AppendValue(out, std::get<Index>(args), segment);
+}
+
+//! Format parsed at run time with the CTXT parser, false if the format is malformed or lacks arguments
+template <typename Tuple, std::size_t ... Indexes>
+bool AppendFormat(std::string& out, const char* format, const Tuple& args, std::index_sequence<Indexes...>)
+{
+    using Appender = void (*)(std::string&, const Tuple&, const FormatSegment&);
+    static const Appender appenders[] = { &AppendArgument<Tuple, Indexes>..., nullptr };
+
+    bool positional = false;
+    bool sequential = false;
+    std::size_t next = 0;
+    std::size_t position = 0;
+    while (format[position])
+    {
+        const FormatSegment segment = ParseSegment(format, position, next);
+        if (segment.error)
+            return false;
+
+        if (segment.kind == FormatSegment::Literal)
+        {
+            out.append(format + segment.begin, segment.length);
+        }
+        else
+        {
+            (segment.positional ? positional : sequential) = true;
+            if (!segment.positional)
+                ++next;
+            if ((positional && sequential) || segment.argument >= sizeof...(Indexes))
+                return false;
+            appenders[segment.argument](out, args, segment);
+        }
+        position = segment.next;
+    }
+    return true;
+}
+
+template <typename T, typename = void>
+struct IsFormatType : std::false_type
+{
+};
+
+template <typename T>
+struct IsFormatType<T, decltype(T::Get(), void())> : std::true_type
+{
+};
+
+} // namespace detail
+
+//! Append formatted text, the format is parsed at run time with the CTXT rules;
+//! a malformed format or missing arguments leave the format text as is, like MessageFormatter
+template <typename ... Args>
+void FormatTo(std::string& out, const char* format, const Args&... args)
+{
+    const auto start = out.size();
+    if (!detail::AppendFormat(out, format, std::forward_as_tuple(args...), std::index_sequence_for<Args...>()))
+    {
+        out.resize(start);
+        out += format;
+    }
+}
+
+template <typename ... Args>
+void FormatTo(std::string& out, const std::string& format, const Args&... args)
+{
+    FormatTo(out, format.c_str(), args...);
+}
+
+//! Append formatted text, the format is a type produced by CTXT_FORMAT_TYPE
+template <typename Format, typename ... Args>
+typename std::enable_if<detail::IsFormatType<Format>::value>::type FormatTo(std::string& out, Format format, const Args&... args)
+{
+    StaticFormatTo(out, format, args...);
+}
+
+namespace detail
+{
+    //! Format into the thread buffer and pass it to the sink as a span
+    template <typename Format, typename ... Args>
+    void WriteFormatted(ILog* log, const char* module, ILog::Level::Value level, const char* file, unsigned line, const char* function, const Format& format, const Args&... args)
+    {
+        ScopedBuffer buffer;
+        FormatTo(buffer.Get(), format, args...);
+        log->Write(module, level, buffer.Get().data(), buffer.Get().size(), file, line, function);
+    }
+
+    template <typename Format, typename ... Args>
+    void WriteFormatted(ILog* log, const CallSite& site, const Format& format, const Args&... args)
+    {
+        ScopedBuffer buffer;
+        FormatTo(buffer.Get(), format, args...);
+        log->Write(site, buffer.Get().data(), buffer.Get().size());
+    }
+} // namespace detail
+
+} // namespace logging
@@ -3,15 +3,23 @@
 #include "conversion/cast.hpp"
 
 #include "log.h"
+#include "static_format.h"
+#include "format_buffer.h"
+#include "thresholds.h"
 
 #include <set>
 #include <vector>
 #include <map>
+#include <list>
+#include <deque>
+#include <sstream>
+#include <type_traits>
 
 #include <boost/format.hpp>
 #include <boost/preprocessor/control/iif.hpp>
 #include <boost/preprocessor/comparison/greater.hpp>
 #include <boost/preprocessor/variadic/size.hpp>
+#include <boost/preprocessor/variadic/elem.hpp>
 
 // Helpers
 #define FORMAT_FOR_ZERO_ARGS(text) logging::MessageFormatter(text).GetText()
@@ -20,50 +28,206 @@
     BOOST_PP_GREATER(BOOST_PP_VARIADIC_SIZE(__VA_ARGS__), 1), \
         FORMAT_FOR_NONZERO_ARGS, FORMAT_FOR_ZERO_ARGS)(__VA_ARGS__) \
 
-//! Text formatting
+//! Text formatting, the format is parsed at compile time if LOG_COMPILE_TIME_FORMAT is defined
+#ifdef LOG_COMPILE_TIME_FORMAT
+#define TXT(...)                                                                                                \
+    CTXT(__VA_ARGS__)
+#else
 #define TXT(...)                                                                                                \
     FORMAT_ARGS(__VA_ARGS__)
+#endif
+
+//! Format and arguments for FormatTo, the format becomes a type if LOG_COMPILE_TIME_FORMAT is defined
+#define LOG_FORMAT_TYPE_FOR_ZERO_ARGS(format) CTXT_FORMAT_TYPE(format)
+#define LOG_FORMAT_TYPE_FOR_NONZERO_ARGS(format, ...) CTXT_FORMAT_TYPE(format), __VA_ARGS__
+#ifdef LOG_COMPILE_TIME_FORMAT
+#define LOG_FORMAT_ARGS(...) BOOST_PP_IIF(                                                                      \
+    BOOST_PP_GREATER(BOOST_PP_VARIADIC_SIZE(__VA_ARGS__), 1),                                                   \
+        LOG_FORMAT_TYPE_FOR_NONZERO_ARGS, LOG_FORMAT_TYPE_FOR_ZERO_ARGS)(__VA_ARGS__)
+#else
+#define LOG_FORMAT_ARGS(...) __VA_ARGS__
+#endif
 
-//! Logging macro
+//! Logging macro, formats into a per-thread buffer, or on the sink side if LOG_DEFERRED_FORMATTING is defined
+#ifdef LOG_DEFERRED_FORMATTING
+#define LOG_MACRO(logger, level, module, ...)                                                                   \
+    LOG_MACRO_DEFERRED(logger, level, module, __VA_ARGS__)
+#else
 #define LOG_MACRO(logger, level, module, ...)                                                                   \
-    logger->Write(module, level, TXT(__VA_ARGS__), __FILE__, __LINE__, __FUNCTION__)
+    logging::detail::WriteFormatted(logger, module, level, __FILE__, __LINE__, __FUNCTION__, LOG_FORMAT_ARGS(__VA_ARGS__))
+#endif
 
+//! Deferred logging macro, captures arguments in binary form, format must be a string literal
+#define LOG_MACRO_DEFERRED(logger, level, module, ...)                                                          \
+    logger->Write(module, level, logging::Capture(__VA_ARGS__), __FILE__, __LINE__, __FUNCTION__)
+
+#if LOG_COMPILED_LEVEL >= LOG_LEVEL_INFO
 #define LINFO(logger, module, ...)                                                                              \
     ((logger && logger->IsEnabled(module, ILog::Level::Info)) ?		                                            \
         LOG_MACRO(logger, ILog::Level::Info, module, __VA_ARGS__) : void())
+#else
+#define LINFO(logger, module, ...)                                                                              \
+    LOG_DISCARD(logger, module, __VA_ARGS__)
+#endif
 #define LERROR(logger, module, ...)		                                                                        \
     ((logger && logger->IsEnabled(module, ILog::Level::Error)) ?		                                        \
         LOG_MACRO(logger, ILog::Level::Error, module, __VA_ARGS__) : void())
+#if LOG_COMPILED_LEVEL >= LOG_LEVEL_WARNING
 #define LWARNING(logger, module, ...)	                                                                        \
     ((logger && logger->IsEnabled(module, ILog::Level::Warning)) ?	                                            \
         LOG_MACRO(logger, ILog::Level::Warning, module, __VA_ARGS__) : void())
+#else
+#define LWARNING(logger, module, ...)                                                                           \
+    LOG_DISCARD(logger, module, __VA_ARGS__)
+#endif
+#if LOG_COMPILED_LEVEL >= LOG_LEVEL_TRACE
 #define LTRACE(logger, module, ...)	                                                                            \
     ((logger && logger->IsEnabled(module, ILog::Level::Trace)) ?		                                        \
         LOG_MACRO(logger, ILog::Level::Trace, module, __VA_ARGS__) : void())
+#else
+#define LTRACE(logger, module, ...)                                                                             \
+    LOG_DISCARD(logger, module, __VA_ARGS__)
+#endif
+#if LOG_COMPILED_LEVEL >= LOG_LEVEL_DEBUG
 #define LDEBUG(logger, module, ...)                                                                             \
     ((logger && logger->IsEnabled(module, ILog::Level::Debug)) ?		                                        \
         LOG_MACRO(logger, ILog::Level::Debug, module, __VA_ARGS__) : void())
+#else
+#define LDEBUG(logger, module, ...)                                                                             \
+    LOG_DISCARD(logger, module, __VA_ARGS__)
+#endif
 #define LLEVELED(logger, module, lvl, ...)                                                                      \
     ((logger && logger->IsEnabled(module, lvl)) ?		                                                        \
         LOG_MACRO(logger, lvl, module, __VA_ARGS__) : void())
 
+//! Static call site of the statement, registered on the first hit
+#define LOG_CALL_SITE_ARGS(level, ...)                                                                          \
+    CURRENT_MODULE_ID, level, __FILE__, __LINE__, logging::detail::FormatOf(BOOST_PP_VARIADIC_ELEM(0, __VA_ARGS__))
+#define LOG_CALL_SITE(level, ...)                                                                               \
+    [&](const char* function) -> const logging::CallSite& {                                                     \
+        static logging::CallSite site(LOG_CALL_SITE_ARGS(level, __VA_ARGS__));                                  \
+        return site.Hit(function);                                                                              \
+    }(__FUNCTION__)
+#define LOG_CALL_SITE_LEVELED(lvl, ...)                                                                         \
+    [&](const char* function, ILog::Level::Value level) -> const logging::CallSite& {                           \
+        static logging::CallSite sites[] = {                                                                    \
+            { LOG_CALL_SITE_ARGS(ILog::Level::Error, __VA_ARGS__) },                                            \
+            { LOG_CALL_SITE_ARGS(ILog::Level::Warning, __VA_ARGS__) },                                          \
+            { LOG_CALL_SITE_ARGS(ILog::Level::Info, __VA_ARGS__) },                                             \
+            { LOG_CALL_SITE_ARGS(ILog::Level::Debug, __VA_ARGS__) },                                            \
+            { LOG_CALL_SITE_ARGS(ILog::Level::Trace, __VA_ARGS__) },                                            \
+        };                                                                                                      \
+        const auto index = static_cast<unsigned>(level);                                                        \
+        const auto last = static_cast<unsigned>(ILog::Level::Trace);                                            \
+        return sites[index < last ? index : last].Hit(function);                                                \
+    }(__FUNCTION__, lvl)
+
+//! Logging macro with a call site
+#ifdef LOG_DEFERRED_FORMATTING
+#define LOG_SITE_MACRO(logger, site, ...)                                                                       \
+    logger->Write(site, logging::Capture(__VA_ARGS__))
+#else
+#define LOG_SITE_MACRO(logger, site, ...)                                                                       \
+    logging::detail::WriteFormatted(logger, site, LOG_FORMAT_ARGS(__VA_ARGS__))
+#endif
+
+#define LSITE(logger, level, ...)                                                                               \
+    ((LOG_IS_COMPILED(level) && logger && logger->IsEnabled(CURRENT_MODULE_ID, level)) ?                                                  \
+        LOG_SITE_MACRO(logger, LOG_CALL_SITE(level, __VA_ARGS__), __VA_ARGS__) : void())
+#define LSITE_LEVELED(logger, lvl, ...)                                                                         \
+    ((LOG_IS_COMPILED(lvl) && logger && logger->IsEnabled(CURRENT_MODULE_ID, lvl)) ?                                                    \
+        LOG_SITE_MACRO(logger, LOG_CALL_SITE_LEVELED(lvl, __VA_ARGS__), __VA_ARGS__) : void())
+
+//! Structured logging, a message followed by key/value pairs kept typed up to the sink:
+//! LOG_INFO_KV("request done", "user", id, "latency_us", elapsed)
+#define LOG_MACRO_KV(logger, level, module, ...)                                                                \
+    logger->Write(module, level, logging::Fields(__VA_ARGS__), __FILE__, __LINE__, __FUNCTION__)
+
+#define LKV(logger, lvl, ...)                                                                                   \
+    ((LOG_IS_COMPILED(lvl) && logger && logger->IsEnabled(CURRENT_MODULE_ID, lvl)) ?                            \
+        LOG_MACRO_KV(logger, lvl, CURRENT_MODULE_ID, __VA_ARGS__) : void())
+
+#define LOG_ERROR_KV(...)   LKV(logging::CurrentLog::Get(), ILog::Level::Error, __VA_ARGS__)
+#define LOG_WARNING_KV(...) LKV(logging::CurrentLog::Get(), ILog::Level::Warning, __VA_ARGS__)
+#define LOG_INFO_KV(...)    LKV(logging::CurrentLog::Get(), ILog::Level::Info, __VA_ARGS__)
+#define LOG_DEBUG_KV(...)   LKV(logging::CurrentLog::Get(), ILog::Level::Debug, __VA_ARGS__)
+#define LOG_TRACE_KV(...)   LKV(logging::CurrentLog::Get(), ILog::Level::Trace, __VA_ARGS__)
+
+#if LOG_COMPILED_LEVEL >= LOG_LEVEL_INFO
 #define LOG_INFO(...) \
-    LINFO(logging::CurrentLog::Get(), CURRENT_MODULE_ID, __VA_ARGS__)
+    LSITE(logging::CurrentLog::Get(), ILog::Level::Info, __VA_ARGS__)
+#else
+#define LOG_INFO(...) \
+	LOG_DISCARD(__VA_ARGS__)
+#endif
 #define LOG_ERROR(...) \
-	LERROR(logging::CurrentLog::Get(), CURRENT_MODULE_ID, __VA_ARGS__)
+	LSITE(logging::CurrentLog::Get(), ILog::Level::Error, __VA_ARGS__)
+#if LOG_COMPILED_LEVEL >= LOG_LEVEL_WARNING
+#define LOG_WARNING(...) \
+	LSITE(logging::CurrentLog::Get(), ILog::Level::Warning, __VA_ARGS__)
+#else
 #define LOG_WARNING(...) \
-	LWARNING(logging::CurrentLog::Get(), CURRENT_MODULE_ID, __VA_ARGS__)
+	LOG_DISCARD(__VA_ARGS__)
+#endif
+#if LOG_COMPILED_LEVEL >= LOG_LEVEL_TRACE
 #define LOG_TRACE(...) \
-	LTRACE(logging::CurrentLog::Get(), CURRENT_MODULE_ID, __VA_ARGS__)
+	LSITE(logging::CurrentLog::Get(), ILog::Level::Trace, __VA_ARGS__)
+#else
+#define LOG_TRACE(...) \
+	LOG_DISCARD(__VA_ARGS__)
+#endif
+#if LOG_COMPILED_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) \
+	LSITE(logging::CurrentLog::Get(), ILog::Level::Debug, __VA_ARGS__)
+#else
 #define LOG_DEBUG(...) \
-	LDEBUG(logging::CurrentLog::Get(), CURRENT_MODULE_ID, __VA_ARGS__)
+	LOG_DISCARD(__VA_ARGS__)
+#endif
 #define LOG_LEVELED(lvl, ...) \
-	LLEVELED(logging::CurrentLog::Get(), CURRENT_MODULE_ID, static_cast<ILog::Level::Value>(lvl), __VA_ARGS__)
+	LSITE_LEVELED(logging::CurrentLog::Get(), static_cast<ILog::Level::Value>(lvl), __VA_ARGS__)
 
-#define SET_LOGGING_MODULE(name) static const char CURRENT_MODULE_ID[] = name;
+//! Module of the translation unit, its compile-time threshold comes from LOG_MODULE_LEVELS
+#define SET_LOGGING_MODULE(name)                                                                                \
+    static constexpr char CURRENT_MODULE_ID[] = name;
 
 namespace logging
 {
+    namespace detail
+    {
+        template <typename T, typename = void>
+        struct IsStreamable : std::false_type
+        {
+        };
+
+        template <typename T>
+        struct IsStreamable<T, decltype(std::declval<std::ostream&>() << std::declval<const T&>(), void())> : std::true_type
+        {
+        };
+
+        //! Any container or array without its own operator<<, except strings
+        template <typename T>
+        struct IsRangeArgument : std::integral_constant<bool,
+            GetValueKind<typename ArgumentType<T>::type>::value == ValueKind::Range &&
+            (std::is_array<T>::value || !IsStreamable<T>::value)>
+        {
+        };
+
+        //! Container argument, written element by element with the range limits applied
+        template <typename T>
+        struct RangeArgument
+        {
+            const T& value;
+        };
+
+        template <typename T>
+        std::ostream& operator << (std::ostream& stream, const RangeArgument<T>& range)
+        {
+            ScopedBuffer buffer;
+            AppendRange(buffer.Get(), range.value);
+            return stream.write(buffer.Get().data(), static_cast<std::streamsize>(buffer.Get().size()));
+        }
+    } // namespace detail
+
     class MessageFormatter
     {
     public:
@@ -83,7 +247,7 @@ namespace logging
         template <typename T, typename ... Args>
         void Print(const T& arg, const Args&... args)
         {
-            m_Format % arg;
+            Feed(arg, detail::IsRangeArgument<T>());
             Print(args...);
         }
 
@@ -94,76 +258,115 @@ namespace logging
             Print(args...);
         }
 
-        template <typename T, typename ... Args>
-        void Print(const std::vector<T>& arg, const Args&... args)
+        template <typename T>
+        void Feed(const T& arg, std::false_type)
         {
-            WriteSequence(arg);
-            Print(args...);
+            m_Format % arg;
         }
 
-        template <typename T, typename ... Args>
-        void Print(const std::set<T>& arg, const Args&... args)
+        template <typename T>
+        void Feed(const T& arg, std::true_type)
         {
-            WriteSequence(arg);
-            Print(args...);
+            m_Format % detail::RangeArgument<T>{ arg };
         }
 
-        template <typename T, typename ... Args>
-        void Print(const std::list<T>& arg, const Args&... args)
+        std::string GetText() const
         {
-            WriteSequence(arg);
-            Print(args...);
+            return m_Format.remaining_args() ? m_Text : m_Format.str();
         }
 
-        template <typename T, typename ... Args>
-        void Print(const std::deque<T>& arg, const Args&... args)
-        {
-            WriteSequence(arg);
-            Print(args...);
-        }
+    protected:
+        boost::format m_Format;
+        const std::string& m_Text;
+    };
 
-        template<typename K, typename V, typename A, typename ... Args>
-        void Print(const std::map<K, V, A>& arg, const Args&... args)
+    namespace detail
+    {
+        //! Types copied into Arguments as is, the rest are formatted on the calling thread
+        template <typename T>
+        struct IsDeferrable : std::integral_constant<bool,
+            std::is_arithmetic<T>::value ||
+            (std::is_pointer<T>::value && !std::is_function<typename std::remove_pointer<T>::type>::value) ||
+            std::is_same<T, std::string>::value ||
+            std::is_same<T, boost::string_ref>::value>
         {
-            std::ostringstream oss;
-            auto it = arg.begin();
-            auto end = arg.end();
-            for (; it != end; ++it)
-            {
-                if (it != arg.begin())
-                    oss << ",";
-                oss << it->first << ":" << it->second;
-            }
+        };
 
-            m_Format % oss.str();
-            Print(args...);
+        template <typename T>
+        void DeferArgument(Arguments& arguments, const T& arg, std::true_type)
+        {
+            arguments.Add(arg);
         }
 
-        template<typename T>
-        void WriteSequence(const T& arg)
+        template <typename T>
+        void DeferArgument(Arguments& arguments, const T& arg, std::false_type)
         {
-            std::ostringstream oss;
-            auto it = arg.begin();
-            auto end = arg.end();
-            for (; it != end; ++it)
-            {
-                if (it != arg.begin())
-                    oss << ",";
-                oss << *it;
-            }
+            arguments.Add(MessageFormatter("%1%", arg).GetText());
+        }
 
-            m_Format % oss.str();
+        inline void Defer(Arguments& /*arguments*/)
+        {
         }
 
-        std::string GetText() const
+        template <typename T, typename ... Args>
+        void Defer(Arguments& arguments, const T& arg, const Args&... args)
         {
-            return m_Format.remaining_args() ? m_Text : m_Format.str();
+            DeferArgument(arguments, arg, IsDeferrable<typename std::decay<T>::type>());
+            Defer(arguments, args...);
         }
+    } // namespace detail
 
-    protected:
-        boost::format m_Format;
-        const std::string& m_Text;
-    };
+    //! Capture format and arguments, a string literal format is kept by address
+    template <std::size_t N, typename ... T>
+    Arguments Capture(const char (&format)[N], const T&... args)
+    {
+        Arguments result(static_cast<const char*>(format));
+        detail::Defer(result, args...);
+        return result;
+    }
+
+    //! Capture arguments, format is copied, so is a char pointer that may be gone before the record is written
+    template <typename ... T>
+    Arguments Capture(const std::string& format, const T&... args)
+    {
+        Arguments result(format);
+        detail::Defer(result, args...);
+        return result;
+    }
+
+    //! Capture arguments, the text of a writable buffer is copied
+    template <std::size_t N, typename ... T>
+    Arguments Capture(char (&format)[N], const T&... args)
+    {
+        return Capture(std::string(format), args...);
+    }
+
+    //! Capture message and key/value pairs, a string literal message is kept by address, keys are strings
+    template <std::size_t N, typename ... T>
+    Arguments Fields(const char (&message)[N], const T&... fields)
+    {
+        static_assert(sizeof...(T) % 2 == 0, "Fields takes a message followed by key/value pairs");
+        Arguments result(static_cast<const char*>(message), Arguments::Structured());
+        detail::Defer(result, fields...);
+        return result;
+    }
+
+    //! Capture message and key/value pairs, message is copied
+    template <typename ... T>
+    Arguments Fields(const std::string& message, const T&... fields)
+    {
+        static_assert(sizeof...(T) % 2 == 0, "Fields takes a message followed by key/value pairs");
+        Arguments result(message, Arguments::Structured());
+        detail::Defer(result, fields...);
+        return result;
+    }
+
+    //! Capture message and key/value pairs, the text of a writable buffer is copied
+    template <std::size_t N, typename ... T>
+    Arguments Fields(char (&message)[N], const T&... fields)
+    {
+        return Fields(std::string(message), fields...);
+    }
 
 }
 
@@ -2,17 +2,52 @@
 
 #include "log.h"
 
+#include <atomic>
 
 namespace logging
 {
 
+namespace detail
+{
+    //! Logger of the thread, the innermost ScopedLog or the one given to CurrentLog::Set
+    extern thread_local ILog* t_CurrentLog;
+    extern std::atomic<ILog*> g_DefaultLog;
+} // namespace detail
+
 class CurrentLog
 {
 public:
 
-    static ILog* Get();
+    //! Logger of the thread, falls back to the default one; a plain thread_local read
+    static ILog* Get()
+    {
+        ILog* const log = detail::t_CurrentLog;
+        return log ? log : detail::g_DefaultLog.load(std::memory_order_relaxed);
+    }
+
+    //! Set logger of the thread, takes ownership, the logger is deleted on reset or thread exit
     static void Set(ILog* log);
+
+    //! Set logger used by threads without their own, takes ownership
     static void SetDefault(ILog* log);
 };
 
-} // namespace logging
\ No newline at end of file
+//! Overrides the logger of the thread while in scope, doesn't take ownership
+//!
+//! \class ScopedLog
+//!
+class ScopedLog
+{
+public:
+    explicit ScopedLog(ILog* log);
+    ~ScopedLog();
+
+    ScopedLog(const ScopedLog&) = delete;
+    ScopedLog& operator = (const ScopedLog&) = delete;
+
+private:
+    ILog* const m_Log;
+    const ScopedLog* const m_Outer;
+};
+
+} // namespace logging
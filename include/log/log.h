@@ -1,5 +1,9 @@
 #pragma once
 
 #include "log/logger.h"
+#include "log/clock.h"
+#include "log/call_site.h"
 #include "log/holder.h"
-#include "log/formatter.h"
\ No newline at end of file
+#include "log/context.h"
+#include "log/formatter.h"
+#include "log/rate_limit.h"
\ No newline at end of file
@@ -11,12 +11,19 @@ public:
     Log4cplus(const std::string& src);
     Log4cplus(Level::Value lvl, const char* file = nullptr);
 
+    using ILog::Write;
+
     virtual bool IsEnabled(const char* module, Level::Value level) const override;
     virtual boost::filesystem::path GetLogFolder(const char* module) const override;
     virtual void Write(const char* module, ILog::Level::Value level, const std::string& text, const char* file, unsigned line, const char* function) override;
+    virtual void WriteBatch(const Record* records, std::size_t count) override;
     virtual void SetLevel(Level::Value level) override;
     virtual void SetLevels(const boost::property_tree::ptree& settings) override;
 
+private:
+    //! Hands the text to log4cplus, false if the logger level filtered it
+    bool Print(const char* module, ILog::Level::Value level, const std::string& text, const char* file, unsigned line, const char* function);
+
 private:
     bool m_IsOpened;
 };
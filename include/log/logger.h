@@ -1,12 +1,22 @@
 #pragma once
 
 #include "conversion/cast.hpp"
+#include "log/arguments.h"
+#include "log/context.h"
 
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <map>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/filesystem/path.hpp>
+#include <boost/thread/thread.hpp>
+
+namespace logging
+{
+    class CallSite;
+    class RenderedLine;
+} // namespace logging
 
 //! Logger interface
 //!
@@ -48,6 +58,22 @@ public:
         }
     };
 
+    //! Log record, carries everything a sink needs to write the message later or on another thread
+    struct Record
+    {
+        const char* module;
+        Level::Value level;
+        std::string text;
+        const char* file;
+        unsigned line;
+        const char* function;
+        std::uint64_t time;             //!< nanoseconds since the epoch, see logging::Clock
+        boost::thread::id thread;
+        logging::Arguments arguments;   //!< deferred arguments, expanded by the sink when the text is empty
+        const logging::CallSite* site;  //!< statement descriptor, nullptr if written without one
+        logging::ContextSnapshot context; //!< context fields of the writing thread, shared, see logging::ScopedContext
+    };
+
     //! Is logging enabled
     virtual bool IsEnabled(const char* module, Level::Value level) const = 0;
 
@@ -57,6 +83,56 @@ public:
     //! Write text
     virtual void Write(const char* module, ILog::Level::Value level, const std::string& text, const char* file, unsigned line, const char* function) = 0;
 
+    //! Write text span, valid only during the call; sinks that render it directly should override it,
+    //! the default copies it into a string
+    virtual void Write(const char* module, ILog::Level::Value level, const char* text, std::size_t size, const char* file, unsigned line, const char* function)
+    {
+        Write(module, level, std::string(text, size), file, line, function);
+    }
+
+    //! Write deferred arguments, sinks that can keep the binary form should override it
+    virtual void Write(const char* module, ILog::Level::Value level, const logging::Arguments& arguments, const char* file, unsigned line, const char* function)
+    {
+        Write(module, level, arguments.Format(), file, line, function);
+    }
+
+    //! Write text from a static call site, the site outlives the logger
+    virtual void Write(const logging::CallSite& site, const std::string& text);
+
+    //! Write text span from a static call site
+    virtual void Write(const logging::CallSite& site, const char* text, std::size_t size);
+
+    //! Write deferred arguments from a static call site
+    virtual void Write(const logging::CallSite& site, const logging::Arguments& arguments);
+
+    //! Write captured record, sinks that print time and thread should override it
+    virtual void Write(const Record& record)
+    {
+        if (record.text.empty() && !record.arguments.IsEmpty())
+            Write(record.module, record.level, record.arguments, record.file, record.line, record.function);
+        else
+            Write(record.module, record.level, record.text, record.file, record.line, record.function);
+    }
+
+    //! Write captured record shared with other sinks, the line renders the text layout once for all of them;
+    //! sinks that write the text layout should override it
+    virtual void Write(const Record& record, logging::RenderedLine& /*line*/)
+    {
+        Write(record);
+    }
+
+    //! Write captured records in one go, sinks that lock or make a system call per record should override it
+    virtual void WriteBatch(const Record* records, std::size_t count)
+    {
+        for (std::size_t i = 0; i != count; ++i)
+            Write(records[i]);
+    }
+
+    //! Write buffered records out
+    virtual void Flush()
+    {
+    }
+
     //! Set logging level
     virtual void SetLevel(Level::Value level) = 0;
     virtual void SetLevels(const boost::property_tree::ptree& settings) = 0;
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "log.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+namespace logging
+{
+
+namespace detail
+{
+    class PublishedLevels;
+} // namespace detail
+
+//! Memory mapped rotating file sink
+//!
+//! Records are copied into a pre-allocated mapped segment, writers reserve space with an atomic add.
+//! The next segment is created ahead of time, so rotation is a pointer swap; truncating the full
+//! segment, renaming generations and enforcing retention happen on a background thread.
+//! Backups are named file.1 (newest) to file.N. Levels may be set per module, as for Std. POSIX only.
+//!
+//! \class MappedFile
+//!
+class MappedFile : public ILog
+{
+public:
+
+    //! Segment and retention settings
+    struct Settings
+    {
+        std::size_t segment = 64 * 1024 * 1024;     //!< bytes per segment
+        std::size_t generations = 5;                //!< number of backups kept
+        std::uint64_t limit = 0;                    //!< total bytes of backups, 0 is unlimited
+    };
+
+    MappedFile(ILog::Level::Value level, const char* file);
+    MappedFile(ILog::Level::Value level, const char* file, const Settings& settings);
+    ~MappedFile();
+
+    using ILog::Write;
+
+    virtual bool IsEnabled(const char* module, Level::Value level) const override;
+    virtual boost::filesystem::path GetLogFolder(const char* module) const override;
+    virtual void Write(const char* module, ILog::Level::Value level, const std::string& text, const char* file, unsigned line, const char* function) override;
+    virtual void Write(const char* module, ILog::Level::Value level, const char* text, std::size_t size, const char* file, unsigned line, const char* function) override;
+    virtual void Write(const Record& record) override;
+    virtual void Write(const Record& record, RenderedLine& line) override;
+    virtual void SetLevel(Level::Value level) override;
+    virtual void SetLevels(const boost::property_tree::ptree& settings) override;
+    virtual void Flush() override;
+
+    //! Number of records dropped because no segment was available
+    std::uint64_t GetDropped() const;
+
+private:
+    struct Segment
+    {
+        char* m_Data = nullptr;
+        std::size_t m_Capacity = 0;
+        int m_File = -1;
+        std::atomic<std::size_t> m_Offset{ 0 };
+        std::atomic<std::size_t> m_Used{ 0 };      //!< offset of the first record that did not fit
+        std::atomic<unsigned> m_Writers{ 0 };
+        std::atomic<unsigned> m_Generation{ 0 };    //!< bumped on every prepare, guards against stale swaps
+    };
+
+    void Append(const char* data, std::size_t size);
+    bool Swap(Segment* full, unsigned generation);
+    void Prepare(Segment& segment, const std::string& path);
+    void Close(Segment& segment);
+    void Shift();
+    void Retain();
+    void Run();
+
+private:
+    const Settings m_Settings;
+    const std::string m_FileName;
+    const std::string m_NextFileName;
+    const std::unique_ptr<detail::PublishedLevels> m_Levels;
+
+    Segment m_Segments[2];
+    std::atomic<Segment*> m_Current;
+    Segment* m_Next;
+    Segment* m_Retiring;
+    std::atomic<std::uint64_t> m_Dropped;
+
+    boost::mutex m_Mutex;
+    boost::condition_variable m_Condition;
+    bool m_Stopped;
+    boost::thread m_Thread;
+};
+
+} // namespace logging
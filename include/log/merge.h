@@ -0,0 +1,18 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace logging
+{
+
+//! Merge text logs written in the file sink layout into one stream ordered by record time
+//!
+//! Streaming k-way merge, only the next record of every input is kept in memory.
+//! Lines that do not start a record (multi-line messages) stay attached to the record before them,
+//! records with equal time keep the input order.
+//!
+void Merge(const std::vector<std::string>& files, std::ostream& out);
+
+} // namespace logging
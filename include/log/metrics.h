@@ -0,0 +1,120 @@
+#pragma once
+
+#include "log/clock.h"
+#include "log/logger.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+namespace logging
+{
+
+namespace detail
+{
+    extern std::atomic<bool> g_MetricsEnabled;
+} // namespace detail
+
+//! Logging pipeline self-instrumentation
+//!
+//! Sinks count what they write, how long writing takes and how long they wait for their lock.
+//! Every thread updates its own counters without atomic read-modify-write, Get sums all threads.
+//! Records are counted by the sinks that write them, so a record fanned out to two sinks counts twice.
+//! Disabled by default, a disabled hook is a relaxed load and a branch.
+//!
+//! \class Metrics
+//!
+class Metrics
+{
+public:
+    //! Nanosecond durations in power of two buckets, bucket i holds values below 2^i
+    struct Histogram
+    {
+        static const std::size_t Buckets = 64;
+
+        std::uint64_t buckets[Buckets] = {};
+        std::uint64_t count = 0;
+        std::uint64_t sum = 0;
+
+        //! Upper bound of the bucket holding the percentile, 0 if empty
+        std::uint64_t Percentile(double percent) const;
+        double Mean() const { return count ? static_cast<double>(sum) / static_cast<double>(count) : 0; }
+    };
+
+    //! Records and bytes of one module
+    struct Module
+    {
+        std::string name;
+        std::uint64_t messages[ILog::Level::Trace + 1] = {};
+        std::uint64_t bytes = 0;
+
+        std::uint64_t GetMessages() const;
+    };
+
+    struct Snapshot
+    {
+        std::vector<Module> modules;    //!< noisiest first
+        Module total;
+        Histogram write;                //!< time spent in sink writes, per call
+        Histogram wait;                 //!< time waiting for sink locks
+        std::uint64_t rotations = 0;
+        std::uint64_t dropped = 0;      //!< records discarded by queue overflow policies
+        std::int64_t queued = 0;        //!< records waiting in queues now, off by those queued while disabled
+
+        //! One line summary with the noisiest modules
+        std::string Summary(std::size_t top = 5) const;
+    };
+
+    static void Enable(bool enabled);
+    static bool IsEnabled() { return detail::g_MetricsEnabled.load(std::memory_order_relaxed); }
+
+    //! Sum of all threads, exited ones included
+    static Snapshot Get();
+
+    //! Nanoseconds since a Clock::Now reading
+    static std::uint64_t GetElapsed(std::uint64_t start)
+    {
+        const auto now = Clock::Now();
+        return now > start ? now - start : 0;
+    }
+
+    //! Hooks for sinks, call only when enabled
+    static void OnRecord(const char* module, ILog::Level::Value level, std::size_t bytes);
+    static void OnWrite(std::uint64_t nanoseconds);
+    static void OnWait(std::uint64_t nanoseconds);
+    static void OnRotate();
+    static void OnDrop();
+    static void OnQueue(std::int64_t records);
+};
+
+//! Writes the metrics summary to a log every interval
+//!
+//! \class MetricsReport
+//!
+class MetricsReport
+{
+public:
+    MetricsReport(ILog& log, unsigned interval = 60000);
+    ~MetricsReport();
+
+    MetricsReport(const MetricsReport&) = delete;
+    MetricsReport& operator = (const MetricsReport&) = delete;
+
+private:
+    void Run();
+
+private:
+    ILog& m_Log;
+    const unsigned m_Interval;  //!< milliseconds
+    boost::mutex m_Mutex;
+    boost::condition_variable m_Stop;
+    bool m_Stopped;
+    boost::thread m_Thread;
+};
+
+} // namespace logging
@@ -0,0 +1,164 @@
+#pragma once
+
+#include "log/logger.h"
+#include "log/call_site.h"
+#include "log/clock.h"
+#include "log/formatter.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+//! Logging macro with a rate limiter, the limiter state lives in static storage of the statement,
+//! so a suppressed record costs one atomic operation and no formatting or I/O.
+//! When a record passes after suppressed ones, a "suppressed N messages" record is written first.
+#define LSITE_LIMITED(logger, level, limiter, args, ...)                                                        \
+    ((LOG_IS_COMPILED(level) && logger && logger->IsEnabled(CURRENT_MODULE_ID, level)) ?                        \
+        [&](const char* function) {                                                                             \
+            static logging::CallSite site(LOG_CALL_SITE_ARGS(level, __VA_ARGS__));                              \
+            static limiter state args;                                                                          \
+            std::uint64_t suppressed = 0;                                                                       \
+            if (!state.Pass(suppressed))                                                                        \
+                return;                                                                                         \
+            site.Hit(function);                                                                                 \
+            if (suppressed)                                                                                     \
+                logging::detail::WriteSuppressed(*logger, site, suppressed);                                    \
+            LOG_SITE_MACRO(logger, site, __VA_ARGS__);                                                          \
+        }(__FUNCTION__) : void())
+
+//! Every n-th record, starting with the first one
+#define LOG_EVERY_N(level, n, ...) \
+    LSITE_LIMITED(logging::CurrentLog::Get(), level, logging::EveryN, (n), __VA_ARGS__)
+//! First n records only
+#define LOG_FIRST_N(level, n, ...) \
+    LSITE_LIMITED(logging::CurrentLog::Get(), level, logging::FirstN, (n), __VA_ARGS__)
+//! At most one record per period in milliseconds
+#define LOG_EVERY_MS(level, ms, ...) \
+    LSITE_LIMITED(logging::CurrentLog::Get(), level, logging::EveryMs, (ms), __VA_ARGS__)
+//! Token bucket, rate records per second on average with bursts up to burst records
+#define LOG_RATE_LIMITED(level, rate, burst, ...) \
+    LSITE_LIMITED(logging::CurrentLog::Get(), level, logging::RateLimited, (rate, burst), __VA_ARGS__)
+
+namespace logging
+{
+
+//! Passes every n-th record, the skipped ones are implied by n and not reported
+class EveryN
+{
+public:
+    constexpr explicit EveryN(std::uint64_t n)
+        : m_N(n ? n : 1)
+        , m_Count(0)
+    {
+    }
+
+    bool Pass(std::uint64_t& /*suppressed*/)
+    {
+        return !(m_Count.fetch_add(1, std::memory_order_relaxed) % m_N);
+    }
+
+private:
+    const std::uint64_t m_N;
+    std::atomic<std::uint64_t> m_Count;
+};
+
+//! Passes the first n records
+class FirstN
+{
+public:
+    constexpr explicit FirstN(std::uint64_t n)
+        : m_N(n)
+        , m_Count(0)
+    {
+    }
+
+    bool Pass(std::uint64_t& /*suppressed*/)
+    {
+        // stop touching the shared counter once the limit is reached
+        return m_Count.load(std::memory_order_relaxed) < m_N && m_Count.fetch_add(1, std::memory_order_relaxed) < m_N;
+    }
+
+private:
+    const std::uint64_t m_N;
+    std::atomic<std::uint64_t> m_Count;
+};
+
+//! Passes at most one record per period
+class EveryMs
+{
+public:
+    constexpr explicit EveryMs(std::uint64_t ms)
+        : m_Period(ms * 1000000)
+        , m_Next(0)
+        , m_Suppressed(0)
+    {
+    }
+
+    bool Pass(std::uint64_t& suppressed)
+    {
+        const auto now = Clock::Now();
+        auto next = m_Next.load(std::memory_order_relaxed);
+        if (now < next || !m_Next.compare_exchange_strong(next, now + m_Period, std::memory_order_relaxed))
+        {
+            m_Suppressed.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        suppressed = m_Suppressed.exchange(0, std::memory_order_relaxed);
+        return true;
+    }
+
+private:
+    const std::uint64_t m_Period;
+    std::atomic<std::uint64_t> m_Next;
+    std::atomic<std::uint64_t> m_Suppressed;
+};
+
+//! Token bucket as a generic cell rate algorithm: a single atomic holds the time the bucket
+//! becomes empty again, a record passes while that time is at most burst intervals ahead of now
+class RateLimited
+{
+public:
+    constexpr RateLimited(double rate, std::uint64_t burst)
+        : m_Interval(rate > 0 ? static_cast<std::uint64_t>(1e9 / rate) : ~std::uint64_t() / 2)
+        , m_Tolerance(rate > 0 && burst ? m_Interval * (burst - 1) : 0)
+        , m_Empty(0)
+        , m_Suppressed(0)
+    {
+    }
+
+    bool Pass(std::uint64_t& suppressed)
+    {
+        const auto now = Clock::Now();
+        auto empty = m_Empty.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            const auto start = empty > now ? empty : now;
+            if (start - now > m_Tolerance)
+            {
+                m_Suppressed.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            if (m_Empty.compare_exchange_weak(empty, start + m_Interval, std::memory_order_relaxed))
+                break;
+        }
+        suppressed = m_Suppressed.exchange(0, std::memory_order_relaxed);
+        return true;
+    }
+
+private:
+    const std::uint64_t m_Interval;
+    const std::uint64_t m_Tolerance;
+    std::atomic<std::uint64_t> m_Empty;
+    std::atomic<std::uint64_t> m_Suppressed;
+};
+
+namespace detail
+{
+    //! Summary of the records a limiter dropped since the last one it passed
+    inline void WriteSuppressed(ILog& log, const CallSite& site, std::uint64_t suppressed)
+    {
+        log.Write(site, "suppressed " + std::to_string(suppressed) + " messages");
+    }
+} // namespace detail
+
+} // namespace logging
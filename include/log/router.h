@@ -0,0 +1,99 @@
+#pragma once
+
+#include "log.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace logging
+{
+
+//! Text layout of a record, rendered on the first request and shared by the sinks of a Router
+//!
+//! \class RenderedLine
+//!
+class RenderedLine
+{
+public:
+    RenderedLine(const ILog::Record& record, std::string& buffer)
+        : m_Record(record)
+        , m_Line(buffer)
+        , m_Rendered()
+    {
+    }
+
+    RenderedLine(const RenderedLine&) = delete;
+    RenderedLine& operator = (const RenderedLine&) = delete;
+
+    const std::string& Get();
+
+private:
+    const ILog::Record& m_Record;
+    std::string& m_Line;
+    bool m_Rendered;
+};
+
+//! Composite logger, routes records to several sinks by module and level
+//!
+//! A record is captured once: time, thread and context are taken and deferred arguments are
+//! expanded a single time, the text layout is rendered on the first sink that asks for it.
+//! IsEnabled is the union of the routes matching the module, each capped by its sink. The union is
+//! kept per module and level, computed on first use and again after any sink of this library or the
+//! router changes levels, so per-module sink levels and levels reloaded by the sinks themselves are seen
+//! and a check is a load. At most 64 sinks; routes must be added before the router is used for logging.
+//!
+//! \class Router
+//!
+class Router : public ILog
+{
+public:
+
+    //! Records passed to a sink
+    struct Route
+    {
+        ILog::Level::Value level;               //!< most verbose level passed to the sink
+        std::vector<std::string> modules;       //!< modules passed to the sink, empty for all of them
+    };
+
+    Router();
+    ~Router();
+
+    //! Route all modules at all levels the sink accepts, throws std::length_error past 64 sinks
+    void Add(std::unique_ptr<ILog> sink);
+    void Add(std::unique_ptr<ILog> sink, const Route& route);
+
+    virtual bool IsEnabled(const char* module, Level::Value level) const override;
+    virtual boost::filesystem::path GetLogFolder(const char* module) const override;
+    virtual void Write(const char* module, ILog::Level::Value level, const std::string& text, const char* file, unsigned line, const char* function) override;
+    virtual void Write(const char* module, ILog::Level::Value level, const char* text, std::size_t size, const char* file, unsigned line, const char* function) override;
+    virtual void Write(const char* module, ILog::Level::Value level, const Arguments& arguments, const char* file, unsigned line, const char* function) override;
+    virtual void Write(const CallSite& site, const std::string& text) override;
+    virtual void Write(const CallSite& site, const char* text, std::size_t size) override;
+    virtual void Write(const CallSite& site, const Arguments& arguments) override;
+    virtual void Write(const Record& record) override;
+    virtual void SetLevel(Level::Value level) override;
+    virtual void SetLevels(const boost::property_tree::ptree& settings) override;
+    virtual void Flush() override;
+
+private:
+    struct Target
+    {
+        std::unique_ptr<ILog> sink;
+        Route route;
+    };
+
+    class Levels;
+
+    //! Bit per target passing the module at the level
+    std::uint64_t GetTargets(const char* module, Level::Value level) const;
+    void Dispatch(const Record& record);
+
+private:
+    std::vector<Target> m_Targets;
+    int m_Threshold;                            //!< most verbose level of any route
+    const std::unique_ptr<Levels> m_Levels;
+};
+
+} // namespace logging
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "log.h"
+#include "log/std_log.h"
+
+#include <memory>
+#include <vector>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+namespace logging
+{
+
+//! Per-thread sharded file sink
+//!
+//! Every writing thread appends to its own shard file, file.shardN, so writers share no lock and no stream.
+//! A shard returns to the sink when its thread exits and is taken by the next new thread, so the number of
+//! files follows the number of threads writing at once. Shards rotate by size as Std does, into
+//! file.shardN.1 to file.shardN.N; rotated shards are not compressed.
+//! Shards use the same text layout as Std; log_merge (see Merge) restores a single stream ordered by time.
+//! Levels may be set per module, as for Std.
+//!
+//! \class Sharded
+//!
+class Sharded : public ILog
+{
+public:
+    Sharded(ILog::Level::Value level, const char* file, const FlushPolicy& policy = FlushPolicy(), const RotationPolicy& rotation = RotationPolicy());
+    ~Sharded();
+
+    using ILog::Write;
+
+    virtual bool IsEnabled(const char* module, Level::Value level) const override;
+    virtual boost::filesystem::path GetLogFolder(const char* module) const override;
+    virtual void Write(const char* module, ILog::Level::Value level, const std::string& text, const char* file, unsigned line, const char* function) override;
+    virtual void Write(const char* module, ILog::Level::Value level, const char* text, std::size_t size, const char* file, unsigned line, const char* function) override;
+    virtual void Write(const Record& record) override;
+    virtual void Write(const Record& record, RenderedLine& line) override;
+    virtual void SetLevel(Level::Value level) override;
+    virtual void SetLevels(const boost::property_tree::ptree& settings) override;
+    virtual void Flush() override;
+
+    //! Shard files opened so far
+    std::vector<std::string> GetShards() const;
+
+private:
+    class Shard;
+    struct Pool;
+
+    Shard& GetShard();
+    void Print(const char* module, ILog::Level::Value level, boost::string_ref text, const char* function, std::uint64_t time, const boost::thread::id& thread, boost::string_ref context);
+    void RunFlusher();
+
+private:
+    const FlushPolicy m_Policy;
+    const RotationPolicy m_Rotation;
+    const std::string m_FileName;
+    const unsigned m_Instance;
+    const std::unique_ptr<detail::PublishedLevels> m_Levels;
+
+    const std::shared_ptr<Pool> m_Pool;     //!< shared with the threads holding shards, they return them on exit
+
+    boost::mutex m_Mutex;
+    boost::condition_variable m_Stop;
+    bool m_Stopped;
+    boost::thread m_Flusher;
+};
+
+} // namespace logging
@@ -0,0 +1,736 @@
+#pragma once
+
+#include "conversion/cast.hpp"
+
+#include <atomic>
+#include <cstdio>
+#include <cstddef>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include <boost/utility/string_ref.hpp>
+#include <boost/preprocessor/control/iif.hpp>
+#include <boost/preprocessor/comparison/greater.hpp>
+#include <boost/preprocessor/variadic/size.hpp>
+
+// Helpers
+#define CTXT_FORMAT_TYPE(format)                                                                                \
+    []() { struct Format { static constexpr const char* Get() { return format; } }; return Format(); }()
+#define CTXT_FOR_ZERO_ARGS(format) logging::StaticFormat(CTXT_FORMAT_TYPE(format))
+#define CTXT_FOR_NONZERO_ARGS(format, ...) logging::StaticFormat(CTXT_FORMAT_TYPE(format), __VA_ARGS__)
+
+//! Text formatting with the format string parsed at compile time, format must be a string literal
+#define CTXT(...) BOOST_PP_IIF(                                                                                 \
+    BOOST_PP_GREATER(BOOST_PP_VARIADIC_SIZE(__VA_ARGS__), 1),                                                   \
+        CTXT_FOR_NONZERO_ARGS, CTXT_FOR_ZERO_ARGS)(__VA_ARGS__)
+
+namespace logging
+{
+namespace detail
+{
+
+//! Parsed format segment, either literal text or an argument directive
+struct FormatSegment
+{
+    enum Kind
+    {
+        Literal     = 0,
+        Argument    = 1,
+    };
+
+    enum Error
+    {
+        None            = 0,
+        Trailing        = 1,    //!< format ends with a single '%'
+        Unsupported     = 2,    //!< unknown directive
+        ZeroPosition    = 3,    //!< positional arguments start from %1%
+        Mixed           = 4,    //!< positional and sequential directives in one format
+    };
+
+    int kind = Literal;
+    int error = None;
+    std::size_t begin = 0;
+    std::size_t length = 0;
+    std::size_t next = 0;
+    std::size_t argument = 0;
+    bool positional = false;
+    bool left = false;
+    bool zero = false;
+    bool plus = false;
+    bool space = false;
+    bool alternate = false;
+    std::size_t width = 0;
+    int precision = -1;
+    char conversion = 's';
+};
+
+//! Format summary
+struct FormatSummary
+{
+    std::size_t segments = 0;
+    std::size_t arguments = 0;
+    std::size_t literals = 0;
+    int error = FormatSegment::None;
+};
+
+constexpr bool IsDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+constexpr bool IsConversion(char c)
+{
+    const char conversions[] = "sdiuxXofFeEgGcp";
+    for (const char* it = conversions; *it; ++it)
+        if (*it == c)
+            return true;
+    return false;
+}
+
+//! Parse segment starting at position, sequential is the index of the next sequential argument
+constexpr FormatSegment ParseSegment(const char* text, std::size_t position, std::size_t sequential)
+{
+    FormatSegment segment;
+    segment.begin = position;
+
+    if (text[position] != '%')
+    {
+        std::size_t end = position;
+        while (text[end] && text[end] != '%')
+            ++end;
+        segment.length = end - position;
+        segment.next = end;
+        return segment;
+    }
+
+    std::size_t it = position + 1;
+    if (text[it] == '%')
+    {
+        segment.begin = it;
+        segment.length = 1;
+        segment.next = it + 1;
+        return segment;
+    }
+    if (!text[it])
+    {
+        segment.error = FormatSegment::Trailing;
+        return segment;
+    }
+
+    segment.kind = FormatSegment::Argument;
+    segment.argument = sequential;
+
+    // %N% or %N$spec
+    std::size_t number = 0;
+    std::size_t digits = it;
+    while (IsDigit(text[digits]))
+        number = number * 10 + static_cast<std::size_t>(text[digits++] - '0');
+
+    if (digits != it && (text[digits] == '%' || text[digits] == '$'))
+    {
+        if (!number)
+        {
+            segment.error = FormatSegment::ZeroPosition;
+            return segment;
+        }
+
+        segment.positional = true;
+        segment.argument = number - 1;
+        if (text[digits] == '%')
+        {
+            segment.next = digits + 1;
+            return segment;
+        }
+        it = digits + 1;
+    }
+
+    // printf style [flags][width][.precision]conversion
+    for (;; ++it)
+    {
+        if (text[it] == '-')
+            segment.left = true;
+        else if (text[it] == '0')
+            segment.zero = true;
+        else if (text[it] == '+')
+            segment.plus = true;
+        else if (text[it] == ' ')
+            segment.space = true;
+        else if (text[it] == '#')
+            segment.alternate = true;
+        else
+            break;
+    }
+    while (IsDigit(text[it]))
+        segment.width = segment.width * 10 + static_cast<std::size_t>(text[it++] - '0');
+    if (text[it] == '.')
+    {
+        segment.precision = 0;
+        while (IsDigit(text[++it]))
+            segment.precision = segment.precision * 10 + (text[it] - '0');
+    }
+
+    if (!IsConversion(text[it]))
+    {
+        segment.error = FormatSegment::Unsupported;
+        return segment;
+    }
+
+    segment.conversion = text[it];
+    segment.next = it + 1;
+    return segment;
+}
+
+constexpr FormatSummary Summarize(const char* text)
+{
+    FormatSummary summary;
+    bool positional = false;
+    bool sequential = false;
+    std::size_t position = 0;
+    while (text[position])
+    {
+        const FormatSegment segment = ParseSegment(text, position, positional ? 0 : summary.arguments);
+        if (segment.error)
+        {
+            summary.error = segment.error;
+            return summary;
+        }
+
+        ++summary.segments;
+        if (segment.kind == FormatSegment::Literal)
+        {
+            summary.literals += segment.length;
+        }
+        else if (segment.positional)
+        {
+            positional = true;
+            if (segment.argument + 1 > summary.arguments)
+                summary.arguments = segment.argument + 1;
+        }
+        else
+        {
+            sequential = true;
+            ++summary.arguments;
+        }
+
+        if (positional && sequential)
+        {
+            summary.error = FormatSegment::Mixed;
+            return summary;
+        }
+        position = segment.next;
+    }
+    return summary;
+}
+
+constexpr FormatSegment GetSegment(const char* text, std::size_t index)
+{
+    std::size_t position = 0;
+    std::size_t sequential = 0;
+    for (;;)
+    {
+        const FormatSegment segment = ParseSegment(text, position, sequential);
+        if (!index--)
+            return segment;
+        if (segment.kind == FormatSegment::Argument && !segment.positional)
+            ++sequential;
+        position = segment.next;
+    }
+}
+
+//! Argument categories, define which conversions are accepted
+struct ValueKind
+{
+    enum Value
+    {
+        Bool,
+        Char,
+        Integer,
+        Float,
+        String,
+        WideString,
+        Pair,
+        Range,
+        Pointer,
+        Other,
+    };
+};
+
+template <typename T, typename = void>
+struct IsRange : std::false_type
+{
+};
+
+template <typename T>
+struct IsRange<T, decltype(std::begin(std::declval<const T&>()), std::end(std::declval<const T&>()), void())> : std::true_type
+{
+};
+
+template <typename T>
+struct IsPair : std::false_type
+{
+};
+
+template <typename A, typename B>
+struct IsPair<std::pair<A, B>> : std::true_type
+{
+};
+
+template <typename T>
+struct IsString : std::integral_constant<bool,
+    std::is_same<T, std::string>::value ||
+    std::is_same<T, boost::string_ref>::value ||
+    std::is_same<T, const char*>::value ||
+    std::is_same<T, char*>::value>
+{
+};
+
+//! Argument type as seen by the formatter, arrays other than char ones are kept as ranges
+template <typename T>
+struct ArgumentType
+{
+    using type = typename std::decay<const T>::type;
+};
+
+template <typename T, std::size_t N>
+struct ArgumentType<T[N]>
+{
+    using type = typename std::conditional<std::is_same<typename std::remove_cv<T>::type, char>::value, const char*, T[N]>::type;
+};
+
+template <typename T>
+struct GetValueKind : std::integral_constant<int,
+    std::is_same<T, bool>::value ? ValueKind::Bool :
+    std::is_same<T, char>::value ? ValueKind::Char :
+    std::is_integral<T>::value ? ValueKind::Integer :
+    std::is_floating_point<T>::value ? ValueKind::Float :
+    IsString<T>::value ? ValueKind::String :
+    std::is_same<T, std::wstring>::value ? ValueKind::WideString :
+    IsPair<T>::value ? ValueKind::Pair :
+    IsRange<T>::value ? ValueKind::Range :
+    std::is_pointer<T>::value ? ValueKind::Pointer :
+    ValueKind::Other>
+{
+};
+
+constexpr bool IsAccepted(int kind, char conversion)
+{
+    switch (conversion)
+    {
+    case 's':
+        return true;
+    case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c':
+        return kind == ValueKind::Bool || kind == ValueKind::Char || kind == ValueKind::Integer;
+    case 'f': case 'F': case 'e': case 'E': case 'g': case 'G':
+        return kind == ValueKind::Float;
+    case 'p':
+        return kind == ValueKind::Pointer;
+    default:
+        return false;
+    }
+}
+
+template <typename Out>
+void AppendPadded(Out& out, const char* data, std::size_t size, const FormatSegment& spec, bool numeric)
+{
+    if (spec.width <= size)
+    {
+        out.append(data, size);
+        return;
+    }
+
+    const auto fill = spec.width - size;
+    if (spec.left)
+    {
+        out.append(data, size);
+        out.append(fill, ' ');
+    }
+    else if (numeric && spec.zero)
+    {
+        // zeros go after the sign and the radix prefix
+        std::size_t prefix = 0;
+        if (size && (data[0] == '-' || data[0] == '+' || data[0] == ' '))
+            ++prefix;
+        if (size > prefix + 1 && data[prefix] == '0' && (data[prefix + 1] == 'x' || data[prefix + 1] == 'X'))
+            prefix += 2;
+        out.append(data, prefix);
+        out.append(fill, '0');
+        out.append(data + prefix, size - prefix);
+    }
+    else
+    {
+        out.append(fill, ' ');
+        out.append(data, size);
+    }
+}
+
+template <typename Out, typename T>
+void AppendInteger(Out& out, T value, const FormatSegment& spec)
+{
+    using Unsigned = typename std::make_unsigned<T>::type;
+
+    char buffer[32];
+    char* const end = buffer + sizeof(buffer);
+    char* it = end;
+
+    const bool decimal = spec.conversion != 'x' && spec.conversion != 'X' && spec.conversion != 'o';
+    const bool negative = decimal && value < T();
+    Unsigned magnitude = negative ? static_cast<Unsigned>(Unsigned() - static_cast<Unsigned>(value)) : static_cast<Unsigned>(value);
+
+    const unsigned base = decimal ? 10 : spec.conversion == 'o' ? 8 : 16;
+    const char* const digits = spec.conversion == 'X' ? "0123456789ABCDEF" : "0123456789abcdef";
+    do
+    {
+        *--it = digits[magnitude % base];
+        magnitude /= base;
+    }
+    while (magnitude);
+
+    if (spec.alternate && base == 16)
+    {
+        *--it = spec.conversion;
+        *--it = '0';
+    }
+    else if (spec.alternate && base == 8 && *it != '0')
+    {
+        *--it = '0';
+    }
+
+    if (negative)
+        *--it = '-';
+    else if (decimal && spec.plus)
+        *--it = '+';
+    else if (decimal && spec.space)
+        *--it = ' ';
+
+    AppendPadded(out, it, static_cast<std::size_t>(end - it), spec, true);
+}
+
+template <typename Out>
+void AppendFloat(Out& out, double value, const FormatSegment& spec)
+{
+    char format[16] = "%";
+    char* it = format + 1;
+    if (spec.left)
+        *it++ = '-';
+    if (spec.zero)
+        *it++ = '0';
+    if (spec.plus)
+        *it++ = '+';
+    if (spec.space)
+        *it++ = ' ';
+    if (spec.alternate)
+        *it++ = '#';
+    *it++ = '*';
+    *it++ = '.';
+    *it++ = '*';
+    *it++ = spec.conversion == 's' ? 'g' : spec.conversion;
+    *it = 0;
+
+    char buffer[128];
+    const int precision = spec.precision < 0 ? 6 : spec.precision;
+    const int size = std::snprintf(buffer, sizeof(buffer), format, static_cast<int>(spec.width), precision, value);
+    if (size >= 0 && static_cast<std::size_t>(size) < sizeof(buffer))
+    {
+        out.append(buffer, static_cast<std::size_t>(size));
+    }
+    else if (size >= 0)
+    {
+        std::string large(static_cast<std::size_t>(size) + 1, 0);
+        std::snprintf(&large[0], large.size(), format, static_cast<int>(spec.width), precision, value);
+        out.append(large.data(), static_cast<std::size_t>(size));
+    }
+}
+
+template <typename Out>
+void AppendString(Out& out, const char* data, std::size_t size, const FormatSegment& spec)
+{
+    if (spec.precision >= 0 && static_cast<std::size_t>(spec.precision) < size)
+        size = static_cast<std::size_t>(spec.precision);
+    AppendPadded(out, data, size, spec, false);
+}
+
+template <typename Out, typename T>
+void AppendValue(Out& out, const T& value, const FormatSegment& spec);
+
+template <typename Out, typename T>
+void AppendKind(Out& out, bool value, const FormatSegment& spec, std::integral_constant<int, ValueKind::Bool>)
+{
+    AppendInteger(out, static_cast<int>(value), spec);
+}
+
+template <typename Out, typename T>
+void AppendKind(Out& out, char value, const FormatSegment& spec, std::integral_constant<int, ValueKind::Char>)
+{
+    if (spec.conversion == 's' || spec.conversion == 'c')
+        AppendPadded(out, &value, 1, spec, false);
+    else
+        AppendInteger(out, static_cast<int>(value), spec);
+}
+
+template <typename Out, typename T>
+void AppendKind(Out& out, const T& value, const FormatSegment& spec, std::integral_constant<int, ValueKind::Integer>)
+{
+    // streams print signed and unsigned char as characters
+    if (sizeof(T) == 1 && (spec.conversion == 's' || spec.conversion == 'c'))
+    {
+        const char c = static_cast<char>(value);
+        AppendPadded(out, &c, 1, spec, false);
+        return;
+    }
+    AppendInteger(out, value, spec);
+}
+
+template <typename Out, typename T>
+void AppendKind(Out& out, const T& value, const FormatSegment& spec, std::integral_constant<int, ValueKind::Float>)
+{
+    AppendFloat(out, static_cast<double>(value), spec);
+}
+
+template <typename Out>
+void AppendText(Out& out, const std::string& value, const FormatSegment& spec)
+{
+    AppendString(out, value.data(), value.size(), spec);
+}
+
+template <typename Out>
+void AppendText(Out& out, boost::string_ref value, const FormatSegment& spec)
+{
+    AppendString(out, value.data(), value.size(), spec);
+}
+
+template <typename Out>
+void AppendText(Out& out, const char* value, const FormatSegment& spec)
+{
+    if (value)
+        AppendString(out, value, std::char_traits<char>::length(value), spec);
+    else
+        AppendString(out, "(null)", 6, spec);
+}
+
+template <typename Out, typename T>
+void AppendKind(Out& out, const T& value, const FormatSegment& spec, std::integral_constant<int, ValueKind::String>)
+{
+    AppendText(out, value, spec);
+}
+
+template <typename Out, typename T>
+void AppendKind(Out& out, const std::wstring& value, const FormatSegment& spec, std::integral_constant<int, ValueKind::WideString>)
+{
+    AppendText(out, conv::cast<std::string>(value), spec);
+}
+
+template <typename Out, typename T>
+void AppendKind(Out& out, const T& value, const FormatSegment& /*spec*/, std::integral_constant<int, ValueKind::Pair>)
+{
+    const FormatSegment element;
+    AppendValue(out, value.first, element);
+    out.append(1, ':');
+    AppendValue(out, value.second, element);
+}
+
+struct RangeLimits
+{
+    std::atomic<std::size_t> elements{ 64 };
+    std::atomic<std::size_t> bytes{ 4096 };
+};
+
+inline RangeLimits& GetRangeLimits()
+{
+    static RangeLimits limits;
+    return limits;
+}
+
+template <typename Out, typename T>
+void AppendRange(Out& out, const T& value, std::size_t limit);
+
+//! Inner ranges are bracketed and share the byte budget of the outer one, they stop at it by themselves
+template <typename Out, typename T>
+bool AppendElement(Out& out, const T& value, std::size_t limit, std::true_type /*range*/)
+{
+    out.append(1, '[');
+    AppendRange(out, value, limit);
+    out.append(1, ']');
+    return false;
+}
+
+//! Other elements are cut at the limit, true if it was
+template <typename Out, typename T>
+bool AppendElement(Out& out, const T& value, std::size_t limit, std::false_type /*range*/)
+{
+    const auto start = out.size();
+    const FormatSegment element;
+    AppendValue(out, value, element);
+    if (out.size() <= limit || start >= limit)
+        return false;
+    out.resize(limit);
+    return true;
+}
+
+//! Elements are appended until the element limit or the output size limit is reached, the rest is only
+//! counted; an element crossing the size limit is cut there
+template <typename Out, typename T>
+void AppendRange(Out& out, const T& value, std::size_t limit)
+{
+    const auto elements = GetRangeLimits().elements.load(std::memory_order_relaxed);
+
+    std::size_t written = 0;
+    bool cut = false;
+    auto it = std::begin(value);
+    const auto end = std::end(value);
+    while (it != end && written < elements && out.size() < limit)
+    {
+        const auto before = out.size();
+        if (written)
+            out.append(1, ',');
+
+        // nothing of the element fits, it is counted with the rest
+        if (out.size() >= limit)
+        {
+            out.resize(before);
+            break;
+        }
+
+        using Element = typename ArgumentType<typename std::decay<decltype(*it)>::type>::type;
+        cut = AppendElement(out, *it, limit, std::integral_constant<bool, GetValueKind<Element>::value == ValueKind::Range>());
+        ++it;
+        ++written;
+        if (cut)
+            break;
+    }
+
+    if (it == end && !cut)
+        return;
+
+    if (written && !cut)
+        out.append(1, ',');
+    out.append("...", 3);
+    if (it == end)
+        return;
+
+    const FormatSegment element;
+    out.append(" (", 2);
+    AppendInteger(out, static_cast<std::size_t>(std::distance(it, end)), element);
+    out.append(" more)", 6);
+}
+
+template <typename Out, typename T>
+void AppendRange(Out& out, const T& value)
+{
+    AppendRange(out, value, out.size() + GetRangeLimits().bytes.load(std::memory_order_relaxed));
+}
+
+template <typename Out, typename T>
+void AppendKind(Out& out, const T& value, const FormatSegment& spec, std::integral_constant<int, ValueKind::Range>)
+{
+    if (!spec.width)
+    {
+        AppendRange(out, value);
+        return;
+    }
+
+    std::string text;
+    AppendRange(text, value);
+    AppendPadded(out, text.data(), text.size(), spec, false);
+}
+
+template <typename Out, typename T>
+void AppendStreamed(Out& out, const T& value, const FormatSegment& spec)
+{
+    std::ostringstream stream;
+    stream << value;
+    const auto text = stream.str();
+    AppendPadded(out, text.data(), text.size(), spec, false);
+}
+
+template <typename Out, typename T>
+void AppendKind(Out& out, const T& value, const FormatSegment& spec, std::integral_constant<int, ValueKind::Pointer>)
+{
+    AppendStreamed(out, static_cast<const void*>(value), spec);
+}
+
+template <typename Out, typename T>
+void AppendKind(Out& out, const T& value, const FormatSegment& spec, std::integral_constant<int, ValueKind::Other>)
+{
+    AppendStreamed(out, value, spec);
+}
+
+template <typename Out, typename T>
+void AppendValue(Out& out, const T& value, const FormatSegment& spec)
+{
+    using Value = typename ArgumentType<T>::type;
+    AppendKind<Out, Value>(out, static_cast<const Value&>(value), spec, GetValueKind<Value>());
+}
+
+template <typename Format, typename Out, typename Tuple, std::size_t Index>
+void AppendSegment(Out& out, const Tuple& /*args*/, std::integral_constant<int, FormatSegment::Literal>, std::integral_constant<std::size_t, Index>)
+{
+    constexpr FormatSegment segment = GetSegment(Format::Get(), Index);
+    out.append(Format::Get() + segment.begin, segment.length);
+}
+
+template <typename Format, typename Out, typename Tuple, std::size_t Index>
+void AppendSegment(Out& out, const Tuple& args, std::integral_constant<int, FormatSegment::Argument>, std::integral_constant<std::size_t, Index>)
+{
+    constexpr FormatSegment segment = GetSegment(Format::Get(), Index);
+    using Value = typename ArgumentType<typename std::remove_reference<typename std::tuple_element<segment.argument, Tuple>::type>::type>::type;
+    static_assert(IsAccepted(GetValueKind<Value>::value, segment.conversion), "format conversion does not match the argument type");
+
+    AppendValue(out, std::get<segment.argument>(args), segment);
+}
+
+template <typename Format, typename Out, typename Tuple, std::size_t Index>
+void AppendSegment(Out& out, const Tuple& args, std::integral_constant<std::size_t, Index> index)
+{
+    constexpr FormatSegment segment = GetSegment(Format::Get(), Index);
+    AppendSegment<Format>(out, args, std::integral_constant<int, segment.kind>(), index);
+}
+
+template <typename Format, typename Out, typename Tuple, std::size_t ... Indexes>
+void AppendSegments(Out& out, const Tuple& args, std::index_sequence<Indexes...>)
+{
+    const int expand[] = { 0, (AppendSegment<Format>(out, args, std::integral_constant<std::size_t, Indexes>()), 0)... };
+    (void)expand;
+}
+
+} // namespace detail
+
+//! Cap container arguments at the given number of elements and bytes, the rest is shown as "... (N more)"
+inline void SetRangeLimits(std::size_t elements, std::size_t bytes)
+{
+    auto& limits = detail::GetRangeLimits();
+    limits.elements.store(elements, std::memory_order_relaxed);
+    limits.bytes.store(bytes, std::memory_order_relaxed);
+}
+
+//! Append formatted text to the output, the format is a type produced by CTXT_FORMAT_TYPE
+template <typename Out, typename Format, typename ... Args>
+void StaticFormatTo(Out& out, Format /*format*/, const Args&... args)
+{
+    constexpr detail::FormatSummary summary = detail::Summarize(Format::Get());
+    static_assert(summary.error != detail::FormatSegment::Trailing, "format ends with a single '%'");
+    static_assert(summary.error != detail::FormatSegment::Unsupported, "unsupported format directive");
+    static_assert(summary.error != detail::FormatSegment::ZeroPosition, "positional arguments start from %1%");
+    static_assert(summary.error != detail::FormatSegment::Mixed, "positional and sequential directives can't be mixed");
+    static_assert(summary.error || summary.arguments == sizeof...(Args), "number of arguments does not match the format");
+
+    constexpr bool valid = !summary.error && summary.arguments == sizeof...(Args);
+    detail::AppendSegments<Format>(out, std::forward_as_tuple(args...), std::make_index_sequence<valid ? summary.segments : 0>());
+}
+
+//! Format text, the format is a type produced by CTXT_FORMAT_TYPE
+template <typename Format, typename ... Args>
+std::string StaticFormat(Format format, const Args&... args)
+{
+    constexpr detail::FormatSummary summary = detail::Summarize(Format::Get());
+
+    std::string result;
+    result.reserve(summary.literals + sizeof...(Args) * 8);
+    StaticFormatTo(result, format, args...);
+    return result;
+}
+
+} // namespace logging
@@ -2,28 +2,139 @@
 
 #include "log.h"
 
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <ostream>
+
 #include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
 
 namespace logging
 {
 
+namespace detail
+{
+    class OutputBuffer;
+    class GzipBuffer;
+    class UringBuffer;
+    class PublishedLevels;
+    class ConfigWatcher;
+} // namespace detail
+
+//! Output buffering, the buffer is written out when full, every interval and after records at or above the level
+struct FlushPolicy
+{
+    //! File writers
+    struct Writer
+    {
+        enum Value
+        {
+            Stream  = 0,    //!< std::ofstream, the writing thread waits for write(2)
+            Uring   = 1,    //!< writes queued through io_uring from reused buffers, pwrite without it; Linux only
+            Direct  = 2,    //!< Uring with O_DIRECT, whole blocks bypassing the page cache
+        };
+    };
+
+    std::size_t size = 64 * 1024;
+    unsigned interval = 1000;   //!< milliseconds, 0 disables the timer
+    ILog::Level::Value level = ILog::Level::Error;
+    Writer::Value writer = Writer::Stream;
+};
+
+//! File rotation, backups are file.1 (newest) to file.N
+struct RotationPolicy
+{
+    //! Compression modes
+    struct Compression
+    {
+        enum Value
+        {
+            None    = 0,
+            Backups = 1,    //!< rotated files are compressed on a background thread into file.N.gz
+            Stream  = 2,    //!< written as gzip to file.gz, a member per buffer flush, backups are file.N.gz
+        };
+    };
+
+    std::uint64_t size = 100000000;     //!< bytes of text per file, counted before compression
+    std::size_t generations = 1;        //!< number of backups kept
+    std::uint64_t limit = 0;            //!< total bytes of backups, 0 is unlimited
+    Compression::Value compression = Compression::None;
+};
+
+//! Record layouts
+struct Layout
+{
+    enum Value
+    {
+        Text    = 0,    //!< [LEVEL][time][module] [thread] {context} text/* function */
+        Json    = 1,    //!< a JSON object per line, fields of structured records become members
+    };
+};
+
+//! Sink writing to a file or the standard output
+//!
+//! Levels may be set per module, see SetLevels. They live in an immutable table replaced as a whole and
+//! read through a hazard pointer, so IsEnabled never locks; a replaced table is freed once no thread reads it.
+//!
 class Std : public ILog
 {
 public:
-    Std(ILog::Level::Value level = ILog::Level::Info, const char* file = nullptr);
+    Std(ILog::Level::Value level = ILog::Level::Info, const char* file = nullptr, const FlushPolicy& policy = FlushPolicy(), const RotationPolicy& rotation = RotationPolicy(), Layout::Value layout = Layout::Text);
+    ~Std();
+
+    using ILog::Write;
 
     virtual bool IsEnabled(const char* module, Level::Value level) const override;
     virtual boost::filesystem::path GetLogFolder(const char* module) const override;
     virtual void Write(const char* module, ILog::Level::Value level, const std::string& text, const char* file, unsigned line, const char* function) override;
+    virtual void Write(const char* module, ILog::Level::Value level, const char* text, std::size_t size, const char* file, unsigned line, const char* function) override;
+    virtual void Write(const char* module, ILog::Level::Value level, const Arguments& arguments, const char* file, unsigned line, const char* function) override;
+    virtual void Write(const Record& record) override;
+    virtual void Write(const Record& record, RenderedLine& line) override;
+    virtual void WriteBatch(const Record* records, std::size_t count) override;
     virtual void SetLevel(Level::Value level) override;
     virtual void SetLevels(const boost::property_tree::ptree& settings) override;
+    virtual void Flush() override;
+
+    //! Applies the levels of a settings file now and every time it changes, format by extension: .json, .xml, .ini or info
+    void Watch(const char* config);
+
+private:
+    void Reload(const std::string& config);
+    //! Line about the sink itself in the layout of the records, the caller holds the lock if there is one
+    void Notice(const std::string& text);
+    void Open(std::ios::openmode mode);
+    void Rotate();
+    void RunFlusher();
+    void RunCompressor();
+    void Compress(const std::string& file);
+    void Render(std::string& out, const char* module, ILog::Level::Value level, boost::string_ref text, const Arguments* arguments, const char* function, std::uint64_t time, const boost::thread::id& thread, boost::string_ref context) const;
+    void Print(const char* module, ILog::Level::Value level, boost::string_ref text, const Arguments* arguments, const char* function, std::uint64_t time, const boost::thread::id& thread, boost::string_ref context);
+    void Output(const std::string& line, ILog::Level::Value level);
 
 private:
-    const size_t m_FileMaxSize{ 100000000 };
+    const FlushPolicy m_Policy;
+    const RotationPolicy m_Rotation;
+    const Layout::Value m_Layout;
     const std::string m_FileName;
-    const std::string m_BackupFileName;
+    const std::string m_Path;       //!< file written, file.gz when the stream is compressed
+    const bool m_Rotate;            //!< regular files only, never rename devices like /dev/null
     boost::shared_ptr<std::ostream> m_Stream;
-    ILog::Level::Value m_Level;
+    std::unique_ptr<detail::UringBuffer> m_File;
+    std::unique_ptr<detail::GzipBuffer> m_Gzip;
+    std::unique_ptr<detail::OutputBuffer> m_Buffer;
+    std::ostream m_Output;
+    const std::unique_ptr<detail::PublishedLevels> m_Levels;
+    boost::mutex m_Mutex;
+    boost::condition_variable m_Stop;
+    bool m_Stopped;
+    std::deque<std::string> m_Pending;  //!< rotated files waiting for compression
+    boost::thread m_Flusher;
+    boost::thread m_Compressor;
+    std::unique_ptr<detail::ConfigWatcher> m_Watcher;
 };
 
 } // namespace logging
\ No newline at end of file
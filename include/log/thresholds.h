@@ -0,0 +1,79 @@
+#pragma once
+
+//! Compile-time logging thresholds
+//!
+//! LOG_COMPILED_LEVEL is the most verbose level compiled in (0 Error .. 4 Trace), statements above it
+//! expand to an unevaluated sizeof, so their arguments are still type checked but no code or strings are emitted.
+//! LOG_MODULE_LEVELS lowers the threshold for modules named by SET_LOGGING_MODULE, e.g.
+//! -DLOG_MODULE_LEVELS='{"net",2},{"db",1}'; statements of those modules get a constant false condition
+//! and are removed by the optimizer. A scope may lower it further with its own CURRENT_MODULE_LEVEL, which
+//! hides the global default of LOG_COMPILED_LEVEL. Error statements are always compiled.
+
+#include <cstddef>
+
+#define LOG_LEVEL_ERROR 0
+#define LOG_LEVEL_WARNING 1
+#define LOG_LEVEL_INFO 2
+#define LOG_LEVEL_DEBUG 3
+#define LOG_LEVEL_TRACE 4
+
+#ifndef LOG_COMPILED_LEVEL
+#define LOG_COMPILED_LEVEL LOG_LEVEL_TRACE
+#endif
+
+//! Type check the statement without evaluating it
+#define LOG_DISCARD(...)                                                                                        \
+    ((void)sizeof(logging::detail::Discard(__VA_ARGS__)))
+
+//! Statement of the current module is compiled in, constant for constant levels and a constexpr module
+#define LOG_IS_COMPILED(level)                                                                                  \
+    (static_cast<int>(level) <= CURRENT_MODULE_LEVEL &&                                                         \
+     static_cast<int>(level) <= logging::detail::GetModuleThreshold(CURRENT_MODULE_ID))
+
+namespace logging
+{
+namespace detail
+{
+
+template <typename ... T>
+constexpr int Discard(const T&... /*args*/)
+{
+    return 0;
+}
+
+struct ModuleThreshold
+{
+    const char* module;
+    int level;
+};
+
+constexpr ModuleThreshold g_ModuleThresholds[] = {
+#ifdef LOG_MODULE_LEVELS
+    LOG_MODULE_LEVELS,
+#endif
+    { nullptr, LOG_COMPILED_LEVEL }
+};
+
+constexpr bool IsSameModule(const char* left, const char* right)
+{
+    while (*left && *left == *right)
+        ++left, ++right;
+    return *left == *right;
+}
+
+//! Compile-time threshold of the module, never above LOG_COMPILED_LEVEL
+constexpr int GetModuleThreshold(const char* module)
+{
+    for (const auto& threshold : g_ModuleThresholds)
+    {
+        if (!threshold.module || IsSameModule(threshold.module, module))
+            return threshold.level < LOG_COMPILED_LEVEL ? threshold.level : LOG_COMPILED_LEVEL;
+    }
+    return LOG_COMPILED_LEVEL;
+}
+
+} // namespace detail
+} // namespace logging
+
+//! Threshold of scopes without their own, so a module id declared without SET_LOGGING_MODULE still works
+static constexpr int CURRENT_MODULE_LEVEL = LOG_COMPILED_LEVEL;
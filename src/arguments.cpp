@@ -0,0 +1,54 @@
+#include "log/arguments.h"
+
+#include <sstream>
+
+#include <boost/format.hpp>
+
+namespace logging
+{
+
+namespace
+{
+
+void Print(std::ostream& out, bool value)                 { out << (value ? "true" : "false"); }
+void Print(std::ostream& out, const void* value)          { out << value; }
+void Print(std::ostream& out, boost::string_ref value)    { out.write(value.data(), static_cast<std::streamsize>(value.size())); }
+
+template <typename T>
+void Print(std::ostream& out, const T& value)
+{
+    out << value;
+}
+
+} // anonymous namespace
+
+std::string Arguments::Format() const
+{
+    const char* text = GetFormat();
+    if (m_Structured)
+    {
+        std::ostringstream out;
+        out << text;
+        VisitFields([&out](boost::string_ref key, const auto& value) {
+            out << ' ';
+            Print(out, key);
+            out << '=';
+            Print(out, value);
+        });
+        return out.str();
+    }
+
+    try
+    {
+        boost::format format(text);
+        Visit([&format](const auto& value){ format % value; });
+        return format.remaining_args() ? text : format.str();
+    }
+    catch (const boost::io::format_error&)
+    {
+        // expanded far from the call site, fall back to the raw text instead of throwing
+        return text;
+    }
+}
+
+} // namespace logging
@@ -0,0 +1,279 @@
+#include "log/async_log.h"
+#include "log/call_site.h"
+#include "log/clock.h"
+#include "log/metrics.h"
+#include "modules.h"
+
+#include <algorithm>
+#include <new>
+
+#include <boost/align/aligned_alloc.hpp>
+
+namespace logging
+{
+
+namespace
+{
+
+//! Most records handed to the sink in one call
+const std::size_t g_BatchSize = 256;
+
+std::size_t RoundUpToPowerOfTwo(std::size_t value)
+{
+    std::size_t result = 2;
+    while (result < value)
+        result <<= 1;
+    return result;
+}
+
+} // anonymous namespace
+
+AsyncLog::AsyncLog(std::unique_ptr<ILog> log, std::size_t capacity, Overflow::Value overflow, ILog::Level::Value threshold)
+    : m_Log(std::move(log))
+    , m_Overflow(overflow)
+    , m_Threshold(threshold)
+    , m_Mask(RoundUpToPowerOfTwo(capacity) - 1)
+    , m_Cells(new Cell[m_Mask + 1])
+    , m_Head(0)
+    , m_Tail(0)
+    , m_Written(0)
+    , m_Dropped(0)
+    , m_Sleeping(false)
+    , m_Stopped(false)
+    , m_FlushWaiters(0)
+{
+    for (std::size_t i = 0; i <= m_Mask; ++i)
+        m_Cells[i].m_Sequence.store(i, std::memory_order_relaxed);
+    m_Batch.reserve(std::min(m_Mask + 1, g_BatchSize));
+
+    m_Thread = boost::thread(&AsyncLog::Run, this);
+}
+
+void* AsyncLog::operator new(std::size_t size)
+{
+    if (void* pointer = boost::alignment::aligned_alloc(alignof(AsyncLog), size))
+        return pointer;
+    throw std::bad_alloc();
+}
+
+void AsyncLog::operator delete(void* pointer)
+{
+    boost::alignment::aligned_free(pointer);
+}
+
+AsyncLog::~AsyncLog()
+{
+    m_Stopped = true;
+    Wake();
+    m_Thread.join();
+}
+
+bool AsyncLog::IsEnabled(const char* module, Level::Value level) const
+{
+    return m_Log->IsEnabled(module, level);
+}
+
+boost::filesystem::path AsyncLog::GetLogFolder(const char* module) const
+{
+    return m_Log->GetLogFolder(module);
+}
+
+void AsyncLog::Write(const char* module, ILog::Level::Value level, const std::string& text, const char* file, unsigned line, const char* function)
+{
+    Push(Record{ detail::InternModule(module), level, text, file, line, function, Clock::Now(), boost::this_thread::get_id(), Arguments(), nullptr, ScopedContext::GetSnapshot() });
+}
+
+void AsyncLog::Write(const char* module, ILog::Level::Value level, const char* text, std::size_t size, const char* file, unsigned line, const char* function)
+{
+    Push(Record{ detail::InternModule(module), level, std::string(text, size), file, line, function, Clock::Now(), boost::this_thread::get_id(), Arguments(), nullptr, ScopedContext::GetSnapshot() });
+}
+
+void AsyncLog::Write(const char* module, ILog::Level::Value level, const Arguments& arguments, const char* file, unsigned line, const char* function)
+{
+    Push(Record{ detail::InternModule(module), level, std::string(), file, line, function, Clock::Now(), boost::this_thread::get_id(), arguments, nullptr, ScopedContext::GetSnapshot() });
+}
+
+void AsyncLog::Write(const CallSite& site, const std::string& text)
+{
+    Push(Record{ site.GetModule(), site.GetLevel(), text, site.GetFile(), site.GetLine(), site.GetFunction(), Clock::Now(), boost::this_thread::get_id(), Arguments(), &site, ScopedContext::GetSnapshot() });
+}
+
+void AsyncLog::Write(const CallSite& site, const char* text, std::size_t size)
+{
+    Push(Record{ site.GetModule(), site.GetLevel(), std::string(text, size), site.GetFile(), site.GetLine(), site.GetFunction(), Clock::Now(), boost::this_thread::get_id(), Arguments(), &site, ScopedContext::GetSnapshot() });
+}
+
+void AsyncLog::Write(const CallSite& site, const Arguments& arguments)
+{
+    Push(Record{ site.GetModule(), site.GetLevel(), std::string(), site.GetFile(), site.GetLine(), site.GetFunction(), Clock::Now(), boost::this_thread::get_id(), arguments, &site, ScopedContext::GetSnapshot() });
+}
+
+void AsyncLog::Write(const Record& record)
+{
+    Record copy(record);
+    if (!record.site)
+        copy.module = detail::InternModule(record.module);
+    Push(std::move(copy));
+}
+
+void AsyncLog::SetLevel(Level::Value level)
+{
+    m_Log->SetLevel(level);
+}
+
+void AsyncLog::SetLevels(const boost::property_tree::ptree& settings)
+{
+    m_Log->SetLevels(settings);
+}
+
+void AsyncLog::Flush()
+{
+    const auto target = m_Head.load(std::memory_order_acquire);
+
+    ++m_FlushWaiters;
+    {
+        boost::unique_lock<boost::mutex> lock(m_Mutex);
+        m_Wakeup.notify_one();
+        while (m_Written.load(std::memory_order_acquire) < target)
+            m_Flushed.wait_for(lock, boost::chrono::milliseconds(10));
+    }
+    --m_FlushWaiters;
+
+    m_Log->Flush();
+}
+
+std::uint64_t AsyncLog::GetDropped() const
+{
+    return m_Dropped.load(std::memory_order_relaxed);
+}
+
+void AsyncLog::Push(Record&& record)
+{
+    if (TryPush(record))
+        return;
+
+    if (m_Overflow == Overflow::Drop || (m_Overflow == Overflow::DropBelow && record.level > m_Threshold))
+    {
+        m_Dropped.fetch_add(1, std::memory_order_relaxed);
+        if (Metrics::IsEnabled())
+            Metrics::OnDrop();
+        return;
+    }
+
+    // queue is full, wait for the writer thread to catch up
+    for (unsigned attempt = 0; !TryPush(record); ++attempt)
+    {
+        Wake();
+        if (attempt < 64)
+            boost::this_thread::yield();
+        else
+            boost::this_thread::sleep_for(boost::chrono::microseconds(50));
+    }
+}
+
+bool AsyncLog::TryPush(Record& record)
+{
+    auto position = m_Head.load(std::memory_order_relaxed);
+    Cell* cell;
+    for (;;)
+    {
+        cell = &m_Cells[position & m_Mask];
+        const auto sequence = cell->m_Sequence.load(std::memory_order_acquire);
+        const auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position);
+        if (!diff)
+        {
+            if (m_Head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                break;
+        }
+        else if (diff < 0)
+        {
+            return false;
+        }
+        else
+        {
+            position = m_Head.load(std::memory_order_relaxed);
+        }
+    }
+
+    cell->m_Record = std::move(record);
+    cell->m_Sequence.store(position + 1, std::memory_order_release);
+    if (Metrics::IsEnabled())
+        Metrics::OnQueue(1);
+
+    // pairs with the fence in Run so the writer thread either sees the record or is notified
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_Sleeping.load(std::memory_order_relaxed))
+        Wake();
+    return true;
+}
+
+std::size_t AsyncLog::Drain()
+{
+    std::size_t count = 0;
+    for (;;)
+    {
+        m_Batch.clear();
+        while (m_Batch.size() < g_BatchSize)
+        {
+            Cell& cell = m_Cells[m_Tail & m_Mask];
+            if (cell.m_Sequence.load(std::memory_order_acquire) != m_Tail + 1)
+                break;
+
+            // release the slot before the slow write so producers are not held by the sink
+            m_Batch.push_back(std::move(cell.m_Record));
+            cell.m_Sequence.store(m_Tail + m_Mask + 1, std::memory_order_release);
+            ++m_Tail;
+        }
+
+        if (m_Batch.empty())
+            break;
+
+        if (Metrics::IsEnabled())
+            Metrics::OnQueue(-static_cast<std::int64_t>(m_Batch.size()));
+        m_Log->WriteBatch(m_Batch.data(), m_Batch.size());
+        count += m_Batch.size();
+        m_Written.store(m_Tail, std::memory_order_release);
+    }
+
+    if (m_FlushWaiters.load())
+    {
+        boost::unique_lock<boost::mutex> lock(m_Mutex);
+        m_Flushed.notify_all();
+    }
+    return count;
+}
+
+void AsyncLog::Wake()
+{
+    boost::unique_lock<boost::mutex> lock(m_Mutex);
+    m_Wakeup.notify_one();
+}
+
+void AsyncLog::Run()
+{
+    for (;;)
+    {
+        if (Drain())
+            continue;
+
+        if (m_Stopped)
+        {
+            // producers are gone, write whatever is left and quit
+            while (Drain())
+                ;
+            break;
+        }
+
+        boost::unique_lock<boost::mutex> lock(m_Mutex);
+        m_Sleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        const Cell& cell = m_Cells[m_Tail & m_Mask];
+        if (cell.m_Sequence.load(std::memory_order_acquire) != m_Tail + 1 && !m_Stopped)
+            m_Wakeup.wait_for(lock, boost::chrono::milliseconds(100));
+
+        m_Sleeping.store(false, std::memory_order_relaxed);
+    }
+}
+
+} // namespace logging
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <string>
+
+namespace logging
+{
+namespace detail
+{
+namespace binary
+{
+
+//! File header, payloads are in the native byte order of the writer
+const char g_Magic[8] = { 'L', 'O', 'G', 'B', 'I', 'N', '\0', '\1' };
+
+//! Record kinds, every record is a varint body size followed by the body starting with the kind
+//!
+//! Block       varint time; resets the interned strings, threads and the time base
+//! String      varint id, bytes
+//! Thread      varint id, bytes
+//! Text        varint time delta, level, varint module, varint function, varint thread, text bytes
+//! Arguments   varint time delta, level, varint module, varint function, varint thread, varint format, payload
+//! Fields      as Arguments, the payload holds key value pairs and the format is the message
+//! Site        varint id, level, varint module, varint function, varint format (0 for none); a call site
+//! SiteText    varint time delta, varint site, varint thread, text bytes
+//! SiteArgs    varint time delta, varint site, varint thread, payload formatted with the site format
+//!
+struct Kind
+{
+    enum Value : unsigned char
+    {
+        Block       = 0,
+        String      = 1,
+        Thread      = 2,
+        Text        = 3,
+        Arguments   = 4,
+        Fields      = 5,
+        Site        = 6,
+        SiteText    = 7,
+        SiteArgs    = 8,
+    };
+};
+
+//! Index entry in file.idx, start time and offset of a block
+struct IndexEntry
+{
+    std::uint64_t time;
+    std::uint64_t offset;
+};
+
+inline void PutVarint(std::string& out, std::uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        out += static_cast<char>(value | 0x80);
+        value >>= 7;
+    }
+    out += static_cast<char>(value);
+}
+
+inline bool GetVarint(const char*& it, const char* end, std::uint64_t& value)
+{
+    value = 0;
+    for (unsigned shift = 0; it != end && shift < 64; shift += 7)
+    {
+        const auto byte = static_cast<unsigned char>(*it++);
+        value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+inline bool ReadVarint(std::istream& in, std::uint64_t& value)
+{
+    value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7)
+    {
+        const auto byte = in.get();
+        if (byte == std::istream::traits_type::eof())
+            return false;
+        value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+//! Signed deltas as small unsigned values
+inline std::uint64_t ZigZag(std::int64_t value)
+{
+    return (static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value >> 63);
+}
+
+inline std::int64_t UnZigZag(std::uint64_t value)
+{
+    return static_cast<std::int64_t>(value >> 1) ^ -static_cast<std::int64_t>(value & 1);
+}
+
+} // namespace binary
+} // namespace detail
+} // namespace logging
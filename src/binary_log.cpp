@@ -0,0 +1,545 @@
+#include "log/binary_log.h"
+#include "log/call_site.h"
+#include "log/clock.h"
+#include "binary_format.h"
+#include "layout.h"
+#include "levels.h"
+#include "output_buffer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+namespace logging
+{
+
+namespace binary = detail::binary;
+
+Binary::Binary(ILog::Level::Value level, const char* file, const FlushPolicy& policy, std::size_t block)
+    : m_Policy(policy)
+    , m_BlockSize(block)
+    , m_FileName(file)
+    , m_Levels(new detail::PublishedLevels(level))
+    , m_Output(nullptr)
+    , m_BlockStart()
+    , m_Time()
+    , m_NextId(1)
+    , m_Stopped()
+{
+    const auto folder = boost::filesystem::path(m_FileName).branch_path();
+    if (!folder.empty() && !boost::filesystem::exists(folder))
+        boost::filesystem::create_directories(folder);
+
+    boost::system::error_code error;
+    auto size = boost::filesystem::file_size(m_FileName, error);
+    if (error)
+        size = 0;
+
+    // buffering is done by OutputBuffer, so every drain is a single write
+    m_File.rdbuf()->pubsetbuf(nullptr, 0);
+    m_File.open(m_FileName, std::ios::binary | std::ios::app);
+    if (!m_File)
+        throw std::runtime_error("unable to open " + m_FileName);
+    m_Index.open(m_FileName + ".idx", std::ios::binary | std::ios::app);
+
+    m_Buffer.reset(new detail::OutputBuffer(m_File.rdbuf(), m_Policy.size, size));
+    m_Output.rdbuf(m_Buffer.get());
+    if (!size)
+        m_Output.write(binary::g_Magic, sizeof(binary::g_Magic));
+
+    // appended records start a new block
+    m_BlockStart = m_Buffer->GetWritten() - m_BlockSize;
+
+    if (m_Policy.interval)
+        m_Flusher = boost::thread(&Binary::RunFlusher, this);
+}
+
+Binary::~Binary()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(m_Mutex);
+        m_Stopped = true;
+        m_Stop.notify_all();
+    }
+    if (m_Flusher.joinable())
+        m_Flusher.join();
+
+    m_Output.flush();
+}
+
+bool Binary::IsEnabled(const char* module, Level::Value level) const
+{
+    return m_Levels->IsEnabled(module, level);
+}
+
+boost::filesystem::path Binary::GetLogFolder(const char* /*module*/) const
+{
+    return boost::filesystem::path(m_FileName).branch_path();
+}
+
+void Binary::Write(const char* module, ILog::Level::Value level, const std::string& text, const char* /*file*/, unsigned /*line*/, const char* function)
+{
+    Append(module, level, text, nullptr, function, Clock::Now(), boost::this_thread::get_id());
+}
+
+void Binary::Write(const char* module, ILog::Level::Value level, const char* text, std::size_t size, const char* /*file*/, unsigned /*line*/, const char* function)
+{
+    Append(module, level, boost::string_ref(text, size), nullptr, function, Clock::Now(), boost::this_thread::get_id());
+}
+
+void Binary::Write(const char* module, ILog::Level::Value level, const logging::Arguments& arguments, const char* /*file*/, unsigned /*line*/, const char* function)
+{
+    Append(module, level, boost::string_ref(), &arguments, function, Clock::Now(), boost::this_thread::get_id());
+}
+
+void Binary::Write(const CallSite& site, const std::string& text)
+{
+    Append(site, text, nullptr, Clock::Now(), boost::this_thread::get_id());
+}
+
+void Binary::Write(const CallSite& site, const char* text, std::size_t size)
+{
+    Append(site, boost::string_ref(text, size), nullptr, Clock::Now(), boost::this_thread::get_id());
+}
+
+void Binary::Write(const CallSite& site, const Arguments& arguments)
+{
+    Append(site, boost::string_ref(), &arguments, Clock::Now(), boost::this_thread::get_id());
+}
+
+void Binary::Write(const Record& record)
+{
+    if (record.site)
+        Append(*record.site, record.text, record.arguments.IsEmpty() ? nullptr : &record.arguments, record.time, record.thread);
+    else if (record.arguments.IsEmpty())
+        Append(record.module, record.level, record.text, nullptr, record.function, record.time, record.thread);
+    else
+        Append(record.module, record.level, boost::string_ref(), &record.arguments, record.function, record.time, record.thread);
+}
+
+void Binary::Append(const char* module, ILog::Level::Value level, boost::string_ref text, const Arguments* arguments, const char* function, std::uint64_t time, const boost::thread::id& thread)
+{
+    boost::unique_lock<boost::mutex> lock(m_Mutex);
+
+    if (m_Buffer->GetWritten() - m_BlockStart >= m_BlockSize)
+        StartBlock(time);
+
+    // ids first, interning writes the definitions before this record
+    const auto moduleId = Intern(module);
+    const auto functionId = Intern(function);
+    const auto threadId = Intern(thread);
+    const auto formatId = arguments ? Intern(arguments->GetFormat()) : 0;
+
+    m_Body.clear();
+    m_Body += static_cast<char>(!arguments ? binary::Kind::Text : arguments->IsStructured() ? binary::Kind::Fields : binary::Kind::Arguments);
+    binary::PutVarint(m_Body, binary::ZigZag(static_cast<std::int64_t>(time - m_Time)));
+    m_Body += static_cast<char>(level);
+    binary::PutVarint(m_Body, moduleId);
+    binary::PutVarint(m_Body, functionId);
+    binary::PutVarint(m_Body, threadId);
+    if (arguments)
+    {
+        binary::PutVarint(m_Body, formatId);
+        m_Body.append(arguments->GetData(), arguments->GetSize());
+    }
+    else
+    {
+        m_Body.append(text.data(), text.size());
+    }
+    m_Time = time;
+    Put(m_Body);
+
+    if (level <= m_Policy.level)
+        m_Output.flush();
+}
+
+void Binary::Append(const CallSite& site, boost::string_ref text, const Arguments* arguments, std::uint64_t time, const boost::thread::id& thread)
+{
+    // the site stands for the format only when the arguments use its literal
+    if (!site.GetId() || (arguments && (arguments->IsStructured() || arguments->GetFormat() != site.GetFormat())))
+    {
+        Append(site.GetModule(), site.GetLevel(), text, arguments, site.GetFunction(), time, thread);
+        return;
+    }
+
+    boost::unique_lock<boost::mutex> lock(m_Mutex);
+
+    if (m_Buffer->GetWritten() - m_BlockStart >= m_BlockSize)
+        StartBlock(time);
+
+    const auto siteId = Intern(site);
+    const auto threadId = Intern(thread);
+
+    m_Body.clear();
+    m_Body += static_cast<char>(arguments ? binary::Kind::SiteArgs : binary::Kind::SiteText);
+    binary::PutVarint(m_Body, binary::ZigZag(static_cast<std::int64_t>(time - m_Time)));
+    binary::PutVarint(m_Body, siteId);
+    binary::PutVarint(m_Body, threadId);
+    if (arguments)
+        m_Body.append(arguments->GetData(), arguments->GetSize());
+    else
+        m_Body.append(text.data(), text.size());
+    m_Time = time;
+    Put(m_Body);
+
+    if (site.GetLevel() <= m_Policy.level)
+        m_Output.flush();
+}
+
+std::uint64_t Binary::Intern(const CallSite& site)
+{
+    const auto index = site.GetId();
+    if (index >= m_Sites.size())
+        m_Sites.resize(index + 1);
+    if (m_Sites[index])
+        return m_Sites[index];
+
+    const auto moduleId = Intern(site.GetModule());
+    const auto functionId = Intern(site.GetFunction());
+    const auto formatId = site.GetFormat() ? Intern(site.GetFormat()) : 0;
+    const auto id = m_NextId++;
+
+    m_Definition.clear();
+    m_Definition += static_cast<char>(binary::Kind::Site);
+    binary::PutVarint(m_Definition, id);
+    m_Definition += static_cast<char>(site.GetLevel());
+    binary::PutVarint(m_Definition, moduleId);
+    binary::PutVarint(m_Definition, functionId);
+    binary::PutVarint(m_Definition, formatId);
+    Put(m_Definition);
+
+    m_Sites[index] = id;
+    return id;
+}
+
+std::uint64_t Binary::Intern(const char* text)
+{
+    if (!text)
+        text = "";
+
+    // keyed by pointer as names are mostly literals, the copy catches reused buffers
+    auto& entry = m_Strings[text];
+    if (entry.first && entry.second == text)
+        return entry.first;
+
+    entry.first = m_NextId++;
+    entry.second = text;
+
+    m_Definition.clear();
+    m_Definition += static_cast<char>(binary::Kind::String);
+    binary::PutVarint(m_Definition, entry.first);
+    m_Definition += entry.second;
+    Put(m_Definition);
+    return entry.first;
+}
+
+std::uint64_t Binary::Intern(const boost::thread::id& thread)
+{
+    auto& id = m_Threads[thread];
+    if (id)
+        return id;
+
+    id = m_NextId++;
+
+    m_Definition.clear();
+    m_Definition += static_cast<char>(binary::Kind::Thread);
+    binary::PutVarint(m_Definition, id);
+    m_Definition += detail::ThreadIdText(thread);
+    Put(m_Definition);
+    return id;
+}
+
+void Binary::StartBlock(std::uint64_t time)
+{
+    m_Strings.clear();
+    m_Threads.clear();
+    std::fill(m_Sites.begin(), m_Sites.end(), 0);
+    m_NextId = 1;
+    m_Time = time;
+    m_BlockStart = m_Buffer->GetWritten();
+
+    const binary::IndexEntry entry{ time, m_BlockStart };
+    m_Index.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+
+    m_Definition.clear();
+    m_Definition += static_cast<char>(binary::Kind::Block);
+    binary::PutVarint(m_Definition, time);
+    Put(m_Definition);
+}
+
+void Binary::Put(const std::string& body)
+{
+    char prefix[10];
+    std::size_t length = 0;
+    for (auto size = body.size(); ; size >>= 7)
+    {
+        prefix[length++] = static_cast<char>(size < 0x80 ? size : (size & 0x7f) | 0x80);
+        if (size < 0x80)
+            break;
+    }
+    m_Output.write(prefix, static_cast<std::streamsize>(length));
+    m_Output.write(body.data(), static_cast<std::streamsize>(body.size()));
+}
+
+void Binary::RunFlusher()
+{
+    boost::unique_lock<boost::mutex> lock(m_Mutex);
+    while (!m_Stopped)
+    {
+        m_Stop.wait_for(lock, boost::chrono::milliseconds(m_Policy.interval));
+        if (m_Buffer->GetPending())
+        {
+            m_Output.flush();
+            m_Index.flush();
+        }
+    }
+}
+
+void Binary::Flush()
+{
+    boost::unique_lock<boost::mutex> lock(m_Mutex);
+    m_Output.flush();
+    m_Index.flush();
+}
+
+void Binary::SetLevel(Level::Value level)
+{
+    m_Levels->Set(level);
+}
+
+void Binary::SetLevels(const boost::property_tree::ptree& settings)
+{
+    m_Levels->Set(settings);
+}
+
+namespace
+{
+
+std::vector<binary::IndexEntry> ReadIndex(const std::string& file)
+{
+    std::ifstream index(file + ".idx", std::ios::binary);
+    std::vector<binary::IndexEntry> entries;
+    binary::IndexEntry entry;
+    while (index.read(reinterpret_cast<char*>(&entry), sizeof(entry)))
+        entries.push_back(entry);
+    return entries;
+}
+
+//! Offset of the last block starting at or before the time, 0 if unknown
+std::uint64_t FindBlock(const std::vector<binary::IndexEntry>& entries, std::uint64_t time)
+{
+    std::uint64_t offset = 0;
+    for (const auto& e : entries)
+    {
+        if (e.time > time)
+            break;
+        offset = e.offset;
+    }
+    return offset;
+}
+
+} // anonymous namespace
+
+void Decode(const std::string& file, std::ostream& out, std::uint64_t from, std::uint64_t to)
+{
+    std::ifstream in(file, std::ios::binary);
+    if (!in)
+        throw std::runtime_error("unable to open " + file);
+
+    char magic[sizeof(binary::g_Magic)];
+    if (!in.read(magic, sizeof(magic)) || std::memcmp(magic, binary::g_Magic, sizeof(magic)))
+        throw std::runtime_error("not a binary log: " + file);
+
+    in.seekg(0, std::ios::end);
+    const auto fileSize = static_cast<std::uint64_t>(in.tellg());
+    in.seekg(sizeof(magic));
+
+    const auto index = ReadIndex(file);
+    if (from)
+    {
+        if (const auto offset = FindBlock(index, from))
+            in.seekg(static_cast<std::streamoff>(offset));
+    }
+
+    // a damaged record can't be skipped reliably, decoding goes on at the next indexed block after it
+    const auto resync = [&](std::uint64_t position) {
+        for (const auto& entry : index)
+        {
+            if (entry.offset > position && entry.offset < fileSize)
+            {
+                in.clear();
+                in.seekg(static_cast<std::streamoff>(entry.offset));
+                return true;
+            }
+        }
+        return false;
+    };
+
+    std::unordered_map<std::uint64_t, std::string> strings;
+    std::unordered_map<std::uint64_t, std::string> threads;
+    struct Site
+    {
+        ILog::Level::Value level;
+        std::uint64_t module;
+        std::uint64_t function;
+        std::uint64_t format;
+    };
+    std::unordered_map<std::uint64_t, Site> sites;
+    std::uint64_t time = 0;
+    std::string body;
+    std::string line;
+    const std::string unknown("?");
+
+    const auto lookup = [&unknown](const std::unordered_map<std::uint64_t, std::string>& table, std::uint64_t id) -> const std::string& {
+        const auto it = table.find(id);
+        return it == table.end() ? unknown : it->second;
+    };
+
+    for (;;)
+    {
+        const auto start = static_cast<std::uint64_t>(in.tellg());
+        std::uint64_t size;
+        if (!binary::ReadVarint(in, size))
+        {
+            if (!in.eof() && resync(start))
+                continue;
+            break;
+        }
+
+        // a body running past the end is the partial tail of a crashed writer, or a damaged size
+        const auto position = static_cast<std::uint64_t>(in.tellg());
+        if (!size || size > fileSize - position)
+        {
+            if (resync(start))
+                continue;
+            break;
+        }
+
+        body.resize(static_cast<std::size_t>(size));
+        if (!in.read(&body[0], static_cast<std::streamsize>(size)))
+            break;
+
+        const char* it = body.data() + 1;
+        const char* const end = body.data() + body.size();
+        std::uint64_t value;
+        bool valid = true;
+
+        switch (static_cast<binary::Kind::Value>(body.front()))
+        {
+        case binary::Kind::Block:
+            if (!binary::GetVarint(it, end, value))
+            {
+                valid = false;
+                break;
+            }
+            if (value > to)
+                return;
+            strings.clear();
+            threads.clear();
+            sites.clear();
+            time = value;
+            break;
+        case binary::Kind::String:
+        case binary::Kind::Thread:
+            if (binary::GetVarint(it, end, value))
+                (body.front() == binary::Kind::String ? strings : threads)[value].assign(it, end);
+            else
+                valid = false;
+            break;
+        case binary::Kind::Text:
+        case binary::Kind::Arguments:
+        case binary::Kind::Fields:
+        {
+            std::uint64_t delta, module, function, thread, format = 0;
+            if (!binary::GetVarint(it, end, delta) || it == end)
+            {
+                valid = false;
+                break;
+            }
+            const auto level = static_cast<ILog::Level::Value>(*it++);
+            if (!binary::GetVarint(it, end, module) || !binary::GetVarint(it, end, function) || !binary::GetVarint(it, end, thread) ||
+                (body.front() != binary::Kind::Text && !binary::GetVarint(it, end, format)))
+            {
+                valid = false;
+                break;
+            }
+            if (body.front() != binary::Kind::Text && !Arguments::IsValid(it, static_cast<std::size_t>(end - it)))
+            {
+                valid = false;
+                break;
+            }
+
+            time += static_cast<std::uint64_t>(binary::UnZigZag(delta));
+            if (time < from || time > to)
+                break;
+
+            const auto text = body.front() != binary::Kind::Text ?
+                Arguments(lookup(strings, format), it, static_cast<std::size_t>(end - it), body.front() == binary::Kind::Fields).Format() :
+                std::string(it, end);
+
+            line.clear();
+            detail::Render(line, lookup(strings, module).c_str(), level, text, lookup(strings, function).c_str(), time, lookup(threads, thread));
+            out << line;
+            break;
+        }
+        case binary::Kind::Site:
+        {
+            Site site;
+            if (!binary::GetVarint(it, end, value) || it == end)
+            {
+                valid = false;
+                break;
+            }
+            site.level = static_cast<ILog::Level::Value>(*it++);
+            if (!binary::GetVarint(it, end, site.module) || !binary::GetVarint(it, end, site.function) || !binary::GetVarint(it, end, site.format))
+            {
+                valid = false;
+                break;
+            }
+            sites[value] = site;
+            break;
+        }
+        case binary::Kind::SiteText:
+        case binary::Kind::SiteArgs:
+        {
+            std::uint64_t delta, id, thread;
+            if (!binary::GetVarint(it, end, delta) || !binary::GetVarint(it, end, id) || !binary::GetVarint(it, end, thread) ||
+                (body.front() == binary::Kind::SiteArgs && !Arguments::IsValid(it, static_cast<std::size_t>(end - it))))
+            {
+                valid = false;
+                break;
+            }
+
+            time += static_cast<std::uint64_t>(binary::UnZigZag(delta));
+            if (time < from || time > to)
+                break;
+
+            const auto site = sites.find(id);
+            if (site == sites.end())
+                break;
+
+            const auto text = body.front() == binary::Kind::SiteArgs ?
+                Arguments(lookup(strings, site->second.format), it, static_cast<std::size_t>(end - it)).Format() :
+                std::string(it, end);
+
+            line.clear();
+            detail::Render(line, lookup(strings, site->second.module).c_str(), site->second.level, text, lookup(strings, site->second.function).c_str(), time, lookup(threads, thread));
+            out << line;
+            break;
+        }
+        default:
+            break;
+        }
+
+        if (!valid)
+        {
+            if (!resync(start))
+                return;
+        }
+    }
+}
+
+} // namespace logging
@@ -0,0 +1,67 @@
+#include "log/call_site.h"
+
+#include <mutex>
+#include <vector>
+
+namespace logging
+{
+
+namespace
+{
+
+std::mutex& GetMutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
+std::vector<const CallSite*>& GetSites()
+{
+    static std::vector<const CallSite*> sites;
+    return sites;
+}
+
+} // anonymous namespace
+
+void CallSite::Register(const char* function)
+{
+    std::lock_guard<std::mutex> lock(GetMutex());
+    if (m_Id.load(std::memory_order_relaxed))
+        return;
+
+    auto& sites = GetSites();
+    sites.push_back(this);
+
+    m_Function = function;
+    m_Id.store(static_cast<unsigned>(sites.size()), std::memory_order_release);
+}
+
+const CallSite* CallSite::Find(unsigned id)
+{
+    std::lock_guard<std::mutex> lock(GetMutex());
+    const auto& sites = GetSites();
+    return id && id <= sites.size() ? sites[id - 1] : nullptr;
+}
+
+std::size_t CallSite::GetCount()
+{
+    std::lock_guard<std::mutex> lock(GetMutex());
+    return GetSites().size();
+}
+
+} // namespace logging
+
+void ILog::Write(const logging::CallSite& site, const std::string& text)
+{
+    Write(site.GetModule(), site.GetLevel(), text, site.GetFile(), site.GetLine(), site.GetFunction());
+}
+
+void ILog::Write(const logging::CallSite& site, const char* text, std::size_t size)
+{
+    Write(site.GetModule(), site.GetLevel(), text, size, site.GetFile(), site.GetLine(), site.GetFunction());
+}
+
+void ILog::Write(const logging::CallSite& site, const logging::Arguments& arguments)
+{
+    Write(site.GetModule(), site.GetLevel(), arguments, site.GetFile(), site.GetLine(), site.GetFunction());
+}
@@ -0,0 +1,41 @@
+#include "log/clock.h"
+
+#include <atomic>
+#include <chrono>
+
+namespace logging
+{
+
+namespace
+{
+
+//! How often the monotonic clock is re-anchored to the wall clock
+const std::int64_t g_AnchorPeriod = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::minutes(1)).count();
+
+std::int64_t GetMonotonic()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+std::int64_t GetWall()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+} // anonymous namespace
+
+std::uint64_t Clock::Now()
+{
+    static std::atomic<std::int64_t> offset{ GetWall() - GetMonotonic() };
+    static std::atomic<std::int64_t> anchor{ GetMonotonic() + g_AnchorPeriod };
+
+    const auto now = GetMonotonic();
+    if (now >= anchor.load(std::memory_order_relaxed))
+    {
+        anchor.store(now + g_AnchorPeriod, std::memory_order_relaxed);
+        offset.store(GetWall() - GetMonotonic(), std::memory_order_relaxed);
+    }
+    return static_cast<std::uint64_t>(now + offset.load(std::memory_order_relaxed));
+}
+
+} // namespace logging
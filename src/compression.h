@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#include <zlib.h>
+
+namespace logging
+{
+namespace detail
+{
+
+//! Gzip stream buffer in front of a stream buffer
+//!
+//! Every write becomes a complete gzip member, concatenated members are a valid gzip file.
+//! Placed behind OutputBuffer a member holds whole records, so a crash loses at most the unwritten buffer.
+//!
+class GzipBuffer : public std::streambuf
+{
+public:
+    explicit GzipBuffer(std::streambuf* target, int level = Z_BEST_SPEED)
+        : m_Target(target)
+        , m_Output(64 * 1024)
+        , m_Stream()
+        , m_Valid(deflateInit2(&m_Stream, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK)
+    {
+    }
+
+    ~GzipBuffer()
+    {
+        if (m_Valid)
+            deflateEnd(&m_Stream);
+    }
+
+    GzipBuffer(const GzipBuffer&) = delete;
+    GzipBuffer& operator = (const GzipBuffer&) = delete;
+
+protected:
+    virtual int_type overflow(int_type c) override
+    {
+        if (traits_type::eq_int_type(c, traits_type::eof()))
+            return traits_type::not_eof(c);
+
+        const char value = traits_type::to_char_type(c);
+        return xsputn(&value, 1) == 1 ? c : traits_type::eof();
+    }
+
+    virtual std::streamsize xsputn(const char* data, std::streamsize size) override
+    {
+        if (!m_Valid || deflateReset(&m_Stream) != Z_OK)
+            return 0;
+
+        m_Stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+        m_Stream.avail_in = static_cast<uInt>(size);
+        int result = Z_OK;
+        while (result != Z_STREAM_END)
+        {
+            m_Stream.next_out = reinterpret_cast<Bytef*>(m_Output.data());
+            m_Stream.avail_out = static_cast<uInt>(m_Output.size());
+            result = deflate(&m_Stream, Z_FINISH);
+            if (result == Z_STREAM_ERROR)
+                return 0;
+
+            const auto produced = static_cast<std::streamsize>(m_Output.size() - m_Stream.avail_out);
+            if (m_Target->sputn(m_Output.data(), produced) != produced)
+                return 0;
+        }
+        return size;
+    }
+
+    virtual int sync() override
+    {
+        return m_Target->pubsync();
+    }
+
+private:
+    std::streambuf* const m_Target;
+    std::vector<char> m_Output;
+    z_stream m_Stream;
+    const bool m_Valid;
+};
+
+//! Compress a file into a gzip file, false if either file can't be used
+inline bool CompressFile(const std::string& from, const std::string& to)
+{
+    std::FILE* input = std::fopen(from.c_str(), "rb");
+    if (!input)
+        return false;
+
+    gzFile output = gzopen(to.c_str(), "wb");
+    if (!output)
+    {
+        std::fclose(input);
+        return false;
+    }
+
+    std::vector<char> buffer(256 * 1024);
+    bool ok = true;
+    while (ok)
+    {
+        const auto size = std::fread(buffer.data(), 1, buffer.size(), input);
+        if (!size)
+            break;
+        ok = gzwrite(output, buffer.data(), static_cast<unsigned>(size)) == static_cast<int>(size);
+    }
+
+    ok = !std::ferror(input) && ok;
+    std::fclose(input);
+    return gzclose(output) == Z_OK && ok;
+}
+
+//! Size of the text in a gzip file, all members counted, 0 if it can't be read
+inline std::uint64_t GetUncompressedSize(const std::string& file)
+{
+    gzFile input = gzopen(file.c_str(), "rb");
+    if (!input)
+        return 0;
+
+    std::vector<char> buffer(256 * 1024);
+    std::uint64_t size = 0;
+    for (int read; (read = gzread(input, buffer.data(), static_cast<unsigned>(buffer.size()))) > 0; )
+        size += static_cast<std::uint64_t>(read);
+    gzclose(input);
+    return size;
+}
+
+} // namespace detail
+} // namespace logging
@@ -0,0 +1,126 @@
+#include "config_watcher.h"
+
+#include <boost/filesystem.hpp>
+
+#ifdef __linux__
+#include <cerrno>
+#include <climits>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <boost/system/system_error.hpp>
+#endif
+
+namespace logging
+{
+namespace detail
+{
+
+ConfigWatcher::ConfigWatcher(const std::string& file, const std::function<void()>& callback)
+    : m_File(boost::filesystem::absolute(file).string())
+    , m_Callback(callback)
+    , m_Notify(-1)
+    , m_Wake{ -1, -1 }
+{
+#ifdef __linux__
+    m_Notify = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_Notify < 0)
+        throw boost::system::system_error(errno, boost::system::system_category(), "inotify_init1");
+
+    const auto folder = boost::filesystem::path(m_File).branch_path().string();
+    if (::inotify_add_watch(m_Notify, folder.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0 || ::pipe2(m_Wake, O_CLOEXEC))
+    {
+        const int code = errno;
+        ::close(m_Notify);
+        throw boost::system::system_error(code, boost::system::system_category(), "watch " + folder);
+    }
+#endif
+
+    m_Thread = boost::thread(&ConfigWatcher::Run, this);
+}
+
+ConfigWatcher::~ConfigWatcher()
+{
+#ifdef __linux__
+    const char stop = 0;
+    if (::write(m_Wake[1], &stop, 1) != 1)
+    {
+        // the pipe is empty and open, cannot happen
+    }
+    m_Thread.join();
+
+    ::close(m_Wake[0]);
+    ::close(m_Wake[1]);
+    ::close(m_Notify);
+#else
+    m_Thread.interrupt();
+    m_Thread.join();
+#endif
+}
+
+#ifdef __linux__
+
+void ConfigWatcher::Run()
+{
+    const auto name = boost::filesystem::path(m_File).filename().string();
+
+    alignas(inotify_event) char buffer[sizeof(inotify_event) + NAME_MAX + 1];
+    pollfd fds[] = { { m_Notify, POLLIN, 0 }, { m_Wake[0], POLLIN, 0 } };
+    for (;;)
+    {
+        if (::poll(fds, 2, -1) < 0 && errno != EINTR)
+            break;
+        if (fds[1].revents)
+            break;
+        if (!fds[0].revents)
+            continue;
+
+        // several saves may be queued, reload once
+        bool changed = false;
+        for (ssize_t size; (size = ::read(m_Notify, buffer, sizeof(buffer))) > 0;)
+        {
+            for (const char* it = buffer; it < buffer + size;)
+            {
+                const auto* event = reinterpret_cast<const inotify_event*>(it);
+                changed |= event->len && name == event->name;
+                it += sizeof(inotify_event) + event->len;
+            }
+        }
+
+        if (changed)
+            m_Callback();
+    }
+}
+
+#else
+
+void ConfigWatcher::Run()
+{
+    boost::system::error_code error;
+    auto time = boost::filesystem::last_write_time(m_File, error);
+    try
+    {
+        for (;;)
+        {
+            boost::this_thread::sleep_for(boost::chrono::seconds(1));
+
+            const auto current = boost::filesystem::last_write_time(m_File, error);
+            if (!error && current != time)
+            {
+                time = current;
+                m_Callback();
+            }
+        }
+    }
+    catch (const boost::thread_interrupted&)
+    {
+    }
+}
+
+#endif // __linux__
+
+} // namespace detail
+} // namespace logging
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <functional>
+#include <string>
+
+#include <boost/thread/thread.hpp>
+
+namespace logging
+{
+namespace detail
+{
+
+//! Calls back on a background thread every time the file is written or replaced
+//!
+//! The folder is watched rather than the file, so editors saving through a rename are noticed too.
+//! Uses inotify on Linux, elsewhere the modification time is polled every second.
+//!
+class ConfigWatcher
+{
+public:
+    ConfigWatcher(const std::string& file, const std::function<void()>& callback);
+    ~ConfigWatcher();
+
+private:
+    void Run();
+
+private:
+    const std::string m_File;
+    const std::function<void()> m_Callback;
+    int m_Notify;
+    int m_Wake[2];
+    boost::thread m_Thread;
+};
+
+} // namespace detail
+} // namespace logging
@@ -0,0 +1,71 @@
+#include "log/context.h"
+
+namespace logging
+{
+
+namespace
+{
+
+thread_local const ScopedContext* t_Current = nullptr;
+thread_local bool t_Rendered = true;
+thread_local ContextSnapshot t_Snapshot;
+
+void Render(std::string& out, const ScopedContext* field)
+{
+    if (!field)
+        return;
+
+    Render(out, field->GetOuter());
+    if (!out.empty())
+        out += ' ';
+    out += field->GetKey();
+    out += '=';
+    out.append(field->GetValue().data(), field->GetValue().size());
+}
+
+} // anonymous namespace
+
+ScopedContext::ScopedContext(const char* key, boost::string_ref value)
+    : m_Key(key)
+    , m_Value(value)
+{
+    Enter();
+}
+
+ScopedContext::~ScopedContext()
+{
+    t_Current = m_Outer;
+    t_Rendered = false;
+}
+
+void ScopedContext::Enter()
+{
+    m_Outer = t_Current;
+    t_Current = this;
+    t_Rendered = false;
+}
+
+const ScopedContext* ScopedContext::GetCurrent()
+{
+    return t_Current;
+}
+
+boost::string_ref ScopedContext::GetText()
+{
+    return GetSnapshot().GetText();
+}
+
+const ContextSnapshot& ScopedContext::GetSnapshot()
+{
+    if (!t_Rendered)
+    {
+        // records may still hold the previous text, it is replaced, never changed
+        std::string text;
+        Render(text, t_Current);
+        t_Snapshot = text.empty() ? ContextSnapshot() : ContextSnapshot(std::make_shared<const std::string>(std::move(text)));
+        t_Rendered = true;
+    }
+    return t_Snapshot;
+}
+
+} // namespace logging
@@ -0,0 +1,286 @@
+#include "log/dedup_log.h"
+#include "log/call_site.h"
+#include "log/clock.h"
+#include "modules.h"
+
+#include <vector>
+
+namespace logging
+{
+
+namespace
+{
+
+const std::uint64_t g_HashBasis = 14695981039346656037ull;
+
+//! FNV-1a, messages are short and the hash is computed once per write
+std::uint64_t Hash(const char* data, std::size_t size, std::uint64_t hash = g_HashBasis)
+{
+    for (const char* const end = data + size; data != end; ++data)
+        hash = (hash ^ static_cast<unsigned char>(*data)) * 1099511628211ull;
+    return hash;
+}
+
+std::uint64_t Hash(const Arguments& arguments)
+{
+    // a literal format is identified by its address
+    const char* format = arguments.GetFormat();
+    const auto hash = arguments.IsFormatStatic() ?
+        Hash(reinterpret_cast<const char*>(&format), sizeof(format)) :
+        Hash(format, std::char_traits<char>::length(format));
+    return Hash(arguments.GetData(), arguments.GetSize(), hash);
+}
+
+std::uint64_t Hash(const ILog::Record& record)
+{
+    return record.arguments.IsEmpty() || !record.text.empty() ?
+        Hash(record.text.data(), record.text.size()) :
+        Hash(record.arguments);
+}
+
+//! Record kept for the summary, time and thread are set when it is used; the module must outlive the caller
+ILog::Record MakeRecord(const char* module, ILog::Level::Value level, std::string text, const char* file, unsigned line, const char* function, const Arguments& arguments, const CallSite* site)
+{
+    return ILog::Record{ module, level, std::move(text), file, line, function, 0, boost::thread::id(), arguments, site, ContextSnapshot() };
+}
+
+//! Copy of a written record kept for the summary, with an interned module
+ILog::Record Keep(const ILog::Record& record, const char* module)
+{
+    ILog::Record kept(record);
+    kept.module = module;
+    return kept;
+}
+
+} // anonymous namespace
+
+DedupLog::DedupLog(std::unique_ptr<ILog> log)
+    : DedupLog(std::move(log), Settings())
+{
+}
+
+DedupLog::DedupLog(std::unique_ptr<ILog> log, const Settings& settings)
+    : m_Log(std::move(log))
+    , m_Settings(settings)
+    , m_Window(static_cast<std::uint64_t>(settings.window) * 1000000)
+    , m_Stopped()
+{
+    m_Sweeper = boost::thread(&DedupLog::Run, this);
+}
+
+DedupLog::~DedupLog()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(m_Mutex);
+        m_Stopped = true;
+        m_Stop.notify_all();
+    }
+    m_Sweeper.join();
+    Expire(0, true);
+}
+
+bool DedupLog::IsEnabled(const char* module, Level::Value level) const
+{
+    return m_Log->IsEnabled(module, level);
+}
+
+boost::filesystem::path DedupLog::GetLogFolder(const char* module) const
+{
+    return m_Log->GetLogFolder(module);
+}
+
+void DedupLog::Write(const char* module, ILog::Level::Value level, const std::string& text, const char* file, unsigned line, const char* function)
+{
+    const Key key{ detail::InternModule(module), level, file, line, Hash(text.data(), text.size()) };
+    if (Pass(key, Clock::Now(), [&]() { return MakeRecord(key.module, level, text, file, line, function, Arguments(), nullptr); }))
+        m_Log->Write(module, level, text, file, line, function);
+}
+
+void DedupLog::Write(const char* module, ILog::Level::Value level, const char* text, std::size_t size, const char* file, unsigned line, const char* function)
+{
+    const Key key{ detail::InternModule(module), level, file, line, Hash(text, size) };
+    if (Pass(key, Clock::Now(), [&]() { return MakeRecord(key.module, level, std::string(text, size), file, line, function, Arguments(), nullptr); }))
+        m_Log->Write(module, level, text, size, file, line, function);
+}
+
+void DedupLog::Write(const char* module, ILog::Level::Value level, const Arguments& arguments, const char* file, unsigned line, const char* function)
+{
+    const Key key{ detail::InternModule(module), level, file, line, Hash(arguments) };
+    if (Pass(key, Clock::Now(), [&]() { return MakeRecord(key.module, level, std::string(), file, line, function, arguments, nullptr); }))
+        m_Log->Write(module, level, arguments, file, line, function);
+}
+
+void DedupLog::Write(const CallSite& site, const std::string& text)
+{
+    const Key key{ site.GetModule(), site.GetLevel(), &site, 0, Hash(text.data(), text.size()) };
+    if (Pass(key, Clock::Now(), [&]() { return MakeRecord(site.GetModule(), site.GetLevel(), text, site.GetFile(), site.GetLine(), site.GetFunction(), Arguments(), &site); }))
+        m_Log->Write(site, text);
+}
+
+void DedupLog::Write(const CallSite& site, const char* text, std::size_t size)
+{
+    const Key key{ site.GetModule(), site.GetLevel(), &site, 0, Hash(text, size) };
+    if (Pass(key, Clock::Now(), [&]() { return MakeRecord(site.GetModule(), site.GetLevel(), std::string(text, size), site.GetFile(), site.GetLine(), site.GetFunction(), Arguments(), &site); }))
+        m_Log->Write(site, text, size);
+}
+
+void DedupLog::Write(const CallSite& site, const Arguments& arguments)
+{
+    const Key key{ site.GetModule(), site.GetLevel(), &site, 0, Hash(arguments) };
+    if (Pass(key, Clock::Now(), [&]() { return MakeRecord(site.GetModule(), site.GetLevel(), std::string(), site.GetFile(), site.GetLine(), site.GetFunction(), arguments, &site); }))
+        m_Log->Write(site, arguments);
+}
+
+void DedupLog::Write(const Record& record)
+{
+    const Key key{ detail::InternModule(record.module), record.level, record.site ? static_cast<const void*>(record.site) : record.file, record.site ? 0 : record.line, Hash(record) };
+    if (Pass(key, record.time, [&]() { return Keep(record, key.module); }))
+        m_Log->Write(record);
+}
+
+void DedupLog::Write(const Record& record, RenderedLine& line)
+{
+    const Key key{ detail::InternModule(record.module), record.level, record.site ? static_cast<const void*>(record.site) : record.file, record.site ? 0 : record.line, Hash(record) };
+    if (Pass(key, record.time, [&]() { return Keep(record, key.module); }))
+        m_Log->Write(record, line);
+}
+
+void DedupLog::WriteBatch(const Record* records, std::size_t count)
+{
+    // runs of written records go to the sink as sub-batches, nothing is copied
+    std::size_t begin = 0;
+    for (std::size_t i = 0; i != count; ++i)
+    {
+        const Record& record = records[i];
+        const Key key{ detail::InternModule(record.module), record.level, record.site ? static_cast<const void*>(record.site) : record.file, record.site ? 0 : record.line, Hash(record) };
+
+        // a summary of an expired window follows the records before it
+        const auto forward = [&]() {
+            if (i != begin)
+                m_Log->WriteBatch(records + begin, i - begin);
+            begin = i;
+        };
+        if (Pass(key, record.time, [&]() { return Keep(record, key.module); }, forward))
+            continue;
+
+        if (i != begin)
+            m_Log->WriteBatch(records + begin, i - begin);
+        begin = i + 1;
+    }
+    if (count != begin)
+        m_Log->WriteBatch(records + begin, count - begin);
+}
+
+void DedupLog::SetLevel(Level::Value level)
+{
+    m_Log->SetLevel(level);
+}
+
+void DedupLog::SetLevels(const boost::property_tree::ptree& settings)
+{
+    m_Log->SetLevels(settings);
+}
+
+void DedupLog::Flush()
+{
+    Expire(0, true);
+    m_Log->Flush();
+}
+
+template <typename Make>
+bool DedupLog::Pass(const Key& key, std::uint64_t time, Make&& make)
+{
+    return Pass(key, time, make, []() {});
+}
+
+template <typename Make, typename Before>
+bool DedupLog::Pass(const Key& key, std::uint64_t time, Make&& make, Before&& before)
+{
+    Shard& shard = m_Shards[key.hash % s_Shards];
+    std::unique_ptr<Entry> expired;
+    {
+        boost::unique_lock<boost::mutex> lock(shard.m_Mutex);
+        const auto it = shard.m_Entries.find(key);
+        if (it == shard.m_Entries.end())
+        {
+            if (shard.m_Entries.size() < m_Settings.capacity / s_Shards + 1)
+            {
+                Entry& entry = shard.m_Entries.emplace(key, Entry{ make(), 0, time }).first->second;
+                entry.record.time = time;
+            }
+            return true;
+        }
+
+        Entry& entry = it->second;
+        if (time < entry.record.time + m_Window)
+        {
+            ++entry.count;
+            entry.last = time;
+            return false;
+        }
+
+        // the window is over, this occurrence opens the next one
+        if (entry.count)
+            expired.reset(new Entry(entry));
+        entry.record.time = time;
+        entry.count = 0;
+    }
+
+    // the count goes out before the message that follows it
+    if (expired)
+    {
+        before();
+        WriteRepeated(*expired);
+    }
+    return true;
+}
+
+void DedupLog::Expire(std::uint64_t time, bool force)
+{
+    std::vector<Entry> expired;
+    for (Shard& shard : m_Shards)
+    {
+        boost::unique_lock<boost::mutex> lock(shard.m_Mutex);
+        for (auto it = shard.m_Entries.begin(); it != shard.m_Entries.end(); )
+        {
+            if (!force && time < it->second.record.time + m_Window)
+            {
+                ++it;
+                continue;
+            }
+            if (it->second.count)
+                expired.push_back(std::move(it->second));
+            it = shard.m_Entries.erase(it);
+        }
+    }
+
+    for (const Entry& entry : expired)
+        WriteRepeated(entry);
+}
+
+void DedupLog::WriteRepeated(const Entry& entry)
+{
+    Record record(entry.record);
+    const auto text = record.arguments.IsEmpty() || !record.text.empty() ? record.text : record.arguments.Format();
+    record.text = "last message repeated " + std::to_string(entry.count) + " times: " + text;
+    record.arguments = Arguments();
+    record.time = entry.last;
+    record.thread = boost::this_thread::get_id();
+    m_Log->Write(record);
+}
+
+void DedupLog::Run()
+{
+    boost::unique_lock<boost::mutex> lock(m_Mutex);
+    while (!m_Stopped)
+    {
+        if (m_Stop.wait_for(lock, boost::chrono::milliseconds(m_Settings.window ? m_Settings.window : 1)) != boost::cv_status::timeout || m_Stopped)
+            continue;
+
+        lock.unlock();
+        Expire(Clock::Now(), false);
+        lock.lock();
+    }
+}
+
+} // namespace logging
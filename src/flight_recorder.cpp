@@ -0,0 +1,596 @@
+#include "log/flight_recorder.h"
+#include "log/call_site.h"
+#include "log/clock.h"
+#include "layout.h"
+#include "modules.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include <boost/thread/mutex.hpp>
+
+#ifndef _WIN32
+#include <csignal>
+#include <unistd.h>
+#endif
+
+namespace logging
+{
+
+namespace
+{
+
+//! Recorder instance ids, thread local ring caches are keyed by them so a reused address never matches
+std::atomic<unsigned> g_Instances{ 0 };
+
+#ifndef _WIN32
+//! Recorder dumped by the crash handler
+std::atomic<FlightRecorder*> g_CrashRecorder{ nullptr };
+#endif
+
+//! Bytes of text or binary arguments kept per record, longer records are truncated
+const std::size_t g_SlotSize = 256;
+
+//! Recorded record, the sequence is odd while the owning thread writes the slot
+struct Slot
+{
+    std::atomic<std::uint32_t> m_Sequence{ 0 };
+    std::uint64_t m_Time;
+    const char* m_Module;
+    const char* m_Function;
+    const char* m_Format;       //!< literal format of binary arguments in the data, nullptr for text
+    ILog::Level::Value m_Level;
+    std::uint16_t m_Size;
+    bool m_Truncated;
+    char m_Data[g_SlotSize];
+};
+
+//! Consistent copy of a slot
+struct Entry
+{
+    std::uint64_t m_Time;
+    const char* m_Module;
+    const char* m_Function;
+    const char* m_Format;
+    ILog::Level::Value m_Level;
+    std::uint16_t m_Size;
+    bool m_Truncated;
+    char m_Data[g_SlotSize];
+};
+
+} // anonymous namespace
+
+//! Records of a single thread, written by it only, read by dumps and the crash handler
+class FlightRecorder::Ring
+{
+public:
+    Ring(std::size_t capacity, Ring* next)
+        : m_Capacity(capacity ? capacity : 1)
+        , m_Slots(new Slot[m_Capacity])
+        , m_Written(0)
+        , m_Dumped(0)
+        , m_Start(0)
+        , m_Free(false)
+        , m_Next(next)
+    {
+        SetThread();
+    }
+
+    //! Ring of an exited thread is taken over by the calling one, the records of the previous thread are dropped
+    bool Claim()
+    {
+        bool free = true;
+        if (!m_Free.compare_exchange_strong(free, false))
+            return false;
+
+        const auto written = m_Written.load();
+        m_Start.store(written);
+        m_Dumped.store(written);
+        SetThread();
+        return true;
+    }
+
+    //! Thread is gone, the ring can be claimed
+    void Release() { m_Free.store(true); }
+
+    //! Module must be interned, the slot keeps the pointer until it is dumped
+    void Add(const char* module, ILog::Level::Value level, const char* function, std::uint64_t time, const char* format, const char* data, std::size_t size)
+    {
+        const auto index = m_Written.load(std::memory_order_relaxed);
+        Slot& slot = m_Slots[index % m_Capacity];
+
+        const auto sequence = slot.m_Sequence.load(std::memory_order_relaxed);
+        slot.m_Sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        slot.m_Time = time;
+        slot.m_Module = module;
+        slot.m_Function = function;
+        slot.m_Format = format;
+        slot.m_Level = level;
+        slot.m_Truncated = size > g_SlotSize;
+        slot.m_Size = static_cast<std::uint16_t>(std::min(size, g_SlotSize));
+        std::memcpy(slot.m_Data, data, slot.m_Size);
+
+        slot.m_Sequence.store(sequence + 2, std::memory_order_release);
+        m_Written.store(index + 1, std::memory_order_release);
+    }
+
+    //! Visit consistent copies of the records written since the index, slots being overwritten are skipped
+    template <typename Visitor>
+    std::uint64_t Read(std::uint64_t from, Visitor&& visitor) const
+    {
+        const auto written = m_Written.load(std::memory_order_acquire);
+        from = std::max(from, m_Start.load(std::memory_order_acquire));
+        if (written - from > m_Capacity)
+            from = written - m_Capacity;
+
+        Entry entry;
+        for (auto index = from; index < written; ++index)
+        {
+            const Slot& slot = m_Slots[index % m_Capacity];
+            const auto sequence = slot.m_Sequence.load(std::memory_order_acquire);
+            if (sequence & 1)
+                continue;
+
+            entry.m_Time = slot.m_Time;
+            entry.m_Module = slot.m_Module;
+            entry.m_Function = slot.m_Function;
+            entry.m_Format = slot.m_Format;
+            entry.m_Level = slot.m_Level;
+            entry.m_Size = std::min<std::uint16_t>(slot.m_Size, g_SlotSize);
+            entry.m_Truncated = slot.m_Truncated;
+            std::memcpy(entry.m_Data, slot.m_Data, entry.m_Size);
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.m_Sequence.load(std::memory_order_relaxed) == sequence)
+                visitor(entry);
+        }
+        return written;
+    }
+
+    const boost::thread::id& GetThread() const { return m_Thread; }
+    const char* GetThreadText() const { return m_ThreadText; }
+    std::size_t GetThreadSize() const { return m_ThreadSize; }
+    std::atomic<std::uint64_t>& GetDumped() { return m_Dumped; }
+    Ring* GetNext() const { return m_Next; }
+
+private:
+    void SetThread()
+    {
+        m_Thread = boost::this_thread::get_id();
+        const auto& text = detail::ThreadIdText(m_Thread);
+        m_ThreadSize = std::min(text.size(), sizeof(m_ThreadText));
+        std::memcpy(m_ThreadText, text.data(), m_ThreadSize);
+    }
+
+private:
+    const std::size_t m_Capacity;
+    const std::unique_ptr<Slot[]> m_Slots;
+    boost::thread::id m_Thread;
+    char m_ThreadText[32];
+    std::size_t m_ThreadSize;
+    std::atomic<std::uint64_t> m_Written;
+    std::atomic<std::uint64_t> m_Dumped;
+    std::atomic<std::uint64_t> m_Start;     //!< first record of the current thread
+    std::atomic<bool> m_Free;               //!< thread exited
+    Ring* const m_Next;
+};
+
+//! Rings of a recorder, outlives it while an exiting thread frees its ring
+struct FlightRecorder::Pool
+{
+    ~Pool()
+    {
+        Ring* ring = m_Rings.load();
+        while (ring)
+        {
+            Ring* next = ring->GetNext();
+            delete ring;
+            ring = next;
+        }
+    }
+
+    boost::mutex m_Mutex;
+    std::atomic<Ring*> m_Rings{ nullptr };
+};
+
+FlightRecorder::FlightRecorder(std::unique_ptr<ILog> log)
+    : FlightRecorder(std::move(log), Settings())
+{
+}
+
+FlightRecorder::FlightRecorder(std::unique_ptr<ILog> log, const Settings& settings)
+    : m_Log(std::move(log))
+    , m_Settings(settings)
+    , m_Instance(++g_Instances)
+    , m_Pool(std::make_shared<Pool>())
+{
+}
+
+FlightRecorder::~FlightRecorder()
+{
+#ifndef _WIN32
+    FlightRecorder* self = this;
+    g_CrashRecorder.compare_exchange_strong(self, nullptr);
+#endif
+}
+
+bool FlightRecorder::IsEnabled(const char* module, Level::Value level) const
+{
+    return level <= m_Settings.level || m_Log->IsEnabled(module, level);
+}
+
+boost::filesystem::path FlightRecorder::GetLogFolder(const char* module) const
+{
+    return m_Log->GetLogFolder(module);
+}
+
+void FlightRecorder::Write(const char* module, ILog::Level::Value level, const std::string& text, const char* file, unsigned line, const char* function)
+{
+    if (Pass(module, level))
+        m_Log->Write(module, level, text, file, line, function);
+    else if (level <= m_Settings.level)
+        GetRing().Add(detail::InternModule(module), level, function, Clock::Now(), nullptr, text.data(), text.size());
+}
+
+void FlightRecorder::Write(const char* module, ILog::Level::Value level, const char* text, std::size_t size, const char* file, unsigned line, const char* function)
+{
+    if (Pass(module, level))
+        m_Log->Write(module, level, text, size, file, line, function);
+    else if (level <= m_Settings.level)
+        GetRing().Add(detail::InternModule(module), level, function, Clock::Now(), nullptr, text, size);
+}
+
+void FlightRecorder::Write(const char* module, ILog::Level::Value level, const Arguments& arguments, const char* file, unsigned line, const char* function)
+{
+    if (Pass(module, level))
+    {
+        m_Log->Write(module, level, arguments, file, line, function);
+    }
+    else if (level <= m_Settings.level)
+    {
+        // binary arguments are expanded at dump time, unless they don't fit or are fields
+        if (arguments.IsFormatStatic() && !arguments.IsStructured() && arguments.GetSize() <= g_SlotSize)
+        {
+            GetRing().Add(detail::InternModule(module), level, function, Clock::Now(), arguments.GetFormat(), arguments.GetData(), arguments.GetSize());
+        }
+        else
+        {
+            const auto text = arguments.Format();
+            GetRing().Add(detail::InternModule(module), level, function, Clock::Now(), nullptr, text.data(), text.size());
+        }
+    }
+}
+
+void FlightRecorder::Write(const CallSite& site, const std::string& text)
+{
+    if (Pass(site.GetModule(), site.GetLevel()))
+        m_Log->Write(site, text);
+    else
+        ILog::Write(site, text);
+}
+
+void FlightRecorder::Write(const CallSite& site, const char* text, std::size_t size)
+{
+    if (Pass(site.GetModule(), site.GetLevel()))
+        m_Log->Write(site, text, size);
+    else
+        ILog::Write(site, text, size);
+}
+
+void FlightRecorder::Write(const CallSite& site, const Arguments& arguments)
+{
+    if (Pass(site.GetModule(), site.GetLevel()))
+        m_Log->Write(site, arguments);
+    else
+        ILog::Write(site, arguments);
+}
+
+void FlightRecorder::Write(const Record& record)
+{
+    if (Pass(record.module, record.level))
+    {
+        m_Log->Write(record);
+    }
+    else if (record.level <= m_Settings.level)
+    {
+        const auto text = record.arguments.IsEmpty() ? record.text : record.arguments.Format();
+        GetRing().Add(detail::InternModule(record.module), record.level, record.function, record.time, nullptr, text.data(), text.size());
+    }
+}
+
+void FlightRecorder::SetLevel(Level::Value level)
+{
+    m_Log->SetLevel(level);
+}
+
+void FlightRecorder::SetLevels(const boost::property_tree::ptree& settings)
+{
+    m_Log->SetLevels(settings);
+}
+
+void FlightRecorder::Flush()
+{
+    m_Log->Flush();
+}
+
+bool FlightRecorder::Pass(const char* module, ILog::Level::Value level)
+{
+    if (!m_Log->IsEnabled(module, level))
+        return false;
+    if (level <= m_Settings.trigger)
+        Dump();
+    return true;
+}
+
+FlightRecorder::Ring& FlightRecorder::GetRing()
+{
+    //! Rings held by this thread, freed for other threads when it exits
+    struct Leases
+    {
+        struct Lease
+        {
+            unsigned instance;
+            std::weak_ptr<Pool> pool;
+            Ring* ring;
+        };
+
+        ~Leases()
+        {
+            for (const auto& lease : m_Leases)
+            {
+                if (const auto pool = lease.pool.lock())
+                    lease.ring->Release();
+            }
+        }
+
+        std::vector<Lease> m_Leases;
+    };
+    static thread_local Leases leases;
+
+    for (const auto& lease : leases.m_Leases)
+    {
+        if (lease.instance == m_Instance)
+            return *lease.ring;
+    }
+
+    // leases of destroyed recorders go away here
+    leases.m_Leases.erase(std::remove_if(leases.m_Leases.begin(), leases.m_Leases.end(), [](const Leases::Lease& lease) {
+        return lease.pool.expired();
+    }), leases.m_Leases.end());
+
+    boost::unique_lock<boost::mutex> lock(m_Pool->m_Mutex);
+    Ring* ring = m_Pool->m_Rings.load();
+    while (ring && !ring->Claim())
+        ring = ring->GetNext();
+    if (!ring)
+    {
+        ring = new Ring(m_Settings.records, m_Pool->m_Rings.load());
+        m_Pool->m_Rings.store(ring);
+    }
+    leases.m_Leases.push_back(Leases::Lease{ m_Instance, m_Pool, ring });
+    return *ring;
+}
+
+void FlightRecorder::Dump()
+{
+    struct Dumped
+    {
+        Record record;
+        std::size_t order;
+    };
+
+    boost::unique_lock<boost::mutex> lock(m_Pool->m_Mutex);
+    std::vector<Dumped> records;
+    for (Ring* ring = m_Pool->m_Rings.load(); ring; ring = ring->GetNext())
+    {
+        const auto dumped = ring->Read(ring->GetDumped().load(), [&](const Entry& entry) {
+            std::string text = entry.m_Format ?
+                Arguments(entry.m_Format, entry.m_Data, entry.m_Size).Format() :
+                std::string(entry.m_Data, entry.m_Size);
+            if (entry.m_Truncated)
+                text += "...";
+
+            records.push_back(Dumped{ Record{ entry.m_Module, entry.m_Level, std::move(text), nullptr, 0, entry.m_Function, entry.m_Time, ring->GetThread(), Arguments(), nullptr, ContextSnapshot() }, records.size() });
+        });
+        ring->GetDumped().store(dumped);
+    }
+
+    std::sort(records.begin(), records.end(), [](const Dumped& left, const Dumped& right) {
+        return left.record.time != right.record.time ? left.record.time < right.record.time : left.order < right.order;
+    });
+
+    for (const auto& dumped : records)
+        m_Log->Write(dumped.record);
+}
+
+#ifndef _WIN32
+
+namespace
+{
+
+int g_CrashDescriptor = 2;
+const int g_CrashSignals[] = { SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT };
+
+//! Fixed line buffer for the signal-safe dump, excess text is cut
+class Line
+{
+public:
+    void Append(const char* data, std::size_t size)
+    {
+        size = std::min(size, sizeof(m_Data) - m_Size);
+        std::memcpy(m_Data + m_Size, data, size);
+        m_Size += size;
+    }
+
+    void Append(const char* text)
+    {
+        Append(text, text ? std::strlen(text) : 0);
+    }
+
+    void Append(std::uint64_t value)
+    {
+        char digits[20];
+        std::size_t size = 0;
+        do
+        {
+            digits[sizeof(digits) - ++size] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        } while (value);
+        Append(digits + sizeof(digits) - size, size);
+    }
+
+    void Append(std::int64_t value)
+    {
+        if (value < 0)
+            Append("-", 1);
+        Append(value < 0 ? std::uint64_t(0) - static_cast<std::uint64_t>(value) : static_cast<std::uint64_t>(value));
+    }
+
+    void Write(int fd) const
+    {
+        std::size_t written = 0;
+        while (written < m_Size)
+        {
+            const auto result = ::write(fd, m_Data + written, m_Size - written);
+            if (result <= 0)
+                return;
+            written += static_cast<std::size_t>(result);
+        }
+    }
+
+private:
+    char m_Data[1024];
+    std::size_t m_Size = 0;
+};
+
+const char* GetLevelText(ILog::Level::Value level)
+{
+    static const char* const levels[] = { "ERROR", "WARN", "INFO", "DEBUG", "TRACE" };
+    return level >= 0 && level <= ILog::Level::Trace ? levels[level] : "UNKNOWN";
+}
+
+//! Argument printer for the signal-safe dump, doubles are shown with microsecond precision
+struct AppendArgument
+{
+    Line& line;
+
+    void operator () (bool value) const { line.Append(value ? "1" : "0"); }
+    void operator () (char value) const { line.Append(&value, 1); }
+    void operator () (std::int64_t value) const { line.Append(value); }
+    void operator () (std::uint64_t value) const { line.Append(value); }
+    void operator () (boost::string_ref value) const { line.Append(value.data(), value.size()); }
+
+    void operator () (double value) const
+    {
+        if (!(value == value) || value > 9.2e18 || value < -9.2e18)
+        {
+            line.Append("(double)");
+            return;
+        }
+        if (value < 0)
+        {
+            line.Append("-", 1);
+            value = -value;
+        }
+        const auto whole = static_cast<std::uint64_t>(value);
+        line.Append(whole);
+        const auto fraction = static_cast<std::uint64_t>((value - static_cast<double>(whole)) * 1000000);
+        line.Append(".", 1);
+        char digits[6];
+        auto rest = fraction;
+        for (int i = 5; i >= 0; --i, rest /= 10)
+            digits[i] = static_cast<char>('0' + rest % 10);
+        line.Append(digits, sizeof(digits));
+    }
+
+    void operator () (const void* value) const
+    {
+        static const char hex[] = "0123456789abcdef";
+        char digits[2 + 2 * sizeof(value)];
+        auto bits = reinterpret_cast<std::uintptr_t>(value);
+        digits[0] = '0';
+        digits[1] = 'x';
+        for (std::size_t i = sizeof(digits) - 1; i >= 2; --i, bits >>= 4)
+            digits[i] = hex[bits & 0xf];
+        line.Append(digits, sizeof(digits));
+    }
+};
+
+void OnCrash(int signal)
+{
+    if (FlightRecorder* recorder = g_CrashRecorder.load())
+        recorder->DumpTo(g_CrashDescriptor);
+
+    // handlers are installed with SA_RESETHAND, the default action runs now
+    ::raise(signal);
+}
+
+} // anonymous namespace
+
+void FlightRecorder::DumpTo(int fd) const
+{
+    for (Ring* ring = m_Pool->m_Rings.load(); ring; ring = ring->GetNext())
+    {
+        ring->Read(0, [&](const Entry& entry) {
+            Line line;
+            line.Append("[", 1);
+            line.Append(GetLevelText(entry.m_Level));
+            line.Append("][", 2);
+            line.Append(entry.m_Time / 1000000000);
+            line.Append(".", 1);
+            char micro[6];
+            auto rest = entry.m_Time / 1000 % 1000000;
+            for (int i = 5; i >= 0; --i, rest /= 10)
+                micro[i] = static_cast<char>('0' + rest % 10);
+            line.Append(micro, sizeof(micro));
+            line.Append("][", 2);
+            line.Append(entry.m_Module);
+            line.Append("] [", 3);
+            line.Append(ring->GetThreadText(), ring->GetThreadSize());
+            line.Append("] ", 2);
+            if (entry.m_Format)
+            {
+                line.Append(entry.m_Format);
+                line.Append(" |", 2);
+                const AppendArgument append{ line };
+                Arguments::Visit(entry.m_Data, entry.m_Size, [&](const auto& value) {
+                    line.Append(" ", 1);
+                    append(value);
+                });
+            }
+            else
+            {
+                line.Append(entry.m_Data, entry.m_Size);
+            }
+            if (entry.m_Truncated)
+                line.Append("...", 3);
+            line.Append("/* ", 3);
+            line.Append(entry.m_Function);
+            line.Append(" */\n", 4);
+            line.Write(fd);
+        });
+    }
+}
+
+void FlightRecorder::InstallCrashHandler(int fd)
+{
+    g_CrashDescriptor = fd;
+    g_CrashRecorder.store(this);
+
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = &OnCrash;
+    action.sa_flags = SA_RESETHAND | SA_NODEFER;
+    sigemptyset(&action.sa_mask);
+    for (const auto signal : g_CrashSignals)
+        ::sigaction(signal, &action, nullptr);
+}
+
+#endif // _WIN32
+
+} // namespace logging
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include <boost/filesystem.hpp>
+
+namespace logging
+{
+namespace detail
+{
+
+//! Backup name, file.1 is the newest
+inline std::string GetGeneration(const std::string& file, std::size_t index, const char* suffix = "")
+{
+    return file + "." + std::to_string(index) + suffix;
+}
+
+//! Make room for a new file.1: drop the oldest backup and rename the rest one generation up
+inline void ShiftGenerations(const std::string& file, std::size_t generations, const char* suffix = "")
+{
+    if (!generations)
+        return;
+
+    boost::system::error_code error;
+    boost::filesystem::remove(GetGeneration(file, generations, suffix), error);
+    for (auto i = generations - 1; i; --i)
+    {
+        const auto from = GetGeneration(file, i, suffix);
+        if (boost::filesystem::exists(from, error))
+            boost::filesystem::rename(from, GetGeneration(file, i + 1, suffix), error);
+    }
+}
+
+//! Remove the oldest backups once their total size exceeds the limit, 0 is unlimited
+inline void RetainGenerations(const std::string& file, std::size_t generations, std::uint64_t limit, const char* suffix = "")
+{
+    if (!limit)
+        return;
+
+    boost::system::error_code error;
+    std::uint64_t total = 0;
+    for (std::size_t i = 1; i <= generations; ++i)
+    {
+        const auto path = GetGeneration(file, i, suffix);
+        const auto size = boost::filesystem::file_size(path, error);
+        if (error)
+            break;
+
+        total += size;
+        if (total > limit)
+        {
+            // drop this and all older generations
+            for (auto j = i; j <= generations; ++j)
+                boost::filesystem::remove(GetGeneration(file, j, suffix), error);
+            break;
+        }
+    }
+}
+
+} // namespace detail
+} // namespace logging
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <atomic>
+
+namespace logging
+{
+namespace detail
+{
+
+//! Hazard pointers, a reader publishes the object it uses so a writer frees a replaced object only when nobody does
+//!
+//! Every thread has one slot, so a reader protects a single object at a time. Slots of exited threads are reused
+//! and never freed, the list is as long as the most threads that ever read at once.
+//! Reads are lock-free, not wait-free: a reader retries while the object is replaced under it, and the first
+//! read of a thread takes a slot, allocating one when none is free. Objects here change rarely, so a retry is
+//! rare too.
+//!
+class Hazards
+{
+public:
+
+    //! Object published by the calling thread, released when the guard goes out of scope
+    class Guard
+    {
+    public:
+        template <typename T>
+        explicit Guard(const std::atomic<const T*>& source)
+            : m_Slot(GetSlot())
+        {
+            const T* object = source.load(std::memory_order_acquire);
+            for (;;)
+            {
+                m_Slot.store(object);
+                const T* current = source.load();
+                if (current == object)
+                    break;
+                object = current;
+            }
+            m_Object = object;
+        }
+
+        ~Guard()
+        {
+            m_Slot.store(nullptr, std::memory_order_release);
+        }
+
+        Guard(const Guard&) = delete;
+        Guard& operator = (const Guard&) = delete;
+
+        template <typename T>
+        const T* Get() const { return static_cast<const T*>(m_Object); }
+
+    private:
+        std::atomic<const void*>& m_Slot;
+        const void* m_Object;
+    };
+
+    //! Object is published by a reader, a replaced object that isn't can be freed
+    static bool IsProtected(const void* object)
+    {
+        for (const Slot* slot = GetHead().load(); slot; slot = slot->m_Next)
+        {
+            if (slot->m_Object.load() == object)
+                return true;
+        }
+        return false;
+    }
+
+private:
+    struct Slot
+    {
+        std::atomic<const void*> m_Object{ nullptr };
+        std::atomic<bool> m_Used{ true };
+        Slot* m_Next = nullptr;
+    };
+
+    static std::atomic<Slot*>& GetHead()
+    {
+        static std::atomic<Slot*> head{ nullptr };
+        return head;
+    }
+
+    static std::atomic<const void*>& GetSlot()
+    {
+        //! Slot of this thread, free for another thread when it exits
+        struct Owner
+        {
+            Owner() : m_Slot(Acquire()) {}
+            ~Owner()
+            {
+                m_Slot->m_Object.store(nullptr);
+                m_Slot->m_Used.store(false, std::memory_order_release);
+            }
+
+            Slot* const m_Slot;
+        };
+        static thread_local Owner owner;
+        return owner.m_Slot->m_Object;
+    }
+
+    static Slot* Acquire()
+    {
+        auto& head = GetHead();
+        for (Slot* slot = head.load(); slot; slot = slot->m_Next)
+        {
+            bool used = false;
+            if (slot->m_Used.compare_exchange_strong(used, true))
+                return slot;
+        }
+
+        Slot* slot = new Slot;
+        slot->m_Next = head.load();
+        while (!head.compare_exchange_weak(slot->m_Next, slot))
+            ;
+        return slot;
+    }
+};
+
+} // namespace detail
+} // namespace logging
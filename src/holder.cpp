@@ -1,26 +1,62 @@
 #include "log/holder.h"
 
-#include <boost/thread/tss.hpp>
+#include <memory>
 
 namespace logging
 {
 
-boost::thread_specific_ptr<ILog> g_Value;
-std::unique_ptr<ILog> g_Default;
+namespace detail
+{
+    thread_local ILog* t_CurrentLog = nullptr;
+    std::atomic<ILog*> g_DefaultLog{ nullptr };
+} // namespace detail
 
-ILog* CurrentLog::Get()
+namespace
 {
-    return g_Value.get() ? g_Value.get() : g_Default.get();
-}
+
+//! Logger owned by the thread, deleted on thread exit
+struct Owned
+{
+    ~Owned()
+    {
+        if (detail::t_CurrentLog == log.get())
+            detail::t_CurrentLog = nullptr;
+    }
+
+    std::unique_ptr<ILog> log;
+};
+
+thread_local Owned t_Owned;
+thread_local const ScopedLog* t_Scope = nullptr;
+std::unique_ptr<ILog> g_Default;
+
+} // anonymous namespace
 
 void CurrentLog::Set(ILog* log)
 {
-    g_Value.reset(log);
+    t_Owned.log.reset(log);
+    if (!t_Scope)
+        detail::t_CurrentLog = log;
 }
 
 void CurrentLog::SetDefault(ILog* log)
 {
+    detail::g_DefaultLog.store(log);
     g_Default.reset(log);
 }
 
-} // namespace logging
\ No newline at end of file
+ScopedLog::ScopedLog(ILog* log)
+    : m_Log(log)
+    , m_Outer(t_Scope)
+{
+    t_Scope = this;
+    detail::t_CurrentLog = log;
+}
+
+ScopedLog::~ScopedLog()
+{
+    t_Scope = m_Outer;
+    detail::t_CurrentLog = m_Outer ? m_Outer->m_Log : t_Owned.log.get();
+}
+
+} // namespace logging
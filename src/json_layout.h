@@ -0,0 +1,260 @@
+#pragma once
+
+#include "log/arguments.h"
+#include "layout.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <string>
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <immintrin.h>
+#define LOG_JSON_SIMD
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include <boost/utility/string_ref.hpp>
+
+namespace logging
+{
+namespace detail
+{
+
+#ifdef LOG_JSON_SIMD
+//! Index of the lowest set bit, mask is not zero
+inline unsigned LowestBit(unsigned mask)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return static_cast<unsigned>(index);
+#else
+    return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+}
+#endif
+
+//! Append the escape sequence of a character JSON strings can't hold as is
+inline void AppendEscape(std::string& out, char c)
+{
+    static const char hex[] = "0123456789abcdef";
+    switch (c)
+    {
+    case '"':   out += "\\\""; break;
+    case '\\':  out += "\\\\"; break;
+    case '\n':  out += "\\n"; break;
+    case '\r':  out += "\\r"; break;
+    case '\t':  out += "\\t"; break;
+    case '\b':  out += "\\b"; break;
+    case '\f':  out += "\\f"; break;
+    default:
+        out += "\\u00";
+        out += hex[(static_cast<unsigned char>(c) >> 4) & 0xf];
+        out += hex[static_cast<unsigned char>(c) & 0xf];
+        break;
+    }
+}
+
+inline bool NeedsEscape(char c)
+{
+    return static_cast<unsigned char>(c) < 0x20 || c == '"' || c == '\\';
+}
+
+//! Append text escaped for a JSON string, bytes above 0x7f pass through unchecked
+//!
+//! Log text rarely needs escaping, so runs of plain characters are found 32 (AVX2) or 16 (SSE2)
+//! bytes at a time and copied with one append; the tail and non-x86 builds go byte by byte.
+//!
+inline void AppendEscaped(std::string& out, boost::string_ref text)
+{
+    const char* it = text.data();
+    const char* const end = it + text.size();
+    const char* plain = it;
+
+    const auto escape = [&](const char* at) {
+        out.append(plain, static_cast<std::size_t>(at - plain));
+        AppendEscape(out, *at);
+        plain = at + 1;
+    };
+
+#ifdef __AVX2__
+    {
+        const __m256i quote = _mm256_set1_epi8('"');
+        const __m256i backslash = _mm256_set1_epi8('\\');
+        const __m256i control = _mm256_set1_epi8(0x1f);
+        while (end - it >= 32)
+        {
+            const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(it));
+            const __m256i special = _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi8(chunk, quote), _mm256_cmpeq_epi8(chunk, backslash)),
+                _mm256_cmpeq_epi8(_mm256_min_epu8(chunk, control), chunk));
+            auto mask = static_cast<unsigned>(_mm256_movemask_epi8(special));
+            for (; mask; mask &= mask - 1)
+                escape(it + LowestBit(mask));
+            it += 32;
+        }
+    }
+#endif
+#ifdef LOG_JSON_SIMD
+    {
+        const __m128i quote = _mm_set1_epi8('"');
+        const __m128i backslash = _mm_set1_epi8('\\');
+        const __m128i control = _mm_set1_epi8(0x1f);
+        while (end - it >= 16)
+        {
+            const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(it));
+            const __m128i special = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+                _mm_cmpeq_epi8(_mm_min_epu8(chunk, control), chunk));
+            auto mask = static_cast<unsigned>(_mm_movemask_epi8(special));
+            for (; mask; mask &= mask - 1)
+                escape(it + LowestBit(mask));
+            it += 16;
+        }
+    }
+#endif
+    for (; it != end; ++it)
+    {
+        if (NeedsEscape(*it))
+            escape(it);
+    }
+    out.append(plain, static_cast<std::size_t>(end - plain));
+}
+
+inline void AppendString(std::string& out, boost::string_ref text)
+{
+    out += '"';
+    AppendEscaped(out, text);
+    out += '"';
+}
+
+//! UTC time as 2024-01-31T12:34:56.123456Z, the seconds part is cached per thread
+inline void AppendIsoTime(std::string& out, std::uint64_t time)
+{
+    static thread_local std::uint64_t cached = ~std::uint64_t();
+    static thread_local char prefix[32];
+    static thread_local std::size_t length;
+
+    const auto seconds = time / 1000000000;
+    if (seconds != cached)
+    {
+        const auto value = static_cast<std::time_t>(seconds);
+        std::tm utc{};
+#ifdef _WIN32
+        gmtime_s(&utc, &value);
+#else
+        gmtime_r(&value, &utc);
+#endif
+        length = std::strftime(prefix, sizeof(prefix), "%Y-%m-%dT%H:%M:%S.", &utc);
+        cached = seconds;
+    }
+    out.append(prefix, length);
+
+    auto micro = static_cast<unsigned>(time / 1000 % 1000000);
+    char digits[7];
+    for (int i = 5; i >= 0; --i, micro /= 10)
+        digits[i] = static_cast<char>('0' + micro % 10);
+    digits[6] = 'Z';
+    out.append(digits, sizeof(digits));
+}
+
+//! Field values in their JSON form
+struct JsonValue
+{
+    std::string& out;
+
+    void operator () (bool value) const                 { out += value ? "true" : "false"; }
+    void operator () (char value) const                 { AppendString(out, boost::string_ref(&value, 1)); }
+    void operator () (boost::string_ref value) const    { AppendString(out, value); }
+
+    void operator () (std::uint64_t value) const
+    {
+        char digits[20];
+        char* it = digits + sizeof(digits);
+        do
+        {
+            *--it = static_cast<char>('0' + value % 10);
+            value /= 10;
+        }
+        while (value);
+        out.append(it, static_cast<std::size_t>(digits + sizeof(digits) - it));
+    }
+
+    void operator () (std::int64_t value) const
+    {
+        if (value < 0)
+            out += '-';
+        (*this)(value < 0 ? ~static_cast<std::uint64_t>(value) + 1 : static_cast<std::uint64_t>(value));
+    }
+
+    void operator () (double value) const
+    {
+        // JSON has no infinities or NaN
+        if (!std::isfinite(value))
+        {
+            out += "null";
+            return;
+        }
+        // the shortest of the two that reads back exactly
+        char buffer[32];
+        auto size = std::snprintf(buffer, sizeof(buffer), "%.15g", value);
+        if (std::strtod(buffer, nullptr) != value)
+            size = std::snprintf(buffer, sizeof(buffer), "%.17g", value);
+        out.append(buffer, static_cast<std::size_t>(size));
+    }
+
+    void operator () (const void* value) const
+    {
+        char buffer[32];
+        const auto size = std::snprintf(buffer, sizeof(buffer), "\"%p\"", value);
+        out.append(buffer, static_cast<std::size_t>(size));
+    }
+};
+
+//! Append record as a JSON object on one line:
+//! {"time":..,"level":..,"module":..,"thread":..,"function":..,"message":..,"context":..,fields}
+//! the context only if there is one, fields only for structured arguments
+inline void RenderJson(std::string& out, const char* module, ILog::Level::Value level, boost::string_ref text, const Arguments* fields, const char* function, std::uint64_t time, const std::string& thread, boost::string_ref context)
+{
+    out += "{\"time\":\"";
+    AppendIsoTime(out, time);
+    out += "\",\"level\":\"";
+    out += ILog::Level::to_string(level);
+    out += "\",\"module\":";
+    AppendString(out, module ? module : "");
+    out += ",\"thread\":";
+    AppendString(out, thread);
+    out += ",\"function\":";
+    AppendString(out, function ? function : "");
+    out += ",\"message\":";
+    AppendString(out, fields ? boost::string_ref(fields->GetFormat()) : text);
+    if (!context.empty())
+    {
+        out += ",\"context\":";
+        AppendString(out, context);
+    }
+    if (fields)
+    {
+        fields->VisitFields([&out](boost::string_ref key, const auto& value) {
+            out += ',';
+            AppendString(out, key);
+            out += ':';
+            JsonValue{ out }(value);
+        });
+    }
+    out += "}\n";
+}
+
+inline void RenderJson(std::string& out, const char* module, ILog::Level::Value level, boost::string_ref text, const Arguments* fields, const char* function, std::uint64_t time, const boost::thread::id& thread, boost::string_ref context)
+{
+    RenderJson(out, module, level, text, fields, function, time, ThreadIdText(thread), context);
+}
+
+} // namespace detail
+} // namespace logging
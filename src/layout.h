@@ -0,0 +1,116 @@
+#pragma once
+
+#include "log/logger.h"
+
+#include <cstdint>
+#include <ctime>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+
+#include <boost/thread/thread.hpp>
+#include <boost/utility/string_ref.hpp>
+
+namespace logging
+{
+namespace detail
+{
+
+//! Level by its configuration name
+inline ILog::Level::Value GetLevel(const std::string& v)
+{
+    const static std::unordered_map<std::string, ILog::Level::Value> levels{
+        { "ERROR", ILog::Level::Error },
+        { "WARNING", ILog::Level::Warning },
+        { "INFO", ILog::Level::Info },
+        { "DEBUG", ILog::Level::Debug },
+        { "TRACE", ILog::Level::Trace }
+    };
+    return levels.at(v);
+}
+
+//! Thread id as text, the last rendered id is cached per thread
+inline const std::string& ThreadIdText(const boost::thread::id& thread)
+{
+    static thread_local boost::thread::id cached;
+    static thread_local std::string text;
+    if (text.empty() || cached != thread)
+    {
+        std::ostringstream stream;
+        stream << thread;
+        text = stream.str();
+        cached = thread;
+    }
+    return text;
+}
+
+//! Append local time as YYYY-Mon-DD HH:MM:SS.ffffff, the part up to the seconds is rendered once per second
+inline void AppendTime(std::string& out, std::uint64_t time)
+{
+    static thread_local std::uint64_t cached = ~std::uint64_t();
+    static thread_local char prefix[32];
+    static thread_local std::size_t length;
+
+    const auto seconds = time / 1000000000;
+    if (seconds != cached)
+    {
+        const auto value = static_cast<std::time_t>(seconds);
+        std::tm local{};
+#ifdef _WIN32
+        localtime_s(&local, &value);
+#else
+        localtime_r(&value, &local);
+#endif
+        length = std::strftime(prefix, sizeof(prefix), "%Y-%b-%d %H:%M:%S.", &local);
+        cached = seconds;
+    }
+    out.append(prefix, length);
+
+    auto micro = static_cast<unsigned>(time / 1000 % 1000000);
+    char digits[6];
+    for (int i = 5; i >= 0; --i, micro /= 10)
+        digits[i] = static_cast<char>('0' + micro % 10);
+    out.append(digits, sizeof(digits));
+}
+
+//! Append record in the text layout shared by the file sinks:
+//! [LEVEL][time][module] [thread] {context} text/* function */, the context part only if there is one
+inline void Render(std::string& out, const char* module, ILog::Level::Value level, boost::string_ref text, const char* function, std::uint64_t time, const std::string& thread, boost::string_ref context = boost::string_ref())
+{
+    out += '[';
+    out += ILog::Level::to_string(level);
+    out += "][";
+    AppendTime(out, time);
+    out += "][";
+    out += module;
+    out += "] [";
+    out += thread;
+    out += "] ";
+    if (!context.empty())
+    {
+        out += '{';
+        out.append(context.data(), context.size());
+        out += "} ";
+    }
+    out.append(text.data(), text.size());
+    out += "/* ";
+    out += function;
+    out += " */\n";
+}
+
+inline void Render(std::string& out, const char* module, ILog::Level::Value level, boost::string_ref text, const char* function, std::uint64_t time, const boost::thread::id& thread, boost::string_ref context = boost::string_ref())
+{
+    Render(out, module, level, text, function, time, ThreadIdText(thread), context);
+}
+
+//! Text of a record, deferred arguments are expanded into the buffer on the writing thread
+inline const std::string& GetText(const ILog::Record& record, std::string& buffer)
+{
+    if (!record.text.empty() || record.arguments.IsEmpty())
+        return record.text;
+    buffer = record.arguments.Format();
+    return buffer;
+}
+
+} // namespace detail
+} // namespace logging
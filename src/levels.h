@@ -0,0 +1,162 @@
+#pragma once
+
+#include "hazards.h"
+#include "layout.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/property_tree/ptree.hpp>
+
+namespace logging
+{
+namespace detail
+{
+
+//! Bumped by every sink that changes its levels, so a decorator caching the levels of its sinks sees it
+inline std::atomic<std::uint32_t>& LevelGeneration()
+{
+    static std::atomic<std::uint32_t> generation{ 1 };
+    return generation;
+}
+
+inline void OnLevelsChanged()
+{
+    LevelGeneration().fetch_add(1, std::memory_order_acq_rel);
+}
+
+//! Immutable per-module levels, replaced as a whole so readers never lock
+//!
+//! Configuration is the "logging" node, a child per module with its level name.
+//! "root" sets the level of modules without an entry; without it the first child does, as it always has.
+//!
+class LevelTable
+{
+public:
+    explicit LevelTable(ILog::Level::Value level)
+        : m_Default(level)
+        , m_Min(level)
+        , m_Max(level)
+    {
+    }
+
+    explicit LevelTable(const boost::property_tree::ptree& settings)
+    {
+        const auto& logging = settings.get_child("logging");
+        if (logging.empty())
+            throw boost::property_tree::ptree_bad_data("no levels", logging);
+
+        const auto root = logging.get_child_optional("root");
+        m_Default = GetLevel((root ? *root : logging.begin()->second).get_value<std::string>());
+        for (const auto& child : logging)
+        {
+            if (child.first != "root")
+                m_Modules.emplace_back(child.first, GetLevel(child.second.get_value<std::string>()));
+        }
+
+        std::sort(m_Modules.begin(), m_Modules.end());
+        m_Modules.erase(std::unique(m_Modules.begin(), m_Modules.end(), [](const Entry& lhs, const Entry& rhs) {
+            return lhs.first == rhs.first;
+        }), m_Modules.end());
+
+        m_Min = m_Max = m_Default;
+        for (const auto& entry : m_Modules)
+        {
+            m_Min = std::min(m_Min, entry.second);
+            m_Max = std::max(m_Max, entry.second);
+        }
+    }
+
+    bool IsEnabled(const char* module, ILog::Level::Value level) const
+    {
+        if (level <= m_Min)
+            return true;
+        if (level > m_Max)
+            return false;
+        return level <= Get(module);
+    }
+
+    ILog::Level::Value Get(const char* module) const
+    {
+        if (!module)
+            return m_Default;
+        const auto it = std::lower_bound(m_Modules.begin(), m_Modules.end(), module, [](const Entry& entry, const char* name) {
+            return std::strcmp(entry.first.c_str(), name) < 0;
+        });
+        return it != m_Modules.end() && it->first == module ? it->second : m_Default;
+    }
+
+private:
+    typedef std::pair<std::string, ILog::Level::Value> Entry;
+
+    ILog::Level::Value m_Default;
+    ILog::Level::Value m_Min;   //!< least verbose level of all entries, everything at or below is enabled
+    ILog::Level::Value m_Max;   //!< most verbose level of all entries, everything above is disabled
+    std::vector<Entry> m_Modules;
+};
+
+//! Levels of a sink, a table replaced as a whole and read through a hazard pointer, so readers never lock
+//!
+//! A replaced table is freed on the change that finds no reader publishing it, so at most the tables
+//! read during a change are kept.
+//!
+class PublishedLevels
+{
+public:
+    explicit PublishedLevels(ILog::Level::Value level)
+        : m_Levels(nullptr)
+    {
+        Publish(std::unique_ptr<const LevelTable>(new LevelTable(level)));
+    }
+
+    PublishedLevels(const PublishedLevels&) = delete;
+    PublishedLevels& operator = (const PublishedLevels&) = delete;
+
+    bool IsEnabled(const char* module, ILog::Level::Value level) const
+    {
+        const Hazards::Guard levels(m_Levels);
+        return levels.Get<LevelTable>()->IsEnabled(module, level);
+    }
+
+    void Set(ILog::Level::Value level)
+    {
+        Publish(std::unique_ptr<const LevelTable>(new LevelTable(level)));
+    }
+
+    void Set(const boost::property_tree::ptree& settings)
+    {
+        Publish(std::unique_ptr<const LevelTable>(new LevelTable(settings)));
+    }
+
+private:
+    void Publish(std::unique_ptr<const LevelTable> levels)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Levels.store(levels.get());
+        if (m_Current)
+            m_Retired.push_back(std::move(m_Current));
+        m_Current = std::move(levels);
+
+        // a reader of a replaced table has published it, the others are freed now and the rest on a later change
+        m_Retired.erase(std::remove_if(m_Retired.begin(), m_Retired.end(), [](const std::unique_ptr<const LevelTable>& table) {
+            return !Hazards::IsProtected(table.get());
+        }), m_Retired.end());
+        OnLevelsChanged();
+    }
+
+private:
+    std::atomic<const LevelTable*> m_Levels;
+    std::unique_ptr<const LevelTable> m_Current;
+    std::vector<std::unique_ptr<const LevelTable>> m_Retired;  //!< replaced levels still read by a thread
+    std::mutex m_Mutex;
+};
+
+} // namespace detail
+} // namespace logging
@@ -1,7 +1,11 @@
 #include "log4cplus.h"
+#include "log/metrics.h"
 
 #include "exception/CheckHelpers.h"
 
+#include "../levels.h"
+#include "../modules.h"
+
 #include <log4cplus/logger.h>
 #include <log4cplus/helpers/loglog.h>
 #include <log4cplus/configurator.h>
@@ -12,7 +16,13 @@
 #include <boost/filesystem/operations.hpp>
 #include <boost/range/algorithm.hpp>
 
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
 #include <unordered_map>
+#include <vector>
 
 
 namespace logging
@@ -41,6 +51,128 @@ log4cplus::LogLevel GetLevel(ILog::Level::Value v)
     }
 }
 
+//! Logger handles and level snapshots keyed by interned module name
+//!
+//! Callers pass names from detail::InternModule, one address per name for the life of the process, so a
+//! lookup compares addresses only and never locks; runtime module strings are safe because they are
+//! interned first. The log4cplus hierarchy is global, so is the cache.
+//!
+class LoggerCache
+{
+public:
+    struct Entry
+    {
+        explicit Entry(const char* module)
+            : m_Module(module)
+            , m_Logger(log4cplus::detail::macros_get_logger(module))
+            , m_Snapshot(0)
+        {
+        }
+
+        const char* const m_Module; //!< interned
+        const log4cplus::Logger m_Logger;
+        mutable std::atomic<std::uint64_t> m_Snapshot; //!< generation << 32 | chained log level
+    };
+
+    static LoggerCache& Instance()
+    {
+        static LoggerCache cache;
+        return cache;
+    }
+
+    //! Find or create entry of an interned module, nullptr if the table is full
+    const Entry* Get(const char* module)
+    {
+        const auto start = Hash(module);
+        for (std::size_t i = 0; i < Size; ++i)
+        {
+            const Entry* entry = m_Slots[(start + i) & (Size - 1)].load(std::memory_order_acquire);
+            if (!entry)
+                return Insert(module);
+            if (entry->m_Module == module)
+                return entry;
+        }
+        return nullptr;
+    }
+
+    //! Level threshold snapshot, a single relaxed load
+    static log4cplus::LogLevel GetThreshold(const Entry& entry)
+    {
+        return static_cast<log4cplus::LogLevel>(entry.m_Snapshot.load(std::memory_order_relaxed) & 0xffffffff);
+    }
+
+    //! Republish snapshot if it was taken before the last level change
+    void Validate(const Entry& entry)
+    {
+        const auto generation = m_Generation.load(std::memory_order_acquire);
+        if ((entry.m_Snapshot.load(std::memory_order_relaxed) >> 32) != generation)
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            Publish(entry, m_Generation.load(std::memory_order_relaxed));
+        }
+    }
+
+    //! Levels changed, start a new generation and recompute snapshots of all cached loggers
+    void Invalidate()
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        const auto generation = m_Generation.fetch_add(1, std::memory_order_acq_rel) + 1;
+        for (const auto& entry : m_Entries)
+            Publish(*entry, generation);
+        detail::OnLevelsChanged();
+    }
+
+private:
+    static const std::size_t Size = 1024;
+
+    LoggerCache() : m_Generation(0)
+    {
+        for (auto& slot : m_Slots)
+            slot.store(nullptr, std::memory_order_relaxed);
+    }
+
+    static std::size_t Hash(const char* module)
+    {
+        const auto address = static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(module));
+        return static_cast<std::size_t>((address * 0x9E3779B97F4A7C15ull) >> 54);
+    }
+
+    static void Publish(const Entry& entry, std::uint64_t generation)
+    {
+        const auto level = static_cast<std::uint32_t>(entry.m_Logger.getChainedLogLevel());
+        entry.m_Snapshot.store((generation << 32) | level, std::memory_order_relaxed);
+    }
+
+    const Entry* Insert(const char* module)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        const auto start = Hash(module);
+        for (std::size_t i = 0; i < Size; ++i)
+        {
+            auto& slot = m_Slots[(start + i) & (Size - 1)];
+            const Entry* entry = slot.load(std::memory_order_relaxed);
+            if (entry && entry->m_Module == module)
+                return entry;
+            if (entry)
+                continue;
+
+            m_Entries.emplace_back(new Entry(module));
+            Entry* created = m_Entries.back().get();
+            Publish(*created, m_Generation.load(std::memory_order_relaxed));
+            slot.store(created, std::memory_order_release);
+            return created;
+        }
+        return nullptr;
+    }
+
+private:
+    std::array<std::atomic<const Entry*>, Size> m_Slots;
+    std::vector<std::unique_ptr<Entry>> m_Entries;
+    std::atomic<std::uint64_t> m_Generation;
+    std::mutex m_Mutex;
+};
+
 log4cplus::LogLevel GetLevel(const std::string& v)
 {
     const static std::unordered_map<std::string, log4cplus::LogLevel> levels{
@@ -87,6 +219,7 @@ Log4cplus::Log4cplus(const std::string& src) : m_IsOpened()
 
         // reconfigure
         cfg.configure();
+        LoggerCache::Instance().Invalidate();
 
         m_IsOpened = true;
     }
@@ -114,6 +247,7 @@ Log4cplus::Log4cplus(Level::Value lvl, const char* file /*= nullptr*/) : m_IsOpe
             logger.addAppender(appender);
         logger.getRoot().setLogLevel(GetLevel(lvl));
     }
+    LoggerCache::Instance().Invalidate();
 
     m_IsOpened = true;
 }
@@ -123,6 +257,10 @@ bool Log4cplus::IsEnabled(const char* module, Level::Value level) const
     if (!m_IsOpened)
         return false;
 
+    if (const auto* entry = LoggerCache::Instance().Get(detail::InternModule(module)))
+        return GetLevel(level) >= LoggerCache::GetThreshold(*entry);
+
+    // more modules than cache slots, ask the hierarchy
     const auto logger = log4cplus::detail::macros_get_logger(module);
     return logger.isEnabledFor(GetLevel(level));
 }
@@ -149,10 +287,74 @@ boost::filesystem::path Log4cplus::GetLogFolder(const char* module) const
 
 void Log4cplus::Write(const char* module, ILog::Level::Value level, const std::string& text, const char* file, unsigned line, const char* function)
 {
+    const auto start = Metrics::IsEnabled() ? Clock::Now() : 0;
+    if (Print(module, level, text, file, line, function) && start)
+    {
+        Metrics::OnRecord(module, level, text.size());
+        Metrics::OnWrite(Metrics::GetElapsed(start));
+    }
+}
+
+bool Log4cplus::Print(const char* module, ILog::Level::Value level, const std::string& text, const char* file, unsigned line, const char* function)
+{
+    auto& cache = LoggerCache::Instance();
+    if (const auto* entry = cache.Get(detail::InternModule(module)))
+    {
+        cache.Validate(*entry);
+
+        const auto logLevel = GetLevel(level);
+        if (logLevel < LoggerCache::GetThreshold(*entry))
+            return false;
+        log4cplus::detail::macro_forced_log(entry->m_Logger, logLevel, text, file, line, function);
+        return true;
+    }
+
     const auto logger = log4cplus::detail::macros_get_logger(module);
     const auto logLevel = GetLevel(level);
-    if (logger.isEnabledFor(logLevel))
-        log4cplus::detail::macro_forced_log(logger, logLevel, text, file, line, function);
+    if (!logger.isEnabledFor(logLevel))
+        return false;
+    log4cplus::detail::macro_forced_log(logger, logLevel, text, file, line, function);
+    return true;
+}
+
+void Log4cplus::WriteBatch(const Record* records, std::size_t count)
+{
+    // a run of records from one module shares the cache lookup and the snapshot check
+    const auto start = Metrics::IsEnabled() ? Clock::Now() : 0;
+    auto& cache = LoggerCache::Instance();
+    const LoggerCache::Entry* entry = nullptr;
+    const char* module = nullptr;
+    std::string expanded;
+    for (const Record* record = records; record != records + count; ++record)
+    {
+        // the records outlive the call, so one pointer is one name here
+        if (!entry || module != record->module)
+        {
+            module = record->module;
+            entry = cache.Get(detail::InternModule(record->module));
+            if (!entry)
+            {
+                const auto& text = detail::GetText(*record, expanded);
+                if (Print(record->module, record->level, text, record->file, record->line, record->function) && start)
+                    Metrics::OnRecord(record->module, record->level, text.size());
+                continue;
+            }
+            cache.Validate(*entry);
+        }
+
+        // deferred arguments are expanded only for records that are written
+        const auto logLevel = GetLevel(record->level);
+        if (logLevel >= LoggerCache::GetThreshold(*entry))
+        {
+            const auto& text = detail::GetText(*record, expanded);
+            log4cplus::detail::macro_forced_log(entry->m_Logger, logLevel, text, record->file, record->line, record->function);
+            if (start)
+                Metrics::OnRecord(record->module, record->level, text.size());
+        }
+    }
+
+    if (start && count)
+        Metrics::OnWrite(Metrics::GetElapsed(start));
 }
 
 void Log4cplus::SetLevel(Level::Value level)
@@ -160,6 +362,8 @@ void Log4cplus::SetLevel(Level::Value level)
     log4cplus::LoggerList loggers = log4cplus::Logger::getCurrentLoggers();
     for (auto& logger : loggers)
         logger.getRoot().setLogLevel(GetLevel(level));
+
+    LoggerCache::Instance().Invalidate();
 }
 
 void Log4cplus::SetLevels(const boost::property_tree::ptree& settings)
@@ -169,6 +373,8 @@ void Log4cplus::SetLevels(const boost::property_tree::ptree& settings)
             auto logger = log4cplus::detail::macros_get_logger(lv.first);
             logger.setLogLevel(GetLevel(lv.second.get_value<std::string>()));
         }
+
+    LoggerCache::Instance().Invalidate();
 }
 
 
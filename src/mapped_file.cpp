@@ -0,0 +1,334 @@
+#include "log/mapped_file.h"
+#include "log/clock.h"
+#include "log/router.h"
+#include "generations.h"
+#include "layout.h"
+#include "levels.h"
+
+#ifndef _WIN32
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/system/system_error.hpp>
+
+namespace logging
+{
+
+namespace
+{
+
+//! How long a writer waits for the background thread to provide the next segment
+const auto g_SwapTimeout = boost::chrono::seconds(1);
+
+} // anonymous namespace
+
+MappedFile::MappedFile(ILog::Level::Value level, const char* file)
+    : MappedFile(level, file, Settings())
+{
+}
+
+MappedFile::MappedFile(ILog::Level::Value level, const char* file, const Settings& settings)
+    : m_Settings(settings)
+    , m_FileName(file)
+    , m_NextFileName(m_FileName + ".next")
+    , m_Levels(new detail::PublishedLevels(level))
+    , m_Current(nullptr)
+    , m_Next(nullptr)
+    , m_Retiring(nullptr)
+    , m_Dropped(0)
+    , m_Stopped()
+{
+    const auto folder = boost::filesystem::path(m_FileName).branch_path();
+    if (!folder.empty() && !boost::filesystem::exists(folder))
+        boost::filesystem::create_directories(folder);
+
+    // previous run output becomes the newest backup
+    boost::system::error_code error;
+    boost::filesystem::remove(m_NextFileName, error);
+    if (boost::filesystem::exists(m_FileName))
+    {
+        Shift();
+        if (m_Settings.generations)
+            boost::filesystem::rename(m_FileName, detail::GetGeneration(m_FileName, 1));
+        Retain();
+    }
+
+    Prepare(m_Segments[0], m_FileName);
+    Prepare(m_Segments[1], m_NextFileName);
+    m_Current = &m_Segments[0];
+    m_Next = &m_Segments[1];
+
+    m_Thread = boost::thread(&MappedFile::Run, this);
+}
+
+MappedFile::~MappedFile()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(m_Mutex);
+        m_Stopped = true;
+        m_Condition.notify_all();
+    }
+    m_Thread.join();
+
+    Close(*m_Current.load());
+    if (m_Next)
+    {
+        Close(*m_Next);
+        boost::system::error_code error;
+        boost::filesystem::remove(m_NextFileName, error);
+    }
+}
+
+bool MappedFile::IsEnabled(const char* module, Level::Value level) const
+{
+    return m_Levels->IsEnabled(module, level);
+}
+
+boost::filesystem::path MappedFile::GetLogFolder(const char* /*module*/) const
+{
+    return boost::filesystem::path(m_FileName).branch_path();
+}
+
+void MappedFile::Write(const char* module, ILog::Level::Value level, const std::string& text, const char* /*file*/, unsigned /*line*/, const char* function)
+{
+    static thread_local std::string line;
+    line.clear();
+    detail::Render(line, module, level, text, function, Clock::Now(), boost::this_thread::get_id(), ScopedContext::GetText());
+    Append(line.data(), line.size());
+}
+
+void MappedFile::Write(const char* module, ILog::Level::Value level, const char* text, std::size_t size, const char* /*file*/, unsigned /*line*/, const char* function)
+{
+    static thread_local std::string line;
+    line.clear();
+    detail::Render(line, module, level, boost::string_ref(text, size), function, Clock::Now(), boost::this_thread::get_id(), ScopedContext::GetText());
+    Append(line.data(), line.size());
+}
+
+void MappedFile::Write(const Record& record)
+{
+    static thread_local std::string line;
+    std::string expanded;
+    line.clear();
+    detail::Render(line, record.module, record.level, detail::GetText(record, expanded), record.function, record.time, record.thread, record.context);
+    Append(line.data(), line.size());
+}
+
+void MappedFile::Write(const Record& /*record*/, RenderedLine& line)
+{
+    const auto& text = line.Get();
+    Append(text.data(), text.size());
+}
+
+void MappedFile::SetLevel(Level::Value level)
+{
+    m_Levels->Set(level);
+}
+
+void MappedFile::SetLevels(const boost::property_tree::ptree& settings)
+{
+    m_Levels->Set(settings);
+}
+
+void MappedFile::Flush()
+{
+    Segment* segment = m_Current.load();
+    segment->m_Writers.fetch_add(1);
+    if (segment == m_Current.load())
+    {
+        const auto size = std::min(segment->m_Offset.load(), segment->m_Capacity);
+        ::msync(segment->m_Data, size, MS_ASYNC);
+    }
+    segment->m_Writers.fetch_sub(1);
+}
+
+std::uint64_t MappedFile::GetDropped() const
+{
+    return m_Dropped.load(std::memory_order_relaxed);
+}
+
+void MappedFile::Append(const char* data, std::size_t size)
+{
+    size = std::min(size, m_Settings.segment);
+    for (;;)
+    {
+        // the writer count keeps the segment mapped, recheck after publishing it
+        Segment* segment = m_Current.load();
+        segment->m_Writers.fetch_add(1);
+        if (segment != m_Current.load())
+        {
+            segment->m_Writers.fetch_sub(1);
+            continue;
+        }
+
+        const auto offset = segment->m_Offset.fetch_add(size, std::memory_order_relaxed);
+        if (offset + size <= segment->m_Capacity)
+        {
+            std::memcpy(segment->m_Data + offset, data, size);
+            segment->m_Writers.fetch_sub(1, std::memory_order_release);
+            return;
+        }
+
+        // the first reservation that did not fit marks the end of the data
+        auto used = segment->m_Used.load();
+        while (offset < used && !segment->m_Used.compare_exchange_weak(used, offset))
+            ;
+        const auto generation = segment->m_Generation.load();
+        segment->m_Writers.fetch_sub(1, std::memory_order_release);
+
+        if (!Swap(segment, generation))
+        {
+            m_Dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+}
+
+bool MappedFile::Swap(Segment* full, unsigned generation)
+{
+    boost::unique_lock<boost::mutex> lock(m_Mutex);
+    const auto deadline = boost::chrono::steady_clock::now() + g_SwapTimeout;
+    for (;;)
+    {
+        // another writer may have rotated while this one was waiting
+        if (m_Current.load() != full || full->m_Generation.load() != generation)
+            return true;
+        if (m_Next)
+            break;
+        if (m_Stopped || m_Condition.wait_until(lock, deadline) == boost::cv_status::timeout)
+            return false;
+    }
+
+    m_Current.store(m_Next);
+    m_Next = nullptr;
+    m_Retiring = full;
+    m_Condition.notify_all();
+    return true;
+}
+
+void MappedFile::Prepare(Segment& segment, const std::string& path)
+{
+    const int file = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (file < 0)
+        throw boost::system::system_error(errno, boost::system::system_category(), "open " + path);
+
+#ifdef __linux__
+    const int result = ::posix_fallocate(file, 0, static_cast<off_t>(m_Settings.segment));
+#else
+    const int result = ::ftruncate(file, static_cast<off_t>(m_Settings.segment)) ? errno : 0;
+#endif
+    if (result)
+    {
+        ::close(file);
+        throw boost::system::system_error(result, boost::system::system_category(), "allocate " + path);
+    }
+
+    void* data = ::mmap(nullptr, m_Settings.segment, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+    if (data == MAP_FAILED)
+    {
+        const int code = errno;
+        ::close(file);
+        throw boost::system::system_error(code, boost::system::system_category(), "mmap " + path);
+    }
+
+    segment.m_Data = static_cast<char*>(data);
+    segment.m_Capacity = m_Settings.segment;
+    segment.m_File = file;
+    segment.m_Offset.store(0);
+    segment.m_Used.store(m_Settings.segment);
+    ++segment.m_Generation;
+}
+
+void MappedFile::Close(Segment& segment)
+{
+    // stale writers only touch the counter, wait for the ones still copying
+    while (segment.m_Writers.load())
+        boost::this_thread::yield();
+
+    const auto size = std::min(segment.m_Offset.load(), segment.m_Used.load());
+    ::munmap(segment.m_Data, segment.m_Capacity);
+    if (::ftruncate(segment.m_File, static_cast<off_t>(size)))
+    {
+        // keep the padded file, readers skip the trailing zeros
+    }
+    ::close(segment.m_File);
+
+    segment.m_Data = nullptr;
+    segment.m_Capacity = 0;
+    segment.m_File = -1;
+}
+
+void MappedFile::Shift()
+{
+    boost::system::error_code error;
+    if (!m_Settings.generations)
+        boost::filesystem::remove(m_FileName, error);
+    detail::ShiftGenerations(m_FileName, m_Settings.generations);
+}
+
+void MappedFile::Retain()
+{
+    detail::RetainGenerations(m_FileName, m_Settings.generations, m_Settings.limit);
+}
+
+void MappedFile::Run()
+{
+    boost::unique_lock<boost::mutex> lock(m_Mutex);
+    for (;;)
+    {
+        if (m_Retiring)
+        {
+            Segment* segment = m_Retiring;
+            m_Retiring = nullptr;
+            lock.unlock();
+
+            Close(*segment);
+
+            boost::system::error_code error;
+            Shift();
+            if (m_Settings.generations)
+                boost::filesystem::rename(m_FileName, detail::GetGeneration(m_FileName, 1), error);
+            boost::filesystem::rename(m_NextFileName, m_FileName, error);
+            Retain();
+
+            for (;;)
+            {
+                try
+                {
+                    Prepare(*segment, m_NextFileName);
+                    break;
+                }
+                catch (const std::exception&)
+                {
+                    // disk full or similar, writers drop records until it works again
+                    lock.lock();
+                    const bool stopped = m_Stopped || m_Condition.wait_for(lock, boost::chrono::seconds(1), [this]{ return m_Stopped; });
+                    lock.unlock();
+                    if (stopped)
+                        return;
+                }
+            }
+
+            lock.lock();
+            m_Next = segment;
+            m_Condition.notify_all();
+            continue;
+        }
+
+        if (m_Stopped)
+            break;
+        m_Condition.wait(lock);
+    }
+}
+
+} // namespace logging
+
+#endif // _WIN32
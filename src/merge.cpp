@@ -0,0 +1,146 @@
+#include "log/merge.h"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <queue>
+#include <stdexcept>
+
+namespace logging
+{
+
+namespace
+{
+
+bool ParseNumber(const char*& it, const char* end, unsigned digits, std::uint64_t& value)
+{
+    value = 0;
+    for (unsigned i = 0; i < digits; ++i, ++it)
+    {
+        if (it == end || *it < '0' || *it > '9')
+            return false;
+        value = value * 10 + static_cast<std::uint64_t>(*it - '0');
+    }
+    return true;
+}
+
+bool Expect(const char*& it, const char* end, char c)
+{
+    if (it == end || *it != c)
+        return false;
+    ++it;
+    return true;
+}
+
+//! Sortable key of the record time, "[LEVEL][YYYY-Mon-DD HH:MM:SS.ffffff]..."
+bool ParseTime(const std::string& line, std::uint64_t& key)
+{
+    static const char* const months[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+
+    if (line.empty() || line.front() != '[')
+        return false;
+    const auto start = line.find("][");
+    if (start == std::string::npos)
+        return false;
+
+    const char* it = line.data() + start + 2;
+    const char* const end = line.data() + line.size();
+
+    std::uint64_t year, month = 0, day, hours, minutes, seconds, micro;
+    if (!ParseNumber(it, end, 4, year) || !Expect(it, end, '-') || end - it < 3)
+        return false;
+    while (month < 12 && std::strncmp(it, months[month], 3))
+        ++month;
+    if (month == 12)
+        return false;
+    it += 3;
+
+    if (!Expect(it, end, '-') || !ParseNumber(it, end, 2, day) || !Expect(it, end, ' ') ||
+        !ParseNumber(it, end, 2, hours) || !Expect(it, end, ':') ||
+        !ParseNumber(it, end, 2, minutes) || !Expect(it, end, ':') ||
+        !ParseNumber(it, end, 2, seconds) || !Expect(it, end, '.') ||
+        !ParseNumber(it, end, 6, micro) || !Expect(it, end, ']'))
+        return false;
+
+    key = ((((((year * 12 + month) * 31 + day) * 24 + hours) * 60 + minutes) * 60 + seconds) * 1000000) + micro;
+    return true;
+}
+
+//! Input file with its current record and the line read ahead
+struct Input
+{
+    std::ifstream stream;
+    std::size_t index;
+    std::string record;
+    std::uint64_t key;
+    std::string next;
+    bool hasNext;
+
+    //! Load the next record, false when the input is exhausted
+    bool Advance()
+    {
+        if (!hasNext)
+            return false;
+
+        record.swap(next);
+        key = 0;
+        ParseTime(record, key);
+
+        std::uint64_t ignored;
+        hasNext = false;
+        while (std::getline(stream, next))
+        {
+            if (ParseTime(next, ignored))
+            {
+                hasNext = true;
+                break;
+            }
+            record += '\n';
+            record += next;
+        }
+        return true;
+    }
+};
+
+struct Later
+{
+    bool operator () (const Input* lhs, const Input* rhs) const
+    {
+        return lhs->key != rhs->key ? lhs->key > rhs->key : lhs->index > rhs->index;
+    }
+};
+
+} // anonymous namespace
+
+void Merge(const std::vector<std::string>& files, std::ostream& out)
+{
+    std::vector<std::unique_ptr<Input>> inputs;
+    std::priority_queue<Input*, std::vector<Input*>, Later> queue;
+
+    for (const auto& file : files)
+    {
+        std::unique_ptr<Input> input(new Input());
+        input->stream.open(file);
+        if (!input->stream)
+            throw std::runtime_error("unable to open " + file);
+
+        input->index = inputs.size();
+        input->hasNext = static_cast<bool>(std::getline(input->stream, input->next));
+        if (input->Advance())
+            queue.push(input.get());
+        inputs.push_back(std::move(input));
+    }
+
+    while (!queue.empty())
+    {
+        Input* const input = queue.top();
+        queue.pop();
+
+        out << input->record << '\n';
+        if (input->Advance())
+            queue.push(input);
+    }
+}
+
+} // namespace logging
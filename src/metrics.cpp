@@ -0,0 +1,348 @@
+#include "log/metrics.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace logging
+{
+
+namespace detail
+{
+
+std::atomic<bool> g_MetricsEnabled(false);
+
+} // namespace detail
+
+namespace
+{
+
+const std::size_t g_Levels = ILog::Level::Trace + 1;
+
+//! Modules tracked by name per thread, the rest share one entry
+const std::size_t g_Modules = 64;
+
+const char g_OtherModules[] = "(other)";
+
+typedef std::atomic<std::uint64_t> Counter;
+
+//! Single writer increment, a plain add instead of a locked one; readers may see it late, never torn
+inline void Add(Counter& counter, std::uint64_t value)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+std::size_t GetBucket(std::uint64_t value)
+{
+    std::size_t bucket = 0;
+    while (value && bucket < Metrics::Histogram::Buckets - 1)
+    {
+        value >>= 1;
+        ++bucket;
+    }
+    return bucket;
+}
+
+struct ThreadHistogram
+{
+    Counter buckets[Metrics::Histogram::Buckets] = {};
+    Counter sum{ 0 };
+
+    void Add(std::uint64_t value)
+    {
+        logging::Add(buckets[GetBucket(value)], 1);
+        logging::Add(sum, value);
+    }
+
+    void Read(Metrics::Histogram& histogram) const
+    {
+        for (std::size_t i = 0; i < Metrics::Histogram::Buckets; ++i)
+        {
+            const auto count = buckets[i].load(std::memory_order_relaxed);
+            histogram.buckets[i] += count;
+            histogram.count += count;
+        }
+        histogram.sum += sum.load(std::memory_order_relaxed);
+    }
+};
+
+struct ThreadModule
+{
+    std::atomic<const char*> key{ nullptr };    //!< module pointer of the first record, compared but never read
+    std::string name;                           //!< copied before the key is published, modules may be runtime strings
+    Counter messages[g_Levels] = {};
+    Counter bytes{ 0 };
+};
+
+//! Counters of one thread, written by it alone and summed by readers
+struct ThreadMetrics
+{
+    ThreadModule modules[g_Modules];    //!< open addressing by module pointer, confirmed by name
+    ThreadModule other;
+    ThreadHistogram write;
+    ThreadHistogram wait;
+    Counter rotations{ 0 };
+    Counter dropped{ 0 };
+    std::atomic<std::int64_t> queued{ 0 };
+
+    ThreadModule& GetModule(const char* module)
+    {
+        const auto start = std::hash<const void*>()(module) % g_Modules;
+        for (std::size_t i = 0; i < g_Modules; ++i)
+        {
+            ThreadModule& entry = modules[(start + i) % g_Modules];
+            const char* key = entry.key.load(std::memory_order_relaxed);
+
+            // a freed runtime module may leave its address to another one
+            if (key == module && entry.name == module)
+                return entry;
+            if (!key)
+            {
+                // published after the name and before the counters, readers never see one without the other
+                entry.name = module;
+                entry.key.store(module, std::memory_order_release);
+                return entry;
+            }
+        }
+        return other;
+    }
+
+    void Read(std::map<std::string, Metrics::Module>& modules, Metrics::Snapshot& snapshot) const
+    {
+        const auto read = [&modules](const char* name, const ThreadModule& entry) {
+            auto& module = modules[name];
+            for (std::size_t level = 0; level < g_Levels; ++level)
+                module.messages[level] += entry.messages[level].load(std::memory_order_relaxed);
+            module.bytes += entry.bytes.load(std::memory_order_relaxed);
+        };
+
+        for (const auto& entry : this->modules)
+        {
+            if (entry.key.load(std::memory_order_acquire))
+                read(entry.name.c_str(), entry);
+        }
+        read(g_OtherModules, other);
+
+        write.Read(snapshot.write);
+        wait.Read(snapshot.wait);
+        snapshot.rotations += rotations.load(std::memory_order_relaxed);
+        snapshot.dropped += dropped.load(std::memory_order_relaxed);
+        snapshot.queued += queued.load(std::memory_order_relaxed);
+    }
+};
+
+//! Counters of live threads and the sum of the exited ones
+class Registry
+{
+public:
+    static Registry& Instance()
+    {
+        // never destroyed, threads may exit after static destruction
+        static Registry* registry = new Registry();
+        return *registry;
+    }
+
+    void Add(ThreadMetrics* metrics)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Threads.push_back(metrics);
+    }
+
+    void Remove(ThreadMetrics* metrics)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        metrics->Read(m_RetiredModules, m_Retired);
+        m_Threads.erase(std::remove(m_Threads.begin(), m_Threads.end(), metrics), m_Threads.end());
+    }
+
+    Metrics::Snapshot Get()
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        Metrics::Snapshot snapshot = m_Retired;
+        auto modules = m_RetiredModules;
+        for (const auto* metrics : m_Threads)
+            metrics->Read(modules, snapshot);
+
+        for (auto& module : modules)
+        {
+            if (!module.second.GetMessages())
+                continue;
+            module.second.name = module.first;
+            for (std::size_t level = 0; level < g_Levels; ++level)
+                snapshot.total.messages[level] += module.second.messages[level];
+            snapshot.total.bytes += module.second.bytes;
+            snapshot.modules.push_back(module.second);
+        }
+
+        std::stable_sort(snapshot.modules.begin(), snapshot.modules.end(), [](const Metrics::Module& lhs, const Metrics::Module& rhs) {
+            return lhs.GetMessages() > rhs.GetMessages();
+        });
+        return snapshot;
+    }
+
+private:
+    std::mutex m_Mutex;
+    std::vector<ThreadMetrics*> m_Threads;
+    Metrics::Snapshot m_Retired;
+    std::map<std::string, Metrics::Module> m_RetiredModules;
+};
+
+//! Registers the counters of the thread on first use and folds them into the registry on exit
+struct Owned
+{
+    Owned()
+    {
+        Registry::Instance().Add(&m_Metrics);
+    }
+
+    ~Owned()
+    {
+        Registry::Instance().Remove(&m_Metrics);
+    }
+
+    ThreadMetrics m_Metrics;
+};
+
+ThreadMetrics& GetThreadMetrics()
+{
+    static thread_local Owned owned;
+    return owned.m_Metrics;
+}
+
+} // anonymous namespace
+
+std::uint64_t Metrics::Histogram::Percentile(double percent) const
+{
+    if (!count)
+        return 0;
+
+    const auto rank = static_cast<std::uint64_t>(percent / 100 * static_cast<double>(count - 1)) + 1;
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < Buckets; ++i)
+    {
+        seen += buckets[i];
+        if (seen >= rank)
+            return i ? std::uint64_t(1) << i : 0;
+    }
+    return std::uint64_t(1) << (Buckets - 1);
+}
+
+std::uint64_t Metrics::Module::GetMessages() const
+{
+    std::uint64_t result = 0;
+    for (const auto count : messages)
+        result += count;
+    return result;
+}
+
+std::string Metrics::Snapshot::Summary(std::size_t top) const
+{
+    char buffer[512];
+    std::snprintf(buffer, sizeof(buffer),
+        "records %llu (E %llu W %llu I %llu D %llu T %llu) bytes %llu write mean %.0fns p99 %lluns wait mean %.0fns p99 %lluns rotations %llu dropped %llu queued %lld",
+        static_cast<unsigned long long>(total.GetMessages()),
+        static_cast<unsigned long long>(total.messages[ILog::Level::Error]),
+        static_cast<unsigned long long>(total.messages[ILog::Level::Warning]),
+        static_cast<unsigned long long>(total.messages[ILog::Level::Info]),
+        static_cast<unsigned long long>(total.messages[ILog::Level::Debug]),
+        static_cast<unsigned long long>(total.messages[ILog::Level::Trace]),
+        static_cast<unsigned long long>(total.bytes),
+        write.Mean(), static_cast<unsigned long long>(write.Percentile(99)),
+        wait.Mean(), static_cast<unsigned long long>(wait.Percentile(99)),
+        static_cast<unsigned long long>(rotations),
+        static_cast<unsigned long long>(dropped),
+        static_cast<long long>(queued));
+
+    std::string result(buffer);
+    for (std::size_t i = 0; i < std::min(top, modules.size()); ++i)
+    {
+        result += i ? ", " : " top: ";
+        result += modules[i].name;
+        result += ' ';
+        result += std::to_string(modules[i].GetMessages());
+    }
+    return result;
+}
+
+void Metrics::Enable(bool enabled)
+{
+    detail::g_MetricsEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+Metrics::Snapshot Metrics::Get()
+{
+    return Registry::Instance().Get();
+}
+
+void Metrics::OnRecord(const char* module, ILog::Level::Value level, std::size_t bytes)
+{
+    auto& entry = GetThreadMetrics().GetModule(module ? module : "");
+    Add(entry.messages[std::min<std::size_t>(level, g_Levels - 1)], 1);
+    Add(entry.bytes, bytes);
+}
+
+void Metrics::OnWrite(std::uint64_t nanoseconds)
+{
+    GetThreadMetrics().write.Add(nanoseconds);
+}
+
+void Metrics::OnWait(std::uint64_t nanoseconds)
+{
+    GetThreadMetrics().wait.Add(nanoseconds);
+}
+
+void Metrics::OnRotate()
+{
+    Add(GetThreadMetrics().rotations, 1);
+}
+
+void Metrics::OnDrop()
+{
+    Add(GetThreadMetrics().dropped, 1);
+}
+
+void Metrics::OnQueue(std::int64_t records)
+{
+    auto& queued = GetThreadMetrics().queued;
+    queued.store(queued.load(std::memory_order_relaxed) + records, std::memory_order_relaxed);
+}
+
+MetricsReport::MetricsReport(ILog& log, unsigned interval)
+    : m_Log(log)
+    , m_Interval(interval)
+    , m_Stopped()
+{
+    m_Thread = boost::thread(&MetricsReport::Run, this);
+}
+
+MetricsReport::~MetricsReport()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(m_Mutex);
+        m_Stopped = true;
+        m_Stop.notify_all();
+    }
+    m_Thread.join();
+}
+
+void MetricsReport::Run()
+{
+    boost::unique_lock<boost::mutex> lock(m_Mutex);
+    while (!m_Stopped)
+    {
+        if (m_Stop.wait_for(lock, boost::chrono::milliseconds(m_Interval)) != boost::cv_status::timeout || m_Stopped)
+            continue;
+
+        lock.unlock();
+        if (m_Log.IsEnabled("logging", ILog::Level::Info))
+            m_Log.Write("logging", ILog::Level::Info, "metrics: " + Metrics::Get().Summary(), __FILE__, __LINE__, __FUNCTION__);
+        lock.lock();
+    }
+}
+
+} // namespace logging
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+
+namespace logging
+{
+namespace detail
+{
+
+//! Copy of a module name that stays valid for the life of the process, for records written after the caller returns
+//!
+//! Modules are a small set, every name is kept once. A per-thread cache by address saves the lookup for names
+//! seen before; a hit is confirmed by the text, so a freed and reused address never returns another name.
+//! An interned name passed again is its own key and is returned without a compare.
+//!
+inline const char* InternModule(const char* module)
+{
+    if (!module)
+        return module;
+
+    struct Entry
+    {
+        const char* key;
+        const char* name;
+    };
+    static thread_local Entry cache[64] = {};
+
+    Entry& entry = cache[(reinterpret_cast<std::uintptr_t>(module) >> 3) % 64];
+    if (entry.key == module && (entry.name == module || !std::strcmp(entry.name, module)))
+        return entry.name;
+
+    static std::mutex mutex;
+    static std::unordered_set<std::string>* const names = new std::unordered_set<std::string>();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    const char* name = names->insert(module).first->c_str();
+    Entry& own = cache[(reinterpret_cast<std::uintptr_t>(name) >> 3) % 64];
+    own.key = name;
+    own.name = name;
+    entry.key = module;
+    entry.name = name;
+    return name;
+}
+
+} // namespace detail
+} // namespace logging
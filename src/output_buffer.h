@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <streambuf>
+#include <vector>
+
+namespace logging
+{
+namespace detail
+{
+
+//! Write buffer in front of a stream buffer
+//!
+//! Collects output until it is full or synced and counts the bytes passed to the target,
+//! so sinks can check the file size without flushing.
+//!
+class OutputBuffer : public std::streambuf
+{
+public:
+    OutputBuffer(std::streambuf* target, std::size_t size, std::uint64_t written = 0)
+        : m_Target(target)
+        , m_Buffer(size ? size : 1)
+        , m_Written(written)
+    {
+        setp(m_Buffer.data(), m_Buffer.data() + m_Buffer.size());
+    }
+
+    ~OutputBuffer()
+    {
+        Drain();
+    }
+
+    //! Bytes written to the target plus pending ones
+    std::uint64_t GetWritten() const
+    {
+        return m_Written + GetPending();
+    }
+
+    //! Bytes waiting in the buffer
+    std::size_t GetPending() const
+    {
+        return static_cast<std::size_t>(pptr() - pbase());
+    }
+
+protected:
+    virtual int_type overflow(int_type c) override
+    {
+        if (!Drain())
+            return traits_type::eof();
+
+        if (!traits_type::eq_int_type(c, traits_type::eof()))
+        {
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    virtual std::streamsize xsputn(const char* data, std::streamsize size) override
+    {
+        const auto space = epptr() - pptr();
+        if (size <= space)
+        {
+            std::memcpy(pptr(), data, static_cast<std::size_t>(size));
+            pbump(static_cast<int>(size));
+            return size;
+        }
+
+        if (!Drain())
+            return 0;
+
+        // larger than the buffer, don't copy twice
+        if (size >= static_cast<std::streamsize>(m_Buffer.size()))
+        {
+            const auto written = m_Target->sputn(data, size);
+            m_Written += static_cast<std::uint64_t>(written);
+            return written;
+        }
+
+        std::memcpy(pptr(), data, static_cast<std::size_t>(size));
+        pbump(static_cast<int>(size));
+        return size;
+    }
+
+    virtual int sync() override
+    {
+        return Drain() && m_Target->pubsync() == 0 ? 0 : -1;
+    }
+
+private:
+    bool Drain()
+    {
+        const auto size = pptr() - pbase();
+        if (!size)
+            return true;
+
+        const auto written = m_Target->sputn(pbase(), size);
+        m_Written += static_cast<std::uint64_t>(written);
+        setp(m_Buffer.data(), m_Buffer.data() + m_Buffer.size());
+        return written == size;
+    }
+
+private:
+    std::streambuf* const m_Target;
+    std::vector<char> m_Buffer;
+    std::uint64_t m_Written;
+};
+
+} // namespace detail
+} // namespace logging
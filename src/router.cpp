@@ -0,0 +1,289 @@
+#include "log/router.h"
+#include "log/format_buffer.h"
+#include "layout.h"
+#include "levels.h"
+#include "modules.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+
+namespace logging
+{
+
+namespace
+{
+
+bool HasModule(const std::vector<std::string>& modules, const char* module)
+{
+    if (modules.empty())
+        return true;
+    if (!module)
+        return false;
+    for (const auto& name : modules)
+    {
+        if (name == module)
+            return true;
+    }
+    return false;
+}
+
+} // anonymous namespace
+
+//! Targets passing each level, per interned module name
+//!
+//! Computed on the first check of a module by asking the sinks, and again once the level generation moved.
+//! Slots are found by address and never locked; more modules than slots ask the sinks on every check.
+//!
+class Router::Levels
+{
+public:
+    explicit Levels(const std::vector<Target>& targets)
+        : m_Targets(targets)
+    {
+        for (auto& slot : m_Slots)
+            slot.store(nullptr, std::memory_order_relaxed);
+    }
+
+    std::uint64_t Get(const char* module, ILog::Level::Value level)
+    {
+        const Entry* entry = Find(module);
+        if (!entry)
+            return Compute(module, level);
+        if (entry->m_Generation.load(std::memory_order_acquire) != detail::LevelGeneration().load(std::memory_order_acquire))
+            Update(*entry);
+        return entry->m_Targets[level].load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Entry
+    {
+        explicit Entry(const char* module)
+            : m_Module(module)
+            , m_Generation(0)
+        {
+            for (auto& targets : m_Targets)
+                targets.store(0, std::memory_order_relaxed);
+        }
+
+        const char* const m_Module; //!< interned
+        mutable std::atomic<std::uint32_t> m_Generation;    //!< level generation the targets were taken at, 0 for none
+        mutable std::array<std::atomic<std::uint64_t>, ILog::Level::Trace + 1> m_Targets;
+    };
+
+    static const std::size_t Size = 256;
+
+    static std::size_t Hash(const char* module)
+    {
+        const auto address = static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(module));
+        return static_cast<std::size_t>((address * 0x9E3779B97F4A7C15ull) >> 56);
+    }
+
+    std::uint64_t Compute(const char* module, ILog::Level::Value level) const
+    {
+        std::uint64_t result = 0;
+        for (std::size_t i = 0; i != m_Targets.size(); ++i)
+        {
+            const auto& target = m_Targets[i];
+            if (level <= target.route.level && HasModule(target.route.modules, module) && target.sink->IsEnabled(module, level))
+                result |= std::uint64_t(1) << i;
+        }
+        return result;
+    }
+
+    void Update(const Entry& entry)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        // a change while the sinks are asked leaves the older generation, the next check asks again
+        const auto generation = detail::LevelGeneration().load(std::memory_order_acquire);
+        if (entry.m_Generation.load(std::memory_order_relaxed) == generation)
+            return;
+        for (int level = 0; level != ILog::Level::Trace + 1; ++level)
+            entry.m_Targets[level].store(Compute(entry.m_Module, static_cast<ILog::Level::Value>(level)), std::memory_order_relaxed);
+        entry.m_Generation.store(generation, std::memory_order_release);
+    }
+
+    const Entry* Find(const char* module)
+    {
+        const auto start = Hash(module);
+        for (std::size_t i = 0; i < Size; ++i)
+        {
+            const Entry* entry = m_Slots[(start + i) & (Size - 1)].load(std::memory_order_acquire);
+            if (!entry)
+                return Insert(module);
+            if (entry->m_Module == module)
+                return entry;
+        }
+        return nullptr;
+    }
+
+    const Entry* Insert(const char* module)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        const auto start = Hash(module);
+        for (std::size_t i = 0; i < Size; ++i)
+        {
+            auto& slot = m_Slots[(start + i) & (Size - 1)];
+            const Entry* entry = slot.load(std::memory_order_relaxed);
+            if (entry && entry->m_Module == module)
+                return entry;
+            if (entry)
+                continue;
+
+            m_Entries.emplace_back(new Entry(module));
+            slot.store(m_Entries.back().get(), std::memory_order_release);
+            return m_Entries.back().get();
+        }
+        return nullptr;
+    }
+
+private:
+    const std::vector<Target>& m_Targets;
+    std::array<std::atomic<const Entry*>, Size> m_Slots;
+    std::vector<std::unique_ptr<Entry>> m_Entries;
+    std::mutex m_Mutex;
+};
+
+const std::string& RenderedLine::Get()
+{
+    if (!m_Rendered)
+    {
+        m_Line.clear();
+        detail::Render(m_Line, m_Record.module, m_Record.level, m_Record.text, m_Record.function, m_Record.time, m_Record.thread, m_Record.context);
+        m_Rendered = true;
+    }
+    return m_Line;
+}
+
+Router::Router()
+    : m_Threshold(-1)
+    , m_Levels(new Levels(m_Targets))
+{
+}
+
+Router::~Router()
+{
+}
+
+void Router::Add(std::unique_ptr<ILog> sink)
+{
+    Add(std::move(sink), Route{ ILog::Level::Trace, {} });
+}
+
+void Router::Add(std::unique_ptr<ILog> sink, const Route& route)
+{
+    if (m_Targets.size() == 64)
+        throw std::length_error("more than 64 router sinks");
+
+    m_Threshold = std::max<int>(m_Threshold, route.level);
+    m_Targets.push_back(Target{ std::move(sink), route });
+    detail::OnLevelsChanged();
+}
+
+bool Router::IsEnabled(const char* module, Level::Value level) const
+{
+    return level <= m_Threshold && GetTargets(module, level);
+}
+
+std::uint64_t Router::GetTargets(const char* module, Level::Value level) const
+{
+    return m_Levels->Get(detail::InternModule(module), level);
+}
+
+boost::filesystem::path Router::GetLogFolder(const char* module) const
+{
+    for (const auto& target : m_Targets)
+    {
+        if (HasModule(target.route.modules, module))
+            return target.sink->GetLogFolder(module);
+    }
+    return boost::filesystem::path();
+}
+
+void Router::Write(const char* module, ILog::Level::Value level, const std::string& text, const char* file, unsigned line, const char* function)
+{
+    Dispatch(Record{ module, level, text, file, line, function, Clock::Now(), boost::this_thread::get_id(), Arguments(), nullptr, ScopedContext::GetSnapshot() });
+}
+
+void Router::Write(const char* module, ILog::Level::Value level, const char* text, std::size_t size, const char* file, unsigned line, const char* function)
+{
+    Dispatch(Record{ module, level, std::string(text, size), file, line, function, Clock::Now(), boost::this_thread::get_id(), Arguments(), nullptr, ScopedContext::GetSnapshot() });
+}
+
+void Router::Write(const char* module, ILog::Level::Value level, const Arguments& arguments, const char* file, unsigned line, const char* function)
+{
+    Dispatch(Record{ module, level, arguments.Format(), file, line, function, Clock::Now(), boost::this_thread::get_id(), arguments.IsStructured() ? arguments : Arguments(), nullptr, ScopedContext::GetSnapshot() });
+}
+
+void Router::Write(const CallSite& site, const std::string& text)
+{
+    Dispatch(Record{ site.GetModule(), site.GetLevel(), text, site.GetFile(), site.GetLine(), site.GetFunction(), Clock::Now(), boost::this_thread::get_id(), Arguments(), &site, ScopedContext::GetSnapshot() });
+}
+
+void Router::Write(const CallSite& site, const char* text, std::size_t size)
+{
+    Dispatch(Record{ site.GetModule(), site.GetLevel(), std::string(text, size), site.GetFile(), site.GetLine(), site.GetFunction(), Clock::Now(), boost::this_thread::get_id(), Arguments(), &site, ScopedContext::GetSnapshot() });
+}
+
+void Router::Write(const CallSite& site, const Arguments& arguments)
+{
+    Dispatch(Record{ site.GetModule(), site.GetLevel(), arguments.Format(), site.GetFile(), site.GetLine(), site.GetFunction(), Clock::Now(), boost::this_thread::get_id(), arguments.IsStructured() ? arguments : Arguments(), &site, ScopedContext::GetSnapshot() });
+}
+
+void Router::Write(const Record& record)
+{
+    if (record.arguments.IsEmpty() || !record.text.empty())
+    {
+        Dispatch(record);
+        return;
+    }
+
+    // structured fields stay for the sinks that write them
+    Record expanded(record);
+    expanded.text = record.arguments.Format();
+    if (!record.arguments.IsStructured())
+        expanded.arguments = Arguments();
+    Dispatch(expanded);
+}
+
+void Router::Dispatch(const Record& record)
+{
+    auto targets = record.level <= m_Threshold ? GetTargets(record.module, record.level) : 0;
+    if (!targets)
+        return;
+
+    detail::ScopedBuffer buffer;
+    RenderedLine line(record, buffer.Get());
+    for (std::size_t i = 0; targets; ++i, targets >>= 1)
+    {
+        if (targets & 1)
+            m_Targets[i].sink->Write(record, line);
+    }
+}
+
+void Router::SetLevel(Level::Value level)
+{
+    for (const auto& target : m_Targets)
+        target.sink->SetLevel(level);
+    detail::OnLevelsChanged();
+}
+
+void Router::SetLevels(const boost::property_tree::ptree& settings)
+{
+    for (const auto& target : m_Targets)
+        target.sink->SetLevels(settings);
+    detail::OnLevelsChanged();
+}
+
+void Router::Flush()
+{
+    for (const auto& target : m_Targets)
+        target.sink->Flush();
+}
+
+} // namespace logging
@@ -0,0 +1,285 @@
+#include "log/sharded_log.h"
+#include "log/clock.h"
+#include "log/metrics.h"
+#include "log/router.h"
+#include "generations.h"
+#include "layout.h"
+#include "levels.h"
+#include "output_buffer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <mutex>
+#include <utility>
+
+#include <boost/filesystem.hpp>
+
+namespace logging
+{
+
+namespace
+{
+
+//! Sink instance ids, thread local shard caches are keyed by them so a reused address never matches
+std::atomic<unsigned> g_Instances{ 0 };
+
+} // anonymous namespace
+
+//! Output of a single thread, the lock is only contended by Flush and the flusher thread
+class Sharded::Shard
+{
+public:
+    Shard(const std::string& path, std::size_t size, const RotationPolicy& rotation)
+        : m_Path(path)
+        , m_Size(size)
+        , m_Rotation(rotation)
+        , m_Output(nullptr)
+    {
+        Open(std::ios::app);
+    }
+
+    ~Shard()
+    {
+        m_Output.flush();
+    }
+
+    const std::string& GetPath() const
+    {
+        return m_Path;
+    }
+
+    void Write(const std::string& line, bool flush)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Output.write(line.data(), static_cast<std::streamsize>(line.size()));
+        if (flush)
+            m_Output.flush();
+
+        if (m_Buffer->GetWritten() > m_Rotation.size)
+            Rotate();
+    }
+
+    void Flush()
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        if (m_Buffer->GetPending())
+            m_Output.flush();
+    }
+
+private:
+    void Open(std::ios::openmode mode)
+    {
+        m_File.rdbuf()->pubsetbuf(nullptr, 0);
+        m_File.open(m_Path, mode);
+
+        boost::system::error_code error;
+        const auto size = (mode & std::ios::app) ? boost::filesystem::file_size(m_Path, error) : 0;
+        m_Buffer.reset(new detail::OutputBuffer(m_File.rdbuf(), m_Size, error ? 0 : size));
+        m_Output.rdbuf(m_Buffer.get());
+    }
+
+    //! Same generations as Std, file.shardN.1 is the newest
+    void Rotate()
+    {
+        if (Metrics::IsEnabled())
+            Metrics::OnRotate();
+
+        m_Output.flush();
+        m_Output.rdbuf(nullptr);
+        m_Buffer.reset();
+        m_File.close();
+
+        boost::system::error_code error;
+        if (!m_Rotation.generations)
+            boost::filesystem::remove(m_Path, error);
+        detail::ShiftGenerations(m_Path, m_Rotation.generations);
+        boost::filesystem::rename(m_Path, detail::GetGeneration(m_Path, 1), error);
+        detail::RetainGenerations(m_Path, m_Rotation.generations, m_Rotation.limit);
+
+        Open(std::ios::out);
+    }
+
+private:
+    const std::string m_Path;
+    const std::size_t m_Size;
+    const RotationPolicy m_Rotation;
+    std::mutex m_Mutex;
+    std::ofstream m_File;
+    std::unique_ptr<detail::OutputBuffer> m_Buffer;
+    std::ostream m_Output;
+};
+
+//! Shards of a sink, outlives it while an exiting thread returns its shard
+struct Sharded::Pool
+{
+    boost::mutex m_Mutex;
+    std::vector<std::unique_ptr<Shard>> m_Shards;
+    std::vector<Shard*> m_Free;     //!< shards of exited threads, taken before new ones are opened
+};
+
+Sharded::Sharded(ILog::Level::Value level, const char* file, const FlushPolicy& policy, const RotationPolicy& rotation)
+    : m_Policy(policy)
+    , m_Rotation(rotation)
+    , m_FileName(file)
+    , m_Instance(++g_Instances)
+    , m_Levels(new detail::PublishedLevels(level))
+    , m_Pool(std::make_shared<Pool>())
+    , m_Stopped()
+{
+    const auto folder = boost::filesystem::path(m_FileName).branch_path();
+    if (!folder.empty() && !boost::filesystem::exists(folder))
+        boost::filesystem::create_directories(folder);
+
+    if (m_Policy.interval)
+        m_Flusher = boost::thread(&Sharded::RunFlusher, this);
+}
+
+Sharded::~Sharded()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(m_Mutex);
+        m_Stopped = true;
+        m_Stop.notify_all();
+    }
+    if (m_Flusher.joinable())
+        m_Flusher.join();
+
+    // a thread returning its shard right now keeps the pool alive, the files are complete anyway
+    Flush();
+}
+
+bool Sharded::IsEnabled(const char* module, Level::Value level) const
+{
+    return m_Levels->IsEnabled(module, level);
+}
+
+boost::filesystem::path Sharded::GetLogFolder(const char* /*module*/) const
+{
+    return boost::filesystem::path(m_FileName).branch_path();
+}
+
+void Sharded::Write(const char* module, ILog::Level::Value level, const std::string& text, const char* /*file*/, unsigned /*line*/, const char* function)
+{
+    Print(module, level, text, function, Clock::Now(), boost::this_thread::get_id(), ScopedContext::GetText());
+}
+
+void Sharded::Write(const char* module, ILog::Level::Value level, const char* text, std::size_t size, const char* /*file*/, unsigned /*line*/, const char* function)
+{
+    Print(module, level, boost::string_ref(text, size), function, Clock::Now(), boost::this_thread::get_id(), ScopedContext::GetText());
+}
+
+void Sharded::Write(const Record& record)
+{
+    std::string expanded;
+    Print(record.module, record.level, detail::GetText(record, expanded), record.function, record.time, record.thread, record.context);
+}
+
+void Sharded::Write(const Record& record, RenderedLine& line)
+{
+    GetShard().Write(line.Get(), record.level <= m_Policy.level);
+}
+
+void Sharded::Print(const char* module, ILog::Level::Value level, boost::string_ref text, const char* function, std::uint64_t time, const boost::thread::id& thread, boost::string_ref context)
+{
+    static thread_local std::string line;
+    line.clear();
+    detail::Render(line, module, level, text, function, time, thread, context);
+    GetShard().Write(line, level <= m_Policy.level);
+}
+
+Sharded::Shard& Sharded::GetShard()
+{
+    //! Shards held by this thread, given back to their sinks when it exits
+    struct Leases
+    {
+        struct Lease
+        {
+            unsigned instance;
+            std::weak_ptr<Pool> pool;
+            Shard* shard;
+        };
+
+        ~Leases()
+        {
+            for (const auto& lease : m_Leases)
+            {
+                if (const auto pool = lease.pool.lock())
+                {
+                    boost::unique_lock<boost::mutex> lock(pool->m_Mutex);
+                    pool->m_Free.push_back(lease.shard);
+                }
+            }
+        }
+
+        std::vector<Lease> m_Leases;
+    };
+    static thread_local Leases leases;
+
+    for (const auto& lease : leases.m_Leases)
+    {
+        if (lease.instance == m_Instance)
+            return *lease.shard;
+    }
+
+    // leases of destroyed sinks go away here
+    leases.m_Leases.erase(std::remove_if(leases.m_Leases.begin(), leases.m_Leases.end(), [](const Leases::Lease& lease) {
+        return lease.pool.expired();
+    }), leases.m_Leases.end());
+
+    Shard* shard;
+    {
+        boost::unique_lock<boost::mutex> lock(m_Pool->m_Mutex);
+        if (!m_Pool->m_Free.empty())
+        {
+            shard = m_Pool->m_Free.back();
+            m_Pool->m_Free.pop_back();
+        }
+        else
+        {
+            const auto path = m_FileName + ".shard" + std::to_string(m_Pool->m_Shards.size());
+            m_Pool->m_Shards.emplace_back(new Shard(path, m_Policy.size, m_Rotation));
+            shard = m_Pool->m_Shards.back().get();
+        }
+    }
+    leases.m_Leases.push_back(Leases::Lease{ m_Instance, m_Pool, shard });
+    return *shard;
+}
+
+void Sharded::RunFlusher()
+{
+    boost::unique_lock<boost::mutex> lock(m_Mutex);
+    while (!m_Stopped)
+    {
+        m_Stop.wait_for(lock, boost::chrono::milliseconds(m_Policy.interval));
+        Flush();
+    }
+}
+
+void Sharded::Flush()
+{
+    boost::unique_lock<boost::mutex> lock(m_Pool->m_Mutex);
+    for (const auto& shard : m_Pool->m_Shards)
+        shard->Flush();
+}
+
+std::vector<std::string> Sharded::GetShards() const
+{
+    boost::unique_lock<boost::mutex> lock(m_Pool->m_Mutex);
+    std::vector<std::string> result;
+    for (const auto& shard : m_Pool->m_Shards)
+        result.push_back(shard->GetPath());
+    return result;
+}
+
+void Sharded::SetLevel(Level::Value level)
+{
+    m_Levels->Set(level);
+}
+
+void Sharded::SetLevels(const boost::property_tree::ptree& settings)
+{
+    m_Levels->Set(settings);
+}
+
+} // namespace logging
@@ -1,53 +1,115 @@
 #include "log/std_log.h"
+#include "log/clock.h"
+#include "log/metrics.h"
+#include "log/router.h"
+#include "compression.h"
+#include "config_watcher.h"
+#include "generations.h"
+#include "json_layout.h"
+#include "layout.h"
+#include "levels.h"
+#include "output_buffer.h"
+#include "uring_buffer.h"
 
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 
 #include <boost/filesystem.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/make_shared.hpp>
+#include <boost/property_tree/info_parser.hpp>
+#include <boost/property_tree/ini_parser.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/xml_parser.hpp>
 #include <boost/thread.hpp>
 
-#include <unordered_map>
-
 namespace logging
 {
 
-ILog::Level::Value GetLevel(const std::string& v)
+namespace
+{
+
+//! Suffix of rotated files waiting for compression
+const char g_PendingSuffix[] = ".pending";
+
+boost::property_tree::ptree ReadSettings(const std::string& file)
 {
-    const static std::unordered_map<std::string, ILog::Level::Value> levels{
-        { "ERROR", ILog::Level::Error },
-        { "WARNING", ILog::Level::Warning },
-        { "INFO", ILog::Level::Info },
-        { "DEBUG", ILog::Level::Debug },
-        { "TRACE", ILog::Level::Trace }
-    };
-    return levels.at(v);
+    boost::property_tree::ptree settings;
+    const auto extension = boost::filesystem::path(file).extension().string();
+    if (extension == ".json")
+        boost::property_tree::read_json(file, settings);
+    else if (extension == ".xml")
+        boost::property_tree::read_xml(file, settings);
+    else if (extension == ".ini")
+        boost::property_tree::read_ini(file, settings);
+    else
+        boost::property_tree::read_info(file, settings);
+    return settings;
 }
 
-Std::Std(ILog::Level::Value level, const char* filename) 
-    : m_FileName(filename ? filename : "")
-    , m_BackupFileName(!m_FileName.empty() ? m_FileName + ".1" : "")
-    , m_Level(level)
+} // anonymous namespace
+
+Std::Std(ILog::Level::Value level, const char* filename, const FlushPolicy& policy, const RotationPolicy& rotation, Layout::Value layout)
+    : m_Policy(policy)
+    , m_Rotation(rotation)
+    , m_Layout(layout)
+    , m_FileName(filename ? filename : "")
+    , m_Path(!m_FileName.empty() && rotation.compression == RotationPolicy::Compression::Stream ? m_FileName + ".gz" : m_FileName)
+    , m_Rotate(!m_Path.empty() && (!boost::filesystem::exists(m_Path) || boost::filesystem::is_regular_file(m_Path)))
+    , m_Output(nullptr)
+    , m_Levels(new detail::PublishedLevels(level))
+    , m_Stopped()
 {
     if (!m_FileName.empty())
     {
-        const auto folder = boost::filesystem::path(m_FileName).branch_path();
+        const auto path = boost::filesystem::path(m_FileName);
+        const auto folder = path.branch_path();
         if (!folder.empty() && !boost::filesystem::exists(folder))
             boost::filesystem::create_directories(folder);
-        m_Stream = boost::make_shared<std::ofstream>(m_FileName, std::ios::app);
+
+        // files left by a previous run are compressed first
+        const auto prefix = path.filename().string() + g_PendingSuffix;
+        boost::system::error_code error;
+        if (m_Rotate && m_Rotation.compression == RotationPolicy::Compression::Backups)
+        {
+            for (boost::filesystem::directory_iterator it(folder.empty() ? "." : folder, error), end; !error && it != end; it.increment(error))
+            {
+                if (!it->path().filename().string().compare(0, prefix.size(), prefix))
+                    m_Pending.push_back(it->path().string());
+            }
+            std::sort(m_Pending.begin(), m_Pending.end());
+        }
     }
-    else
+    Open(std::ios::app);
+
+    Notice("Started. ");
+
+    if (m_Policy.interval)
+        m_Flusher = boost::thread(&Std::RunFlusher, this);
+    if (m_Rotate && m_Rotation.compression == RotationPolicy::Compression::Backups)
+        m_Compressor = boost::thread(&Std::RunCompressor, this);
+}
+
+Std::~Std()
+{
+    m_Watcher.reset();
     {
-        m_Stream = boost::shared_ptr<std::ostream>(&std::cout, [](const std::ostream*){});
+        boost::unique_lock<boost::mutex> lock(m_Mutex);
+        m_Stopped = true;
+        m_Stop.notify_all();
     }
+    if (m_Flusher.joinable())
+        m_Flusher.join();
+    if (m_Compressor.joinable())
+        m_Compressor.join();
 
-    *m_Stream << "[" << boost::posix_time::microsec_clock::local_time() << "]" << " Started. " << std::endl;
+    m_Output.flush();
 }
 
-bool Std::IsEnabled(const char* /*module*/, Level::Value level) const
+bool Std::IsEnabled(const char* module, Level::Value level) const
 {
-    return m_Level >= level;
+    return m_Levels->IsEnabled(module, level);
 }
 
 boost::filesystem::path Std::GetLogFolder(const char* /*module*/) const
@@ -58,48 +120,309 @@ boost::filesystem::path Std::GetLogFolder(const char* /*module*/) const
     return folder;
 }
 
-void Std::Write(const char* module, ILog::Level::Value level, const std::string& text, const char* file, unsigned line, const char* function)
+void Std::Write(const char* module, ILog::Level::Value level, const std::string& text, const char* /*file*/, unsigned /*line*/, const char* function)
+{
+    Print(module, level, text, nullptr, function, Clock::Now(), boost::this_thread::get_id(), ScopedContext::GetText());
+}
+
+void Std::Write(const char* module, ILog::Level::Value level, const char* text, std::size_t size, const char* /*file*/, unsigned /*line*/, const char* function)
+{
+    Print(module, level, boost::string_ref(text, size), nullptr, function, Clock::Now(), boost::this_thread::get_id(), ScopedContext::GetText());
+}
+
+void Std::Write(const char* module, ILog::Level::Value level, const Arguments& arguments, const char* /*file*/, unsigned /*line*/, const char* function)
 {
-    static boost::mutex mutex;
-    boost::unique_lock<boost::mutex> lock(mutex);
+    Print(module, level, boost::string_ref(), &arguments, function, Clock::Now(), boost::this_thread::get_id(), ScopedContext::GetText());
+}
 
-    *m_Stream
-        << "[" << ILog::Level::to_string(level) << "]"
-        << "[" << boost::posix_time::microsec_clock::local_time() << "]"
-        << "[" << module << "] "
-        << "[" << boost::this_thread::get_id() << "] "
-        << text
-        << "/* " 
-        << function
-        << " */"
-        << std::endl;
+void Std::Write(const Record& record)
+{
+    Print(record.module, record.level, record.text, record.arguments.IsEmpty() ? nullptr : &record.arguments, record.function, record.time, record.thread, record.context);
+}
 
-    if (!m_FileName.empty() && m_Stream->tellp() > m_FileMaxSize)
+void Std::Write(const Record& record, RenderedLine& line)
+{
+    // the shared line is in the text layout
+    if (m_Layout != Layout::Text)
     {
-        auto fstream = static_cast<std::ofstream*>(m_Stream.get());
-        fstream->close();
+        Write(record);
+        return;
+    }
+
+    const auto start = Metrics::IsEnabled() ? Clock::Now() : 0;
+    const auto& text = line.Get();
+    Output(text, record.level);
 
-        // Remove old backup.
-        if (boost::filesystem::exists(m_BackupFileName))
-            boost::filesystem::remove(m_BackupFileName);
-        
-        // Backup current log.
-        boost::filesystem::rename(m_FileName, m_BackupFileName);
-        
-        // Start new log.
-        m_Stream = boost::make_shared<std::ofstream>(m_FileName);
+    if (start)
+    {
+        Metrics::OnRecord(record.module, record.level, text.size());
+        Metrics::OnWrite(Metrics::GetElapsed(start));
     }
 }
 
+void Std::WriteBatch(const Record* records, std::size_t count)
+{
+    // render outside the lock, the batch goes out as a single write
+    static thread_local std::string lines;
+    lines.clear();
+
+    const auto start = Metrics::IsEnabled() ? Clock::Now() : 0;
+    auto level = ILog::Level::Trace;
+    for (const Record* record = records; record != records + count; ++record)
+    {
+        const auto size = lines.size();
+        Render(lines, record->module, record->level, record->text, record->arguments.IsEmpty() ? nullptr : &record->arguments, record->function, record->time, record->thread, record->context);
+        level = std::min(level, record->level);
+        if (start)
+            Metrics::OnRecord(record->module, record->level, lines.size() - size);
+    }
+
+    if (count)
+        Output(lines, level);
+    if (start)
+        Metrics::OnWrite(Metrics::GetElapsed(start));
+}
+
+void Std::Render(std::string& out, const char* module, ILog::Level::Value level, boost::string_ref text, const Arguments* arguments, const char* function, std::uint64_t time, const boost::thread::id& thread, boost::string_ref context) const
+{
+    // deferred arguments are expanded here, on the writing thread, unless they are fields written as JSON members
+    const Arguments* fields = arguments && arguments->IsStructured() && m_Layout == Layout::Json ? arguments : nullptr;
+    std::string expanded;
+    if (arguments && !fields && text.empty())
+    {
+        expanded = arguments->Format();
+        text = expanded;
+    }
+
+    if (m_Layout == Layout::Json)
+        detail::RenderJson(out, module, level, text, fields, function, time, thread, context);
+    else
+        detail::Render(out, module, level, text, function, time, thread, context);
+}
+
+void Std::Print(const char* module, ILog::Level::Value level, boost::string_ref text, const Arguments* arguments, const char* function, std::uint64_t time, const boost::thread::id& thread, boost::string_ref context)
+{
+    const auto start = Metrics::IsEnabled() ? Clock::Now() : 0;
+
+    static thread_local std::string line;
+    line.clear();
+    Render(line, module, level, text, arguments, function, time, thread, context);
+    Output(line, level);
+
+    if (start)
+    {
+        Metrics::OnRecord(module, level, line.size());
+        Metrics::OnWrite(Metrics::GetElapsed(start));
+    }
+}
+
+void Std::Output(const std::string& line, ILog::Level::Value level)
+{
+    // the clock is read only when the lock is contended
+    boost::unique_lock<boost::mutex> lock(m_Mutex, boost::try_to_lock);
+    if (!lock.owns_lock())
+    {
+        const auto start = Clock::Now();
+        lock.lock();
+        if (Metrics::IsEnabled())
+            Metrics::OnWait(Metrics::GetElapsed(start));
+    }
+    else if (Metrics::IsEnabled())
+    {
+        Metrics::OnWait(0);
+    }
+
+    m_Output.write(line.data(), static_cast<std::streamsize>(line.size()));
+
+    if (level <= m_Policy.level)
+        m_Output.flush();
+
+    if (m_Rotate && m_Buffer->GetWritten() > m_Rotation.size)
+        Rotate();
+}
+
+void Std::Open(std::ios::openmode mode)
+{
+    if (m_FileName.empty())
+    {
+        m_Stream = boost::shared_ptr<std::ostream>(&std::cout, [](const std::ostream*){});
+    }
+#ifdef __linux__
+    else if (m_Rotate && m_Policy.writer != FlushPolicy::Writer::Stream)
+    {
+        m_File.reset(new detail::UringBuffer(m_Path, mode, m_Policy.size, m_Policy.writer == FlushPolicy::Writer::Direct));
+    }
+#endif
+    else
+    {
+        const auto file = boost::make_shared<std::ofstream>();
+
+        // buffering is done by OutputBuffer, so every drain is a single write
+        file->rdbuf()->pubsetbuf(nullptr, 0);
+        file->open(m_Path, mode);
+        m_Stream = file;
+    }
+
+    // rotation counts text before compression, an appended gzip file is measured by its content
+    const bool compressed = !m_FileName.empty() && m_Rotation.compression == RotationPolicy::Compression::Stream;
+    boost::system::error_code error;
+    std::uint64_t size = 0;
+    if (!m_FileName.empty() && (mode & std::ios::app))
+        size = compressed ? detail::GetUncompressedSize(m_Path) : boost::filesystem::file_size(m_Path, error);
+
+    std::streambuf* target = m_File ? static_cast<std::streambuf*>(m_File.get()) : m_Stream->rdbuf();
+    if (compressed)
+    {
+        m_Gzip.reset(new detail::GzipBuffer(target));
+        target = m_Gzip.get();
+    }
+    m_Buffer.reset(new detail::OutputBuffer(target, m_Policy.size, error ? 0 : size));
+    m_Output.rdbuf(m_Buffer.get());
+}
+
+void Std::Rotate()
+{
+    if (Metrics::IsEnabled())
+        Metrics::OnRotate();
+
+    m_Output.flush();
+    m_Output.rdbuf(nullptr);
+    m_Buffer.reset();
+    m_Gzip.reset();
+    m_File.reset();
+    m_Stream.reset();
+
+    boost::system::error_code error;
+    if (m_Rotation.compression == RotationPolicy::Compression::Backups)
+    {
+        // the compressor thread owns the generations, it gets the file under a unique, time ordered name
+        const auto pending = m_FileName + g_PendingSuffix + std::to_string(Clock::Now());
+        boost::filesystem::rename(m_FileName, pending, error);
+        m_Pending.push_back(pending);
+        m_Stop.notify_all();
+    }
+    else
+    {
+        // a compressed stream keeps its suffix in the generations
+        const char* suffix = m_Rotation.compression == RotationPolicy::Compression::Stream ? ".gz" : "";
+        if (!m_Rotation.generations)
+            boost::filesystem::remove(m_Path, error);
+        detail::ShiftGenerations(m_FileName, m_Rotation.generations, suffix);
+        boost::filesystem::rename(m_Path, detail::GetGeneration(m_FileName, 1, suffix), error);
+        detail::RetainGenerations(m_FileName, m_Rotation.generations, m_Rotation.limit, suffix);
+    }
+
+    // Start new log.
+    Open(std::ios::out);
+}
+
+void Std::RunCompressor()
+{
+    boost::unique_lock<boost::mutex> lock(m_Mutex);
+    for (;;)
+    {
+        // pending files are finished before stopping
+        if (!m_Pending.empty())
+        {
+            const auto file = m_Pending.front();
+            lock.unlock();
+            Compress(file);
+            lock.lock();
+            m_Pending.pop_front();
+            continue;
+        }
+
+        if (m_Stopped)
+            break;
+        m_Stop.wait(lock);
+    }
+}
+
+void Std::Compress(const std::string& file)
+{
+    const auto target = detail::GetGeneration(m_FileName, 1, ".gz");
+    const auto temporary = target + ".tmp";
+
+    boost::system::error_code error;
+    if (!detail::CompressFile(file, temporary))
+    {
+        // keep the text, it is picked up again on the next start
+        boost::filesystem::remove(temporary, error);
+        return;
+    }
+
+    detail::ShiftGenerations(m_FileName, m_Rotation.generations, ".gz");
+    if (m_Rotation.generations)
+        boost::filesystem::rename(temporary, target, error);
+    else
+        boost::filesystem::remove(temporary, error);
+    boost::filesystem::remove(file, error);
+    detail::RetainGenerations(m_FileName, m_Rotation.generations, m_Rotation.limit, ".gz");
+}
+
+void Std::RunFlusher()
+{
+    boost::unique_lock<boost::mutex> lock(m_Mutex);
+    while (!m_Stopped)
+    {
+        m_Stop.wait_for(lock, boost::chrono::milliseconds(m_Policy.interval));
+        if (m_Buffer->GetPending())
+            m_Output.flush();
+    }
+}
+
+void Std::Flush()
+{
+    boost::unique_lock<boost::mutex> lock(m_Mutex);
+    m_Output.flush();
+}
+
 void Std::SetLevel(Level::Value level)
 {
-    m_Level = level;
+    m_Levels->Set(level);
 }
 
 void Std::SetLevels(const boost::property_tree::ptree& settings)
 {
-    const auto& lv = settings.get_child("logging").begin();
-    m_Level = GetLevel(lv->second.get_value<std::string>());
+    m_Levels->Set(settings);
+}
+
+void Std::Watch(const char* config)
+{
+    const std::string file(config);
+    m_Watcher.reset();
+    if (boost::filesystem::exists(file))
+        Reload(file);
+    m_Watcher.reset(new detail::ConfigWatcher(file, [this, file]() { Reload(file); }));
+}
+
+void Std::Reload(const std::string& config)
+{
+    try
+    {
+        SetLevels(ReadSettings(config));
+    }
+    catch (const std::exception& e)
+    {
+        // keep the current levels, a half written file gets another event when complete
+        boost::unique_lock<boost::mutex> lock(m_Mutex);
+        Notice("Failed to load levels from " + config + ": " + e.what());
+    }
+}
+
+void Std::Notice(const std::string& text)
+{
+    if (m_Layout == Layout::Json)
+    {
+        std::string line;
+        detail::RenderJson(line, "logging", ILog::Level::Info, text, nullptr, "", Clock::Now(), boost::this_thread::get_id(), boost::string_ref());
+        m_Output << line;
+    }
+    else
+    {
+        m_Output << "[" << boost::posix_time::microsec_clock::local_time() << "]" << " " << text << '\n';
+    }
+    m_Output.flush();
 }
 
 } // namespace logging
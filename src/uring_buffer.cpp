@@ -0,0 +1,388 @@
+#include "uring_buffer.h"
+
+#ifdef __linux__
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <boost/align/aligned_alloc.hpp>
+#include <boost/system/system_error.hpp>
+
+namespace logging
+{
+namespace detail
+{
+
+namespace
+{
+
+//! Buffers per file, writes in flight at most
+const std::size_t g_Buffers = 8;
+
+//! O_DIRECT alignment of offsets, sizes and memory
+const std::size_t g_Block = 4096;
+
+std::size_t RoundUp(std::size_t value, std::size_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+} // anonymous namespace
+
+//! Submission and completion queues mapped from the kernel, raw system calls keep liburing out of the dependencies
+struct UringBuffer::Ring
+{
+    Ring(unsigned entries, const std::vector<iovec>& buffers)
+        : m_Descriptor(-1)
+        , m_Fixed(false)
+    {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        m_Descriptor = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+        if (m_Descriptor < 0)
+            throw boost::system::system_error(errno, boost::system::system_category(), "io_uring_setup");
+
+        m_SqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        m_CqSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single)
+            m_SqSize = m_CqSize = std::max(m_SqSize, m_CqSize);
+        m_SqeSize = params.sq_entries * sizeof(io_uring_sqe);
+
+        m_Sq = Map(m_SqSize, IORING_OFF_SQ_RING);
+        m_Cq = single ? m_Sq : Map(m_CqSize, IORING_OFF_CQ_RING);
+        m_Sqes = static_cast<io_uring_sqe*>(Map(m_SqeSize, IORING_OFF_SQES));
+        if (!m_Sq || !m_Cq || !m_Sqes)
+        {
+            const int code = errno;
+            Release();
+            throw boost::system::system_error(code, boost::system::system_category(), "io_uring mmap");
+        }
+
+        char* sq = static_cast<char*>(m_Sq);
+        m_SqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        m_SqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        m_SqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+        char* cq = static_cast<char*>(m_Cq);
+        m_CqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        m_CqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        m_CqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        m_Cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        // pinned buffers save a page walk per write, plain writes still work when RLIMIT_MEMLOCK says no
+        m_Fixed = ::syscall(__NR_io_uring_register, m_Descriptor, IORING_REGISTER_BUFFERS, buffers.data(), static_cast<unsigned>(buffers.size())) == 0;
+    }
+
+    ~Ring()
+    {
+        Release();
+    }
+
+    void Release()
+    {
+        if (m_Sqes)
+            ::munmap(m_Sqes, m_SqeSize);
+        if (m_Cq && m_Cq != m_Sq)
+            ::munmap(m_Cq, m_CqSize);
+        if (m_Sq)
+            ::munmap(m_Sq, m_SqSize);
+        ::close(m_Descriptor);
+    }
+
+    //! Shared mapping of a ring region, nullptr on failure
+    void* Map(std::size_t size, off_t offset)
+    {
+        void* memory = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_Descriptor, offset);
+        return memory == MAP_FAILED ? nullptr : memory;
+    }
+
+    //! Queue a write, the ring has an entry per buffer so it never overflows; false if the kernel refused it
+    bool Write(int file, std::size_t index, const char* data, std::size_t size, std::uint64_t offset, bool ordered)
+    {
+        const unsigned tail = *m_SqTail;
+        const unsigned slot = tail & m_SqMask;
+
+        io_uring_sqe& sqe = m_Sqes[slot];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = m_Fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+        sqe.fd = file;
+        sqe.addr = reinterpret_cast<std::uint64_t>(data);
+        sqe.len = static_cast<unsigned>(size);
+        sqe.off = offset;
+        sqe.buf_index = static_cast<std::uint16_t>(index);
+        sqe.flags = ordered ? IOSQE_IO_DRAIN : 0;
+        sqe.user_data = index;
+
+        m_SqArray[slot] = slot;
+        __atomic_store_n(m_SqTail, tail + 1, __ATOMIC_RELEASE);
+        if (Enter(1, 0, 0) == 1)
+            return true;
+
+        // not consumed, take it back so it is not submitted twice
+        __atomic_store_n(m_SqTail, tail, __ATOMIC_RELEASE);
+        return false;
+    }
+
+    //! Calls back with buffer index and result for every completion, waits for one if asked
+    template <typename Callback>
+    void Reap(bool wait, const Callback& callback)
+    {
+        if (wait)
+            Enter(0, 1, IORING_ENTER_GETEVENTS);
+
+        unsigned head = *m_CqHead;
+        const unsigned tail = __atomic_load_n(m_CqTail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head)
+        {
+            const io_uring_cqe& cqe = m_Cqes[head & m_CqMask];
+            callback(static_cast<std::size_t>(cqe.user_data), cqe.res);
+        }
+        __atomic_store_n(m_CqHead, head, __ATOMIC_RELEASE);
+    }
+
+    int Enter(unsigned submit, unsigned complete, unsigned flags)
+    {
+        int result;
+        do
+        {
+            result = static_cast<int>(::syscall(__NR_io_uring_enter, m_Descriptor, submit, complete, flags, nullptr, 0));
+        }
+        while (result < 0 && (errno == EINTR || errno == EAGAIN || errno == EBUSY));
+        return result;
+    }
+
+    int m_Descriptor;
+    bool m_Fixed;
+
+    void* m_Sq = nullptr;
+    void* m_Cq = nullptr;
+    std::size_t m_SqSize = 0;
+    std::size_t m_CqSize = 0;
+    io_uring_sqe* m_Sqes = nullptr;
+    std::size_t m_SqeSize = 0;
+
+    unsigned* m_SqTail = nullptr;
+    unsigned m_SqMask = 0;
+    unsigned* m_SqArray = nullptr;
+    unsigned* m_CqHead = nullptr;
+    unsigned* m_CqTail = nullptr;
+    unsigned m_CqMask = 0;
+    io_uring_cqe* m_Cqes = nullptr;
+};
+
+UringBuffer::UringBuffer(const std::string& path, std::ios::openmode mode, std::size_t size, bool direct)
+    : m_File(-1)
+    , m_Direct(direct)
+    , m_Size(RoundUp(std::max<std::size_t>(size, 1), g_Block))
+    , m_Memory(nullptr)
+    , m_Pending(g_Buffers)
+    , m_Offset(0)
+    , m_Error(0)
+{
+    const int flags = O_CREAT | O_CLOEXEC | ((mode & std::ios::app) ? 0 : O_TRUNC);
+    if (m_Direct)
+    {
+        // read access for the partial block when appending
+        m_File = ::open(path.c_str(), flags | O_RDWR | O_DIRECT, 0644);
+        if (m_File < 0 && errno == EINVAL)
+            m_Direct = false;
+    }
+    if (m_File < 0)
+        m_File = ::open(path.c_str(), flags | O_WRONLY, 0644);
+    if (m_File < 0)
+        throw boost::system::system_error(errno, boost::system::system_category(), "open " + path);
+
+    struct stat status;
+    if (::fstat(m_File, &status) == 0)
+        m_Offset = static_cast<std::uint64_t>(status.st_size);
+
+    m_Memory = static_cast<char*>(boost::alignment::aligned_alloc(g_Block, m_Size * g_Buffers));
+    if (!m_Memory)
+    {
+        ::close(m_File);
+        throw std::bad_alloc();
+    }
+
+    std::vector<iovec> buffers;
+    for (std::size_t i = g_Buffers; i; --i)
+    {
+        m_Free.push_back(i - 1);
+        buffers.push_back(iovec{ GetBuffer(g_Buffers - i), m_Size });
+    }
+
+    if (m_Direct && m_Offset % g_Block)
+    {
+        // appending in the middle of a block, it is rewritten with the first write
+        const auto start = m_Offset / g_Block * g_Block;
+        char* block = GetBuffer(0);
+        const auto read = ::pread(m_File, block, g_Block, static_cast<off_t>(start));
+        m_Tail.assign(block, read > 0 ? static_cast<std::size_t>(read) : 0);
+        m_Tail.resize(static_cast<std::size_t>(m_Offset - start));
+        m_Offset = start;
+    }
+
+    try
+    {
+        m_Ring.reset(new Ring(static_cast<unsigned>(g_Buffers), buffers));
+    }
+    catch (const std::exception&)
+    {
+        // io_uring unavailable, writes are synchronous
+    }
+}
+
+UringBuffer::~UringBuffer()
+{
+    while (m_Free.size() != g_Buffers)
+        Reap(true);
+
+    // drop the padding of the last block
+    if (m_Direct && ::ftruncate(m_File, static_cast<off_t>(m_Offset + m_Tail.size())))
+    {
+        // the zeros stay, readers skip them
+    }
+
+    m_Ring.reset();
+    ::close(m_File);
+    boost::alignment::aligned_free(m_Memory);
+}
+
+bool UringBuffer::IsQueued() const
+{
+    return !!m_Ring;
+}
+
+UringBuffer::int_type UringBuffer::overflow(int_type c)
+{
+    if (traits_type::eq_int_type(c, traits_type::eof()))
+        return traits_type::not_eof(c);
+
+    const char value = traits_type::to_char_type(c);
+    return xsputn(&value, 1) == 1 ? c : traits_type::eof();
+}
+
+std::streamsize UringBuffer::xsputn(const char* data, std::streamsize size)
+{
+    auto left = static_cast<std::size_t>(size);
+    while (left)
+    {
+        const auto index = Acquire();
+        char* buffer = GetBuffer(index);
+
+        const auto tail = m_Tail.size();
+        const auto chunk = std::min(left, m_Size - tail);
+        std::memcpy(buffer, m_Tail.data(), tail);
+        std::memcpy(buffer + tail, data, chunk);
+        data += chunk;
+        left -= chunk;
+
+        const auto used = tail + chunk;
+        if (!m_Direct)
+        {
+            Submit(index, used, false);
+            m_Offset += used;
+            continue;
+        }
+
+        // the previous write covered the tail block, this one has to land after it
+        const auto padded = RoundUp(used, g_Block);
+        std::memset(buffer + used, 0, padded - used);
+        Submit(index, padded, tail != 0);
+
+        const auto whole = used / g_Block * g_Block;
+        m_Tail.assign(buffer + whole, used - whole);
+        m_Offset += whole;
+    }
+    return size;
+}
+
+int UringBuffer::sync()
+{
+    // everything is submitted already, report failures seen since the last call
+    Reap(false);
+    const int error = m_Error;
+    m_Error = 0;
+    return error ? -1 : 0;
+}
+
+std::size_t UringBuffer::Acquire()
+{
+    if (m_Ring)
+        Reap(false);
+    while (m_Free.empty())
+        Reap(true);
+
+    const auto index = m_Free.back();
+    m_Free.pop_back();
+    return index;
+}
+
+void UringBuffer::Submit(std::size_t index, std::size_t size, bool ordered)
+{
+    m_Pending[index] = Pending{ size, m_Offset };
+    if (!m_Ring || !m_Ring->Write(m_File, index, GetBuffer(index), size, m_Offset, ordered))
+    {
+        // synchronous write, the buffer is free right away
+        Complete(index, Write(GetBuffer(index), size, m_Offset) ? static_cast<int>(size) : -errno);
+    }
+}
+
+void UringBuffer::Reap(bool wait)
+{
+    if (m_Ring)
+        m_Ring->Reap(wait, [this](std::size_t index, int result) { Complete(index, result); });
+}
+
+void UringBuffer::Complete(std::size_t index, int result)
+{
+    const auto& pending = m_Pending[index];
+    if (result < 0)
+    {
+        if (!m_Error)
+            m_Error = -result;
+    }
+    else if (static_cast<std::size_t>(result) < pending.size)
+    {
+        // short write, rare enough to finish on this thread
+        const auto written = static_cast<std::size_t>(result);
+        if (!Write(GetBuffer(index) + written, pending.size - written, pending.offset + written) && !m_Error)
+            m_Error = errno;
+    }
+    m_Free.push_back(index);
+}
+
+bool UringBuffer::Write(const char* data, std::size_t size, std::uint64_t offset)
+{
+    while (size)
+    {
+        const auto written = ::pwrite(m_File, data, size, static_cast<off_t>(offset));
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return false;
+        data += written;
+        size -= static_cast<std::size_t>(written);
+        offset += static_cast<std::uint64_t>(written);
+    }
+    return true;
+}
+
+char* UringBuffer::GetBuffer(std::size_t index) const
+{
+    return m_Memory + index * m_Size;
+}
+
+} // namespace detail
+} // namespace logging
+
+#endif // __linux__
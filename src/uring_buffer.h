@@ -0,0 +1,80 @@
+#pragma once
+
+#ifdef __linux__
+
+#include <cstdint>
+#include <ios>
+#include <memory>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+namespace logging
+{
+namespace detail
+{
+
+//! File stream buffer submitting writes through io_uring
+//!
+//! Every write is copied into one of a few registered buffers and submitted at an explicit offset,
+//! the buffer is reused once its completion is reaped. The caller only waits when all buffers are
+//! in flight. Without io_uring (old kernel, seccomp) the buffers are written with pwrite instead.
+//!
+//! In direct mode the file is opened with O_DIRECT and whole blocks are written: the last partial
+//! block goes out padded with zeros and is rewritten, ordered after the first write, when more data
+//! arrives; the padding is truncated on close. Falls back to cached writes where O_DIRECT is unsupported.
+//!
+//! Writes may complete out of order, a reader can briefly see a hole before the end of the file.
+//! Placed behind OutputBuffer every write is a whole drained buffer, sync only reports errors.
+//!
+class UringBuffer : public std::streambuf
+{
+public:
+    UringBuffer(const std::string& path, std::ios::openmode mode, std::size_t size, bool direct);
+    ~UringBuffer();
+
+    UringBuffer(const UringBuffer&) = delete;
+    UringBuffer& operator = (const UringBuffer&) = delete;
+
+    //! Writes go through io_uring, false for the pwrite fallback
+    bool IsQueued() const;
+
+protected:
+    virtual int_type overflow(int_type c) override;
+    virtual std::streamsize xsputn(const char* data, std::streamsize size) override;
+    virtual int sync() override;
+
+private:
+    struct Ring;
+
+    //! Write in flight
+    struct Pending
+    {
+        std::size_t size;
+        std::uint64_t offset;
+    };
+
+    std::size_t Acquire();
+    void Submit(std::size_t index, std::size_t size, bool ordered);
+    void Reap(bool wait);
+    void Complete(std::size_t index, int result);
+    bool Write(const char* data, std::size_t size, std::uint64_t offset);
+    char* GetBuffer(std::size_t index) const;
+
+private:
+    int m_File;
+    bool m_Direct;
+    std::size_t m_Size;                 //!< bytes per buffer, a multiple of the block size
+    char* m_Memory;
+    std::vector<Pending> m_Pending;     //!< by buffer index
+    std::vector<std::size_t> m_Free;
+    std::uint64_t m_Offset;             //!< file offset of the next write
+    std::string m_Tail;                 //!< direct mode, the last partial block already written padded
+    int m_Error;                        //!< first failure since the last sync
+    std::unique_ptr<Ring> m_Ring;
+};
+
+} // namespace detail
+} // namespace logging
+
+#endif // __linux__
@@ -1,16 +1,120 @@
 #include "log/log.h"
+#include "log/async_log.h"
+#include "log/std_log.h"
+#include "log/mapped_file.h"
+#include "log/sharded_log.h"
+#include "log/merge.h"
+#include "log/binary_log.h"
+#include "log/flight_recorder.h"
+#include "log/router.h"
+#include "log/metrics.h"
+#include "log/dedup_log.h"
+#ifdef LOG_TESTS_LOG4CPLUS
+#include "log/log4cplus.h"
+#endif
 
+#include <algorithm>
 #include <vector>
+#include <list>
+#include <unordered_map>
+#include <future>
+#include <fstream>
+#include <iterator>
+#include <numeric>
+#include <regex>
+#include <functional>
+#include <thread>
+#include <sstream>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <atomic>
+
+#include <boost/filesystem/operations.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/thread/barrier.hpp>
+
+#include <zlib.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+namespace
+{
+    //! Heap allocations made by the current thread while counting is enabled
+    thread_local bool g_CountAllocations = false;
+    thread_local std::size_t g_Allocations = 0;
+} // anonymous namespace
+
+void* operator new(std::size_t size)
+{
+    if (g_CountAllocations)
+        ++g_Allocations;
+    if (void* pointer = std::malloc(size ? size : 1))
+        return pointer;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    if (g_CountAllocations)
+        ++g_Allocations;
+    return std::malloc(size ? size : 1);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept
+{
+    return operator new(size, tag);
+}
+
+void operator delete(void* pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, const std::nothrow_t&) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept
+{
+    std::free(pointer);
+}
+
 using ::testing::_;
 using ::testing::Return;
 using ::testing::Exactly;
 using ::testing::AtLeast;
 using ::testing::Invoke;
 using ::testing::Expectation;
+using ::testing::StrEq;
 
 class MockedLog : public ILog
 {
@@ -35,6 +139,32 @@ public:
 
 SET_LOGGING_MODULE("tests");
 
+namespace quiet
+{
+    // a module with a lower compile-time threshold, as LOG_MODULE_LEVELS would give it
+    static constexpr char CURRENT_MODULE_ID[] = "quiet";
+    static constexpr int CURRENT_MODULE_LEVEL = LOG_LEVEL_WARNING;
+
+    void Write()
+    {
+        LOG_INFO("stripped %1%", 1);
+        LOG_DEBUG("stripped");
+        LOG_WARNING("kept %1%", 2);
+        LOG_ERROR("kept");
+    }
+} // namespace quiet
+
+namespace plain
+{
+    // a module id declared without SET_LOGGING_MODULE, statements keep the global threshold
+    static const char CURRENT_MODULE_ID[] = "plain";
+
+    void Write()
+    {
+        LOG_DEBUG("kept %1%", 3);
+    }
+} // namespace plain
+
 
 TEST(Logging, TextFormatter)
 {
@@ -52,6 +182,73 @@ TEST(Logging, TextFormatter)
     }
 }
 
+TEST(Logging, StaticFormatter)
+{
+    EXPECT_EQ(CTXT("text"), "text");
+    EXPECT_EQ(CTXT("100%% done"), "100% done");
+    EXPECT_EQ(CTXT("%1% and %2%, %1%", 1, "two"), "1 and two, 1");
+    EXPECT_EQ(CTXT("%s-%d-%x-%05d-%-4s|", "s", -42, 255, 42, "ab"), "s--42-ff-00042-ab  |");
+    EXPECT_EQ(CTXT("%s %.2f %s", 2.5, 3.14159, true), "2.5 3.14 1");
+    EXPECT_EQ(CTXT("text: %s", std::vector<int>{1, 2, 3}), "text: 1,2,3");
+    EXPECT_EQ(CTXT("text: %s", std::map<std::string, int>{ {"1", 1}, {"2", 2} }), "text: 1:1,2:2");
+    EXPECT_EQ(CTXT("%1%", std::string("str")), TXT("%1%", std::string("str")));
+}
+
+TEST(Logging, ContainerFormatter)
+{
+    const std::vector<int> large(100000, 7);
+    const int array[] = { 1, 2, 3 };
+    const std::vector<std::vector<int>> nested = { { 1, 2 }, { 3 } };
+    const std::unordered_map<std::string, int> map = { { "key", 1 } };
+    const std::list<std::string> strings = { "a", "b" };
+
+    logging::SetRangeLimits(3, 4096);
+    EXPECT_EQ(logging::MessageFormatter("%1%", large).GetText(), "7,7,7,... (99997 more)");
+    EXPECT_EQ(CTXT("%1%", large), "7,7,7,... (99997 more)");
+    EXPECT_EQ(logging::MessageFormatter("%1% %2%", array, map).GetText(), "1,2,3 key:1");
+    EXPECT_EQ(CTXT("%1% %2%", array, map), "1,2,3 key:1");
+    EXPECT_EQ(logging::MessageFormatter("%1% %2%", nested, strings).GetText(), "[1,2],[3] a,b");
+    EXPECT_EQ(CTXT("%1%", nested), "[1,2],[3]");
+    EXPECT_EQ(logging::Capture("%s", large).Format(), "7,7,7,... (99997 more)");
+
+    logging::SetRangeLimits(1000, 8);
+    EXPECT_EQ(logging::MessageFormatter("%1%", large).GetText(), "7,7,7,7,... (99996 more)");
+
+    // one long element or an inner range can't exceed the budget of the outer range
+    const std::vector<std::string> long_strings = { "abcdefghijklmnop", "x" };
+    const std::vector<std::vector<int>> long_nested = { { 1, 2, 3, 4, 5, 6, 7, 8 }, { 9 } };
+    logging::SetRangeLimits(1000, 10);
+    EXPECT_EQ(logging::MessageFormatter("%1%", long_strings).GetText(), "abcdefghij... (1 more)");
+    EXPECT_EQ(CTXT("%1%", long_nested), "[1,2,3,4,5,... (3 more)],... (1 more)");
+
+    logging::SetRangeLimits(0, 4096);
+    EXPECT_EQ(logging::MessageFormatter("%1%", large).GetText(), "... (100000 more)");
+
+    logging::SetRangeLimits(64, 4096);
+}
+
+TEST(Logging, DeferredFormatter)
+{
+    {
+        const auto arguments = logging::Capture("text");
+        EXPECT_EQ(arguments.GetCount(), 0u);
+        EXPECT_EQ(arguments.Format(), "text");
+    }
+    {
+        const auto arguments = logging::Capture("%1% %2% %3% %4% %5%", 42, 2.5, 'c', std::string("str"), "literal");
+        EXPECT_EQ(arguments.GetCount(), 5u);
+        EXPECT_EQ(arguments.Format(), "42 2.5 c str literal");
+    }
+    {
+        const auto arguments = logging::Capture("text: %s", std::vector<int>{1, 2, 3});
+        EXPECT_EQ(arguments.Format(), "text: 1,2,3");
+    }
+    {
+        const auto arguments = logging::Capture("test%1%2");
+        EXPECT_EQ(arguments.Format(), "test%1%2");
+    }
+}
+
 TEST(Logging, Levels)
 {
     auto* log = new MockedLog();
@@ -128,6 +325,1598 @@ TEST(Logging, CorrectFormat)
     logging::CurrentLog::Set(nullptr);
 }
 
+TEST(Logging, CallSites)
+{
+    auto* log = new MockedLog();
+
+    EXPECT_CALL(*log, IsEnabled(CURRENT_MODULE_ID, _))
+        .WillRepeatedly(Return(true));
+    EXPECT_CALL(*log, Write(CURRENT_MODULE_ID, _, _, _, _, _))
+        .Times(Exactly(5));
+
+    logging::CurrentLog::Set(log);
+
+    std::vector<unsigned> ids;
+    for (int i = 0; i < 2; ++i)
+    {
+        LOG_INFO("site %1%", i);
+        LOG_LEVELED(i ? ILog::Level::Debug : ILog::Level::Error, "leveled");
+    }
+    LOG_INFO("other");
+
+    logging::CurrentLog::Set(nullptr);
+
+    const auto count = logging::CallSite::GetCount();
+    ASSERT_GE(count, 4u);
+
+    const auto* site = logging::CallSite::Find(static_cast<unsigned>(count));
+    ASSERT_TRUE(site);
+    EXPECT_STREQ(site->GetModule(), CURRENT_MODULE_ID);
+    EXPECT_STREQ(site->GetFormat(), "other");
+    EXPECT_EQ(site->GetLevel(), ILog::Level::Info);
+    EXPECT_EQ(site->GetFunction(), std::string(__FUNCTION__));
+
+    const auto* leveled = logging::CallSite::Find(static_cast<unsigned>(count - 1));
+    ASSERT_TRUE(leveled);
+    EXPECT_EQ(leveled->GetLevel(), ILog::Level::Debug);
+    EXPECT_EQ(logging::CallSite::Find(static_cast<unsigned>(count + 1)), nullptr);
+}
+
+TEST(Logging, RateLimitedSites)
+{
+    auto* log = new MockedLog();
+
+    EXPECT_CALL(*log, IsEnabled(CURRENT_MODULE_ID, _))
+        .WillRepeatedly(Return(true));
+
+    std::vector<std::string> texts;
+    EXPECT_CALL(*log, Write(CURRENT_MODULE_ID, _, _, _, _, _))
+        .WillRepeatedly(Invoke([&texts](const char*, ILog::Level::Value, const std::string& text, const char*, unsigned, const char*){
+            texts.push_back(text);
+        }));
+
+    logging::CurrentLog::Set(log);
+
+    for (int i = 0; i < 10; ++i)
+    {
+        LOG_EVERY_N(ILog::Level::Info, 4, "every %1%", i);
+        LOG_FIRST_N(ILog::Level::Warning, 2, "first %1%", i);
+        LOG_EVERY_MS(ILog::Level::Info, 60 * 60 * 1000, "hourly");
+        LOG_RATE_LIMITED(ILog::Level::Info, 0.001, 3, "burst %1%", i);
+    }
+
+    for (int i = 0; i < 5; ++i)
+    {
+        LOG_EVERY_MS(ILog::Level::Error, 50, "periodic %1%", i);
+        if (i == 3)
+            boost::this_thread::sleep_for(boost::chrono::milliseconds(100));
+    }
+
+    logging::CurrentLog::Set(nullptr);
+
+    const std::vector<std::string> expected = {
+        "every 0", "first 0", "hourly", "burst 0",
+        "first 1", "burst 1",
+        "burst 2",
+        "every 4",
+        "every 8",
+        "periodic 0", "suppressed 3 messages", "periodic 4"
+    };
+    EXPECT_EQ(texts, expected);
+}
+
+TEST(Logging, DedupCollapsesRepeats)
+{
+    // the sweeper thread writes too
+    boost::mutex mutex;
+    std::vector<std::string> texts;
+    const auto mocked = [&]() {
+        auto* log = new MockedLog();
+        EXPECT_CALL(*log, IsEnabled(CURRENT_MODULE_ID, _))
+            .WillRepeatedly(Return(true));
+        EXPECT_CALL(*log, Write(StrEq(CURRENT_MODULE_ID), _, _, _, _, _))
+            .WillRepeatedly(Invoke([&](const char*, ILog::Level::Value, const std::string& text, const char*, unsigned, const char*){
+                boost::unique_lock<boost::mutex> lock(mutex);
+                texts.push_back(text);
+            }));
+        return std::unique_ptr<ILog>(log);
+    };
+    const auto written = [&]() {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        return texts;
+    };
+
+    logging::DedupLog::Settings settings;
+    settings.window = 60 * 1000;
+    {
+        logging::DedupLog dedup(mocked(), settings);
+        ILog* logger = &dedup;
+
+        for (int i = 0; i < 1000; ++i)
+        {
+            LERROR(logger, CURRENT_MODULE_ID, "storm %1%", 1);
+            if (i % 100 == 0)
+                LERROR(logger, CURRENT_MODULE_ID, "storm %1%", 2);
+            if (i == 500)
+                LWARNING(logger, CURRENT_MODULE_ID, "storm %1%", 1);
+            logger->Write(CURRENT_MODULE_ID, ILog::Level::Error, std::string("plain"), __FILE__, __LINE__, __FUNCTION__);
+        }
+
+        const std::vector<std::string> first = { "storm 1", "storm 2", "plain", "storm 1" };
+        EXPECT_EQ(written(), first);
+
+        // the counts are written on flush, their order depends on the hashes
+        dedup.Flush();
+        auto repeated = written();
+        ASSERT_EQ(repeated.size(), 7u);
+        repeated.erase(repeated.begin(), repeated.begin() + 4);
+        std::sort(repeated.begin(), repeated.end());
+        const std::vector<std::string> expected = {
+            "last message repeated 9 times: storm 2",
+            "last message repeated 999 times: plain",
+            "last message repeated 999 times: storm 1"
+        };
+        EXPECT_EQ(repeated, expected);
+    }
+
+    // a window expiring within a batch is reported after the records before it
+    texts.clear();
+    {
+        logging::DedupLog dedup(mocked(), settings);
+        const auto start = logging::Clock::Now();
+        const auto record = [&](const char* text, std::uint64_t time) {
+            return ILog::Record{ CURRENT_MODULE_ID, ILog::Level::Error, text, __FILE__, 1, __FUNCTION__, time, boost::this_thread::get_id(), logging::Arguments(), nullptr, logging::ContextSnapshot() };
+        };
+        const std::vector<ILog::Record> batch = {
+            record("first", start), record("first", start + 1), record("second", start + 2),
+            record("first", start + 61ull * 1000000000), record("third", start + 61ull * 1000000000 + 1)
+        };
+        dedup.WriteBatch(batch.data(), batch.size());
+
+        const std::vector<std::string> expected = { "first", "second", "last message repeated 1 times: first", "first", "third" };
+        EXPECT_EQ(written(), expected);
+    }
+
+    // an expired window is reported without another occurrence
+    texts.clear();
+
+    settings.window = 50;
+    logging::DedupLog dedup(mocked(), settings);
+    ILog* logger = &dedup;
+    for (int i = 0; i < 5; ++i)
+        LERROR(logger, CURRENT_MODULE_ID, "burst");
+
+    for (int i = 0; i < 100 && written().size() < 2; ++i)
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(20));
+    LERROR(logger, CURRENT_MODULE_ID, "burst");
+
+    const std::vector<std::string> expected = { "burst", "last message repeated 4 times: burst", "burst" };
+    EXPECT_EQ(written(), expected);
+}
+
+std::string ReadGzip(const boost::filesystem::path& path)
+{
+    std::string result;
+    gzFile file = gzopen(path.string().c_str(), "rb");
+    if (!file)
+        return result;
+
+    char buffer[4096];
+    int size = 0;
+    while ((size = gzread(file, buffer, sizeof(buffer))) > 0)
+        result.append(buffer, static_cast<std::size_t>(size));
+    gzclose(file);
+    return result;
+}
+
+std::string ReadFile(const boost::filesystem::path& path)
+{
+    std::ifstream file(path.string());
+    return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+TEST(Logging, StdFlushPolicy)
+{
+    const auto path = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    {
+        logging::FlushPolicy policy;
+        policy.interval = 0;
+
+        logging::Std log(ILog::Level::Info, path.string().c_str(), policy);
+        ILog* logger = &log;
+
+        LINFO(logger, CURRENT_MODULE_ID, "buffered");
+        EXPECT_EQ(ReadFile(path).find("buffered"), std::string::npos);
+
+        LERROR(logger, CURRENT_MODULE_ID, "error");
+        EXPECT_NE(ReadFile(path).find("buffered"), std::string::npos);
+        EXPECT_NE(ReadFile(path).find("error"), std::string::npos);
+
+        LINFO(logger, CURRENT_MODULE_ID, "explicit");
+        logger->Flush();
+        EXPECT_NE(ReadFile(path).find("explicit"), std::string::npos);
+
+        LINFO(logger, CURRENT_MODULE_ID, "shutdown");
+    }
+    EXPECT_NE(ReadFile(path).find("shutdown"), std::string::npos);
+    boost::filesystem::remove(path);
+}
+
+TEST(Logging, Metrics)
+{
+    const auto path = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    const auto before = logging::Metrics::Get();
+    logging::Metrics::Enable(true);
+    {
+        logging::RotationPolicy rotation;
+        rotation.size = 4096;
+        logging::Std log(ILog::Level::Trace, path.string().c_str(), logging::FlushPolicy(), rotation);
+        ILog* logger = &log;
+
+        for (int i = 0; i < 100; ++i)
+            LINFO(logger, "noisy", "record %1%", i);
+        LERROR(logger, "quiet", "failure");
+
+        // runtime module names, the second one likely reuses the address of the first
+        {
+            std::string module("dyn");
+            module += "amic";
+            LINFO(logger, module.c_str(), "runtime module");
+        }
+        {
+            std::string module("run");
+            module += "time";
+            LINFO(logger, module.c_str(), "runtime module");
+        }
+
+        // counters of exited threads are kept
+        boost::thread([logger] { LDEBUG(logger, "quiet", "from a thread"); }).join();
+
+        logging::AsyncLog async(std::unique_ptr<ILog>(new logging::Std(ILog::Level::Trace, nullptr)), 2, logging::AsyncLog::Overflow::Drop);
+        for (int i = 0; i < 100; ++i)
+            async.Write("async", ILog::Level::Trace, "dropped", __FILE__, __LINE__, __FUNCTION__);
+        async.Flush();
+
+        logging::MetricsReport report(log, 10);
+        EXPECT_TRUE([&] {
+            for (int i = 0; i < 500; ++i, std::this_thread::sleep_for(std::chrono::milliseconds(10)))
+            {
+                log.Flush();
+                std::string text = ReadFile(path);
+                for (std::size_t backup = 1; text.find("metrics: records") == std::string::npos && backup <= rotation.generations; ++backup)
+                    text = ReadFile(path.string() + "." + std::to_string(backup));
+                if (text.find("metrics: records") != std::string::npos)
+                    return true;
+            }
+            return false;
+        }());
+    }
+    logging::Metrics::Enable(false);
+    const auto after = logging::Metrics::Get();
+
+    const auto messages = [](const logging::Metrics::Snapshot& snapshot, const std::string& name, ILog::Level::Value level) {
+        for (const auto& module : snapshot.modules)
+        {
+            if (module.name == name)
+                return module.messages[level];
+        }
+        return std::uint64_t();
+    };
+
+    EXPECT_EQ(messages(after, "noisy", ILog::Level::Info) - messages(before, "noisy", ILog::Level::Info), 100u);
+    EXPECT_EQ(messages(after, "quiet", ILog::Level::Error) - messages(before, "quiet", ILog::Level::Error), 1u);
+    EXPECT_EQ(messages(after, "quiet", ILog::Level::Debug) - messages(before, "quiet", ILog::Level::Debug), 1u);
+    EXPECT_GE(messages(after, "logging", ILog::Level::Info) - messages(before, "logging", ILog::Level::Info), 1u);
+    EXPECT_EQ(messages(after, "dynamic", ILog::Level::Info) - messages(before, "dynamic", ILog::Level::Info), 1u);
+    EXPECT_EQ(messages(after, "runtime", ILog::Level::Info) - messages(before, "runtime", ILog::Level::Info), 1u);
+
+    const auto written = messages(after, "async", ILog::Level::Trace) - messages(before, "async", ILog::Level::Trace);
+    EXPECT_GT(after.dropped - before.dropped, 0u);
+    EXPECT_EQ(written + after.dropped - before.dropped, 100u);
+    EXPECT_EQ(after.queued - before.queued, 0);
+
+    EXPECT_GT(after.total.bytes - before.total.bytes, 100u * 20);
+    EXPECT_GE(after.rotations - before.rotations, 1u);
+    EXPECT_GE(after.write.count - before.write.count, 102u);
+    EXPECT_GE(after.wait.count - before.wait.count, 102u);
+    EXPECT_GT(after.write.Percentile(99), 0u);
+    EXPECT_EQ(after.modules.front().name, "noisy");
+    EXPECT_NE(after.Summary().find("top: noisy 100"), std::string::npos);
+
+    boost::system::error_code error;
+    boost::filesystem::remove(path, error);
+    boost::filesystem::remove(path.string() + ".1", error);
+}
+
+#ifdef __linux__
+
+TEST(Logging, StdUringWriter)
+{
+    for (const auto writer : { logging::FlushPolicy::Writer::Uring, logging::FlushPolicy::Writer::Direct })
+    {
+        const auto path = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+
+        logging::FlushPolicy policy;
+        policy.size = 1000;
+        policy.interval = 0;
+        policy.writer = writer;
+
+        // the second run appends in the middle of a block
+        for (int run = 0; run < 2; ++run)
+        {
+            logging::Std log(ILog::Level::Info, path.string().c_str(), policy);
+            ILog* logger = &log;
+            for (int i = 0; i < 1000; ++i)
+            {
+                LINFO(logger, CURRENT_MODULE_ID, "record %1% %2%", run, i);
+                if (i % 100 == 0)
+                    logger->Flush();
+            }
+        }
+
+        const auto text = ReadFile(path);
+        EXPECT_EQ(text.find('\0'), std::string::npos) << writer;
+
+        std::istringstream stream(text);
+        std::vector<std::pair<int, int>> records;
+        for (std::string line; std::getline(stream, line);)
+        {
+            const auto position = line.find("record ");
+            if (position != std::string::npos)
+            {
+                std::istringstream record(line.substr(position + 7));
+                int run = -1, index = -1;
+                record >> run >> index;
+                records.emplace_back(run, index);
+            }
+        }
+
+        ASSERT_EQ(records.size(), 2000u) << writer;
+        for (int i = 0; i < 2000; ++i)
+            EXPECT_EQ(records[i], std::make_pair(i / 1000, i % 1000)) << writer;
+
+        boost::filesystem::remove(path);
+    }
+}
+
+#endif // __linux__
+
+#ifndef LOG_DEFERRED_FORMATTING
+
+TEST(Logging, FormattingWithoutAllocations)
+{
+    const auto path = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    logging::FlushPolicy policy;
+    policy.interval = 0;
+
+    ILog* logger = new logging::Std(ILog::Level::Info, path.string().c_str(), policy);
+    logging::CurrentLog::Set(logger);
+
+    const std::string text("string argument");
+    const auto write = [&](int i) {
+        LINFO(logger, CURRENT_MODULE_ID, "record %1% %2% %3% %4%", i, 2.5, text, "literal");
+        LOG_INFO("site %1% %2%", i, text);
+    };
+
+    // first calls size the thread buffers and register the call sites
+    for (int i = 0; i < 10; ++i)
+        write(i);
+
+    g_Allocations = 0;
+    g_CountAllocations = true;
+    for (int i = 0; i < 1000; ++i)
+        write(i);
+    g_CountAllocations = false;
+
+    EXPECT_EQ(g_Allocations, 0u);
+
+    logging::CurrentLog::Set(nullptr);
+    const auto content = ReadFile(path);
+    EXPECT_NE(content.find("record 999 2.5 string argument literal"), std::string::npos);
+    EXPECT_NE(content.find("site 999 string argument"), std::string::npos);
+    boost::filesystem::remove(path);
+}
+
+#endif // LOG_DEFERRED_FORMATTING
+
+TEST(Logging, ScopedLogAndContext)
+{
+    auto* owned = new MockedLog();
+    MockedLog scoped;
+
+    EXPECT_CALL(*owned, IsEnabled(_, _)).WillRepeatedly(Return(true));
+    EXPECT_CALL(scoped, IsEnabled(_, _)).WillRepeatedly(Return(true));
+    EXPECT_CALL(*owned, Write(_, _, "owned", _, _, _)).Times(Exactly(2));
+    EXPECT_CALL(scoped, Write(_, _, "scoped", _, _, _)).Times(Exactly(1));
+
+    logging::CurrentLog::Set(owned);
+    LOG_INFO("owned");
+    {
+        logging::ScopedLog scope(&scoped);
+        EXPECT_EQ(logging::CurrentLog::Get(), &scoped);
+        LOG_INFO("scoped");
+    }
+    EXPECT_EQ(logging::CurrentLog::Get(), owned);
+    LOG_INFO("owned");
+    logging::CurrentLog::Set(nullptr);
+
+    const auto path = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    {
+        logging::Std log(ILog::Level::Info, path.string().c_str());
+        const std::string session("abc");
+
+        LINFO((&log), CURRENT_MODULE_ID, "before");
+        logging::ContextSnapshot captured;
+        {
+            logging::ScopedContext request("request", 42);
+            {
+                logging::ScopedContext user("session", session);
+                EXPECT_EQ(logging::ScopedContext::GetText(), "request=42 session=abc");
+                LINFO((&log), CURRENT_MODULE_ID, "inner");
+
+                // records in the same scope share one text
+                captured = logging::ScopedContext::GetSnapshot();
+                EXPECT_EQ(logging::ScopedContext::GetSnapshot().GetText().data(), captured.GetText().data());
+            }
+            EXPECT_EQ(logging::ScopedContext::GetText(), "request=42");
+            {
+                // the temporary is gone before the record is written
+                logging::ScopedContext user("user", session + "-" + std::to_string(7));
+                LINFO((&log), CURRENT_MODULE_ID, "owned");
+            }
+            LINFO((&log), CURRENT_MODULE_ID, "outer");
+        }
+        LINFO((&log), CURRENT_MODULE_ID, "after");
+        EXPECT_TRUE(logging::ScopedContext::GetText().empty());
+        EXPECT_TRUE(logging::ScopedContext::GetSnapshot().IsEmpty());
+        EXPECT_EQ(captured.GetText(), "request=42 session=abc");
+    }
+
+    const auto content = ReadFile(path);
+    EXPECT_NE(content.find("] before/*"), std::string::npos);
+    EXPECT_NE(content.find("] {request=42 session=abc} inner/*"), std::string::npos);
+    EXPECT_NE(content.find("] {request=42} outer/*"), std::string::npos);
+    EXPECT_NE(content.find("] {request=42 user=abc-7} owned/*"), std::string::npos);
+    EXPECT_NE(content.find("] after/*"), std::string::npos);
+    boost::filesystem::remove(path);
+}
+
+TEST(Logging, CompileTimeThresholds)
+{
+    static_assert(CURRENT_MODULE_LEVEL == LOG_COMPILED_LEVEL, "module without its own threshold");
+    static_assert(logging::detail::GetModuleThreshold("tests") == LOG_COMPILED_LEVEL, "module without its own threshold");
+    static_assert(logging::detail::IsSameModule("net", "net") && !logging::detail::IsSameModule("net", "network"), "module names");
+
+    auto* log = new MockedLog();
+    EXPECT_CALL(*log, IsEnabled(_, ILog::Level::Info)).Times(0);
+    EXPECT_CALL(*log, IsEnabled(StrEq("quiet"), ILog::Level::Debug)).Times(0);
+    EXPECT_CALL(*log, IsEnabled(StrEq("plain"), ILog::Level::Debug)).WillOnce(Return(true));
+    EXPECT_CALL(*log, IsEnabled(_, ILog::Level::Warning)).WillOnce(Return(true));
+    EXPECT_CALL(*log, IsEnabled(_, ILog::Level::Error)).WillOnce(Return(true));
+    EXPECT_CALL(*log, Write(_, ILog::Level::Warning, "kept 2", _, _, _)).Times(Exactly(1));
+    EXPECT_CALL(*log, Write(_, ILog::Level::Error, "kept", _, _, _)).Times(Exactly(1));
+    EXPECT_CALL(*log, Write(_, ILog::Level::Debug, "kept 3", _, _, _)).Times(Exactly(1));
+
+    logging::CurrentLog::Set(log);
+    quiet::Write();
+    plain::Write();
+    logging::CurrentLog::Set(nullptr);
+
+    // discarded statements are type checked only
+    int evaluated = 0;
+    LOG_DISCARD("text %1%", ++evaluated);
+    EXPECT_EQ(evaluated, 0);
+}
+
+TEST(Logging, FlightRecorder)
+{
+    const auto path = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    const auto dump = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    {
+        logging::FlightRecorder::Settings settings;
+        settings.records = 4;
+        logging::FlightRecorder recorder(std::unique_ptr<ILog>(new logging::Std(ILog::Level::Info, path.string().c_str())), settings);
+        ILog* logger = &recorder;
+
+        EXPECT_TRUE(logger->IsEnabled(CURRENT_MODULE_ID, ILog::Level::Trace));
+        for (int i = 0; i < 5; ++i)
+            LTRACE(logger, CURRENT_MODULE_ID, "trace %1%", i);
+        recorder.Write(CURRENT_MODULE_ID, ILog::Level::Debug, logging::Capture("deferred %1% %2%", 42, "text"), __FILE__, __LINE__, __FUNCTION__);
+        LINFO(logger, CURRENT_MODULE_ID, "written");
+        recorder.Flush();
+        EXPECT_EQ(ReadFile(path).find("trace"), std::string::npos);
+
+#ifndef _WIN32
+        {
+            std::ofstream file(dump.string());
+        }
+        const int fd = ::open(dump.string().c_str(), O_WRONLY);
+        recorder.DumpTo(fd);
+        ::close(fd);
+        const auto dumped = ReadFile(dump);
+        EXPECT_NE(dumped.find("[DEBUG]["), std::string::npos);
+        EXPECT_NE(dumped.find("deferred %1% %2% | 42 text/*"), std::string::npos);
+        EXPECT_EQ(std::count(dumped.begin(), dumped.end(), '\n'), 4);
+
+        // oldest records are evicted, with or without deferred formatting
+        EXPECT_FALSE(std::regex_search(dumped, std::regex("trace (%1% \\| )?[01]\\b")));
+        EXPECT_TRUE(std::regex_search(dumped, std::regex("trace (%1% \\| )?4\\b")));
+#endif
+
+        LERROR(logger, CURRENT_MODULE_ID, "failed");
+        LTRACE(logger, CURRENT_MODULE_ID, "after");
+        recorder.Dump();
+        recorder.Flush();
+    }
+
+    const auto content = ReadFile(path);
+    const auto written = content.find("written");
+    const auto first = content.find("trace 2");
+    const auto deferred = content.find("deferred 42 text");
+    const auto failed = content.find("failed");
+    EXPECT_EQ(content.find("trace 1"), std::string::npos);
+    EXPECT_LT(written, first);
+    EXPECT_LT(first, content.find("trace 4"));
+    EXPECT_LT(content.find("trace 4"), deferred);
+    EXPECT_LT(deferred, failed);
+    EXPECT_LT(failed, content.find("after"));
+    EXPECT_NE(content.find("after"), std::string::npos);
+    boost::filesystem::remove(path);
+    boost::filesystem::remove(dump);
+}
+
+TEST(Logging, FlightRecorderThreads)
+{
+    const auto path = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    {
+        logging::FlightRecorder::Settings settings;
+        settings.records = 4;
+        logging::FlightRecorder recorder(std::unique_ptr<ILog>(new logging::Std(ILog::Level::Info, path.string().c_str())), settings);
+        ILog* logger = &recorder;
+
+        // rings of exited threads are taken over, records of the previous thread are dropped
+        for (int i = 0; i < 10; ++i)
+            boost::thread([logger, i](){ LTRACE(logger, CURRENT_MODULE_ID, "thread %1%", i); }).join();
+        recorder.Dump();
+        recorder.Flush();
+
+        auto content = ReadFile(path);
+        EXPECT_EQ(content.find("thread 8"), std::string::npos);
+        EXPECT_NE(content.find("thread 9"), std::string::npos);
+
+#ifndef _WIN32
+        // a single ring, recorded once
+        const auto dump = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+        {
+            std::ofstream file(dump.string());
+        }
+        const int fd = ::open(dump.string().c_str(), O_WRONLY);
+        boost::thread([&recorder, logger, fd](){
+            LTRACE(logger, CURRENT_MODULE_ID, "last");
+            recorder.DumpTo(fd);
+        }).join();
+        ::close(fd);
+        const auto dumped = ReadFile(dump);
+        EXPECT_EQ(std::count(dumped.begin(), dumped.end(), '\n'), 1);
+        EXPECT_NE(dumped.find("last"), std::string::npos);
+        boost::filesystem::remove(dump);
+#endif
+    }
+    boost::filesystem::remove(path);
+}
+
+TEST(Logging, FlightRecorderRuntimeStrings)
+{
+    const auto path = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    {
+        logging::FlightRecorder::Settings settings;
+        settings.records = 32;
+        logging::FlightRecorder recorder(std::unique_ptr<ILog>(new logging::Std(ILog::Level::Info, path.string().c_str())), settings);
+
+        // module storage is gone, or reused, before the rings are dumped
+        for (int i = 0; i < 10; ++i)
+        {
+            std::unique_ptr<std::string> module(new std::string("runtime_" + std::to_string(i)));
+            recorder.Write(module->c_str(), ILog::Level::Trace, "text " + std::to_string(i), __FILE__, __LINE__, __FUNCTION__);
+            recorder.Write(module->c_str(), ILog::Level::Debug, logging::Capture("deferred %1%", i), __FILE__, __LINE__, __FUNCTION__);
+            module->assign("garbage_" + std::to_string(i));
+        }
+        recorder.Dump();
+        recorder.Flush();
+    }
+
+    const auto content = ReadFile(path);
+    for (int i = 0; i < 10; ++i)
+    {
+        EXPECT_NE(content.find("][runtime_" + std::to_string(i) + "] ["), std::string::npos);
+        EXPECT_NE(content.find("text " + std::to_string(i) + "/*"), std::string::npos);
+        EXPECT_NE(content.find("deferred " + std::to_string(i) + "/*"), std::string::npos);
+    }
+    EXPECT_EQ(content.find("garbage"), std::string::npos);
+    boost::filesystem::remove(path);
+}
+
+TEST(Logging, StdCompression)
+{
+    const auto count = [](const std::string& text, const std::string& what) {
+        std::size_t result = 0;
+        for (auto position = text.find(what); position != std::string::npos; position = text.find(what, position + 1))
+            ++result;
+        return result;
+    };
+
+    logging::FlushPolicy policy;
+    policy.size = 1024;
+    policy.interval = 0;
+
+    {
+        const auto path = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+        logging::RotationPolicy rotation;
+        rotation.size = 16 * 1024;
+        rotation.generations = 10;
+        rotation.compression = logging::RotationPolicy::Compression::Stream;
+        {
+            logging::Std log(ILog::Level::Info, path.c_str(), policy, rotation);
+            for (int i = 0; i < 500; ++i)
+                LINFO((&log), CURRENT_MODULE_ID, "streamed record %1%", i);
+        }
+        EXPECT_FALSE(boost::filesystem::exists(path));
+        EXPECT_TRUE(boost::filesystem::exists(path + ".gz"));
+        EXPECT_TRUE(boost::filesystem::exists(path + ".1.gz"));
+
+        // an appended file is measured by its text, not by its compressed size
+        {
+            logging::Std log(ILog::Level::Info, path.c_str(), policy, rotation);
+            for (int i = 500; i < 1000; ++i)
+                LINFO((&log), CURRENT_MODULE_ID, "streamed record %1%", i);
+        }
+        EXPECT_LE(ReadGzip(path + ".gz").size(), rotation.size + policy.size);
+
+        std::size_t records = 0;
+        for (std::size_t i = 0; i <= rotation.generations; ++i)
+        {
+            const auto file = i ? path + "." + std::to_string(i) + ".gz" : path + ".gz";
+            if (!boost::filesystem::exists(file))
+                continue;
+
+            const auto text = ReadGzip(file);
+            EXPECT_LT(boost::filesystem::file_size(file), text.size() / 2);
+            EXPECT_LE(text.size(), rotation.size + policy.size);
+            records += count(text, "streamed record");
+            boost::filesystem::remove(file);
+        }
+        EXPECT_EQ(records, 1000u);
+    }
+
+    {
+        const auto path = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+        logging::RotationPolicy rotation;
+        rotation.size = 8 * 1024;
+        rotation.generations = 2;
+        rotation.compression = logging::RotationPolicy::Compression::Backups;
+        {
+            logging::Std log(ILog::Level::Info, path.c_str(), policy, rotation);
+            for (int i = 0; i < 1000; ++i)
+                LINFO((&log), CURRENT_MODULE_ID, "backup record %1%", i);
+        }
+
+        // the compressor finishes pending files before the sink is destroyed
+        EXPECT_NE(ReadFile(path).find("backup record 999"), std::string::npos);
+        EXPECT_NE(count(ReadGzip(path + ".1.gz"), "backup record"), 0u);
+        EXPECT_NE(count(ReadGzip(path + ".2.gz"), "backup record"), 0u);
+        EXPECT_FALSE(boost::filesystem::exists(path + ".3.gz"));
+
+        const auto folder = boost::filesystem::path(path).branch_path();
+        const auto name = boost::filesystem::path(path).filename().string();
+        for (boost::filesystem::directory_iterator it(folder), end; it != end; ++it)
+        {
+            const auto file = it->path().filename().string();
+            if (file.compare(0, name.size(), name))
+                continue;
+            EXPECT_EQ(file.find(".pending"), std::string::npos);
+            boost::filesystem::remove(it->path());
+        }
+    }
+}
+
+TEST(Logging, StdLevelChanges)
+{
+    const auto path = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+    {
+        logging::Std log(ILog::Level::Info, path.c_str());
+
+        // replaced levels are freed while readers keep checking
+        std::atomic<bool> stopped{ false };
+        std::atomic<std::size_t> checks{ 0 };
+        std::vector<boost::thread> readers;
+        for (int i = 0; i < 4; ++i)
+            readers.emplace_back([&](){
+                while (!stopped)
+                {
+                    EXPECT_TRUE(log.IsEnabled("net", ILog::Level::Error));
+                    ++checks;
+                }
+            });
+
+        boost::property_tree::ptree settings;
+        settings.put("logging.root", "WARNING");
+        settings.put("logging.net", "DEBUG");
+        for (int i = 0; i < 10000 || checks < 10000; ++i)
+        {
+            if (i % 2)
+                log.SetLevels(settings);
+            else
+                log.SetLevel(ILog::Level::Trace);
+        }
+        stopped = true;
+        for (auto& reader : readers)
+            reader.join();
+
+        log.SetLevels(settings);
+        EXPECT_TRUE(log.IsEnabled("net", ILog::Level::Debug));
+        EXPECT_FALSE(log.IsEnabled("db", ILog::Level::Info));
+    }
+    boost::filesystem::remove(path);
+}
+
+TEST(Logging, StdModuleLevelsReload)
+{
+    const auto folder = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    const auto file = (folder / "levels.log").string();
+    const auto config = (folder / "levels.json").string();
+
+    const auto save = [&](const std::string& text) {
+        // replaced through a rename, the way editors save
+        const auto temporary = config + ".tmp";
+        std::ofstream(temporary) << text;
+        boost::filesystem::rename(temporary, config);
+    };
+
+    const auto wait = [](const std::function<bool()>& condition) {
+        for (int i = 0; i < 500 && !condition(); ++i)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        return condition();
+    };
+
+    const auto failed = [&] {
+        std::ifstream output(file);
+        const std::string text((std::istreambuf_iterator<char>(output)), std::istreambuf_iterator<char>());
+        return text.find("Failed to load levels from " + config) != std::string::npos;
+    };
+
+    boost::filesystem::create_directories(folder);
+    {
+        logging::Std log(ILog::Level::Info, file.c_str());
+
+        boost::property_tree::ptree settings;
+        settings.put("logging.root", "ERROR");
+        settings.put("logging.net", "DEBUG");
+        log.SetLevels(settings);
+        EXPECT_TRUE(log.IsEnabled("net", ILog::Level::Debug));
+        EXPECT_FALSE(log.IsEnabled("net", ILog::Level::Trace));
+        EXPECT_FALSE(log.IsEnabled("db", ILog::Level::Warning));
+        EXPECT_TRUE(log.IsEnabled("db", ILog::Level::Error));
+        EXPECT_FALSE(log.IsEnabled(nullptr, ILog::Level::Info));
+
+        // the first entry is the default without a root
+        boost::property_tree::ptree legacy;
+        legacy.put("logging.level", "WARNING");
+        log.SetLevels(legacy);
+        EXPECT_TRUE(log.IsEnabled("net", ILog::Level::Warning));
+        EXPECT_FALSE(log.IsEnabled("net", ILog::Level::Info));
+
+        save(R"({ "logging": { "root": "INFO", "db": "TRACE" } })");
+        log.Watch(config.c_str());
+        EXPECT_TRUE(log.IsEnabled("db", ILog::Level::Trace));
+        EXPECT_FALSE(log.IsEnabled("net", ILog::Level::Debug));
+
+        save(R"({ "logging": { "root": "INFO", "net": "DEBUG" } })");
+        EXPECT_TRUE(wait([&] { return log.IsEnabled("net", ILog::Level::Debug); }));
+        EXPECT_FALSE(log.IsEnabled("db", ILog::Level::Debug));
+
+        // a broken file keeps the current levels
+        save(R"({ "logging": )");
+        EXPECT_TRUE(wait(failed));
+        EXPECT_TRUE(log.IsEnabled("net", ILog::Level::Debug));
+
+        save(R"({ "logging": { "root": "ERROR" } })");
+        EXPECT_TRUE(wait([&] { return !log.IsEnabled("net", ILog::Level::Debug); }));
+        EXPECT_FALSE(log.IsEnabled("net", ILog::Level::Warning));
+        EXPECT_TRUE(log.IsEnabled("net", ILog::Level::Error));
+    }
+
+    boost::filesystem::remove_all(folder);
+}
+
+TEST(Logging, RouterFanOut)
+{
+    const auto folder = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    const auto errors = (folder / "errors.log").string();
+    const auto network = (folder / "network.log").string();
+    const auto all = (folder / "all.log").string();
+    {
+        logging::Router router;
+        router.Add(std::unique_ptr<ILog>(new logging::Std(ILog::Level::Trace, errors.c_str())), logging::Router::Route{ ILog::Level::Error, {} });
+        router.Add(std::unique_ptr<ILog>(new logging::Std(ILog::Level::Debug, network.c_str())), logging::Router::Route{ ILog::Level::Trace, { "net" } });
+        router.Add(std::unique_ptr<ILog>(new logging::Std(ILog::Level::Info, all.c_str())));
+
+        // union of the routes, each capped by its sink
+        EXPECT_TRUE(router.IsEnabled("net", ILog::Level::Debug));
+        EXPECT_FALSE(router.IsEnabled("net", ILog::Level::Trace));
+        EXPECT_FALSE(router.IsEnabled("db", ILog::Level::Debug));
+        EXPECT_TRUE(router.IsEnabled("db", ILog::Level::Info));
+
+        ILog* logger = &router;
+        LDEBUG(logger, "net", "connected %1%", 1);
+        LDEBUG(logger, "db", "query");
+        LINFO(logger, "db", "opened");
+        LERROR(logger, "net", "failed %1%", 2);
+        router.Write("db", ILog::Level::Error, logging::Capture("deferred %1%", 3), __FILE__, __LINE__, __FUNCTION__);
+    }
+
+    const auto lines = [](const std::string& path, const std::string& what) {
+        std::vector<std::string> result;
+        std::ifstream file(path);
+        std::string line;
+        while (std::getline(file, line))
+        {
+            if (line.find(what) != std::string::npos)
+                result.push_back(line);
+        }
+        return result;
+    };
+
+    EXPECT_EQ(lines(errors, "failed 2").size(), 1u);
+    EXPECT_EQ(lines(errors, "deferred 3").size(), 1u);
+    EXPECT_TRUE(lines(errors, "opened").empty());
+
+    EXPECT_EQ(lines(network, "connected 1").size(), 1u);
+    EXPECT_EQ(lines(network, "failed 2").size(), 1u);
+    EXPECT_TRUE(lines(network, "opened").empty());
+    EXPECT_TRUE(lines(network, "query").empty());
+
+    EXPECT_TRUE(lines(all, "connected").empty());
+    EXPECT_TRUE(lines(all, "query").empty());
+    EXPECT_EQ(lines(all, "opened").size(), 1u);
+
+    // the same rendered line, time included, goes to every sink
+    EXPECT_EQ(lines(all, "failed 2"), lines(errors, "failed 2"));
+    EXPECT_EQ(lines(network, "failed 2"), lines(errors, "failed 2"));
+
+    boost::filesystem::remove_all(folder);
+}
+
+TEST(Logging, RouterModuleLevels)
+{
+    const auto folder = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    const auto all = (folder / "all.log").string();
+    const auto network = (folder / "network.log").string();
+    {
+        auto sink = std::unique_ptr<logging::Std>(new logging::Std(ILog::Level::Info, all.c_str()));
+        logging::Std& std = *sink;
+
+        boost::property_tree::ptree settings;
+        settings.put("logging.root", "INFO");
+        settings.put("logging.net", "DEBUG");
+        std.SetLevels(settings);
+        ASSERT_TRUE(std.IsEnabled("net", ILog::Level::Debug));
+
+        logging::Router router;
+        router.Add(std::move(sink));
+        router.Add(std::unique_ptr<ILog>(new logging::Std(ILog::Level::Trace, network.c_str())), logging::Router::Route{ ILog::Level::Debug, { "net" } });
+
+        // per-module levels of a sink routed for all modules
+        EXPECT_TRUE(router.IsEnabled("net", ILog::Level::Debug));
+        EXPECT_FALSE(router.IsEnabled("net", ILog::Level::Trace));
+        EXPECT_FALSE(router.IsEnabled("db", ILog::Level::Debug));
+        EXPECT_TRUE(router.IsEnabled("db", ILog::Level::Info));
+
+        ILog* logger = &router;
+        LDEBUG(logger, "net", "connected");
+        LDEBUG(logger, "db", "query");
+
+        // levels changed on the sink itself, as a reload does
+        settings.clear();
+        settings.put("logging.root", "INFO");
+        settings.put("logging.db", "TRACE");
+        std.SetLevels(settings);
+        EXPECT_TRUE(router.IsEnabled("db", ILog::Level::Trace));
+        EXPECT_TRUE(router.IsEnabled("net", ILog::Level::Debug));
+        LTRACE(logger, "db", "traced");
+    }
+
+    const auto count = [](const std::string& path, const std::string& what) {
+        std::size_t result = 0;
+        std::ifstream file(path);
+        for (std::string line; std::getline(file, line); )
+            result += line.find(what) != std::string::npos;
+        return result;
+    };
+
+    EXPECT_EQ(count(all, "connected"), 1u);
+    EXPECT_EQ(count(all, "query"), 0u);
+    EXPECT_EQ(count(all, "traced"), 1u);
+    EXPECT_EQ(count(network, "connected"), 1u);
+    EXPECT_EQ(count(network, "traced"), 0u);
+
+    boost::filesystem::remove_all(folder);
+}
+
+TEST(Logging, JsonLines)
+{
+    const auto folder = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    const auto json = (folder / "log.json").string();
+    const auto queued = (folder / "queued.json").string();
+    const auto text = (folder / "log.txt").string();
+    const auto binary = (folder / "log.bin").string();
+
+    // long enough for the vector loops, escapes inside and after them
+    const std::string path = "C:\\data\\records\\2024\\\"quoted\"\n\ttab\x01 and some plain tail";
+    {
+        logging::Router router;
+        router.Add(std::unique_ptr<ILog>(new logging::Std(ILog::Level::Trace, json.c_str(), logging::FlushPolicy(), logging::RotationPolicy(), logging::Layout::Json)));
+        router.Add(std::unique_ptr<ILog>(new logging::Std(ILog::Level::Trace, text.c_str())));
+        router.Add(std::unique_ptr<ILog>(new logging::Binary(ILog::Level::Trace, binary.c_str())));
+
+        ILog* logger = &router;
+        LKV(logger, ILog::Level::Info, "request done", "user", path, "status", 200, "delta", -5, "ratio", 0.25, "cached", true);
+        LINFO(logger, CURRENT_MODULE_ID, "plain %1%", 1);
+
+        logging::AsyncLog async(std::unique_ptr<ILog>(new logging::Std(ILog::Level::Trace, queued.c_str(), logging::FlushPolicy(), logging::RotationPolicy(), logging::Layout::Json)));
+        logger = &async;
+        LKV(logger, ILog::Level::Warning, "queued", "id", 7u);
+        async.Flush();
+    }
+
+    const auto lines = [](const std::string& path) {
+        std::vector<std::string> result;
+        std::ifstream file(path);
+        for (std::string line; std::getline(file, line); )
+            result.push_back(line);
+        return result;
+    };
+
+    auto records = lines(json);
+    const auto more = lines(queued);
+    records.insert(records.end(), more.begin(), more.end());
+
+    // the opening notice is a record too
+    ASSERT_EQ(records.size(), 5u);
+    EXPECT_NE(records[0].find("\"module\":\"logging\",\"thread\":"), std::string::npos);
+    EXPECT_NE(records[0].find("\"message\":\"Started. \"}"), std::string::npos);
+    records.erase(records.begin() + 3);
+    records.erase(records.begin());
+    for (const auto& record : records)
+    {
+        EXPECT_EQ(record.front(), '{');
+        EXPECT_EQ(record.back(), '}');
+        EXPECT_NE(record.find("\",\"module\":\"tests\",\"thread\":\""), std::string::npos);
+        EXPECT_TRUE(std::regex_search(record, std::regex("^\\{\"time\":\"\\d{4}-\\d\\d-\\d\\dT\\d\\d:\\d\\d:\\d\\d\\.\\d{6}Z\"")));
+    }
+    EXPECT_NE(records[0].find("\"level\":\"INFO\""), std::string::npos);
+    EXPECT_NE(records[0].find("\"message\":\"request done\""), std::string::npos);
+    EXPECT_NE(records[0].find("\"user\":\"C:\\\\data\\\\records\\\\2024\\\\\\\"quoted\\\"\\n\\ttab\\u0001 and some plain tail\""), std::string::npos);
+    EXPECT_NE(records[0].find(",\"status\":200,\"delta\":-5,\"ratio\":0.25,\"cached\":true}"), std::string::npos);
+    EXPECT_NE(records[1].find("\"message\":\"plain 1\"}"), std::string::npos);
+    EXPECT_NE(records[2].find("\"level\":\"WARN\""), std::string::npos);
+    EXPECT_NE(records[2].find("\"message\":\"queued\",\"id\":7}"), std::string::npos);
+
+    // text sinks get the fields appended to the message
+    const auto plain = lines(text);
+    ASSERT_GE(plain.size(), 2u);
+    EXPECT_NE(plain[1].find("request done user=" + path.substr(0, 20)), std::string::npos);
+
+    std::ostringstream decoded;
+    logging::Decode(binary, decoded);
+    EXPECT_NE(decoded.str().find("status=200 delta=-5 ratio=0.25 cached=true"), std::string::npos);
+
+    boost::filesystem::remove_all(folder);
+}
+
+#ifdef LOG_TESTS_LOG4CPLUS
+TEST(Logging, Log4cplusLevelCache)
+{
+    const auto folder = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    boost::filesystem::create_directories(folder);
+    logging::Log4cplus log(ILog::Level::Info, (folder / "log4cplus.log").string().c_str());
+
+    EXPECT_TRUE(log.IsEnabled("cached", ILog::Level::Info));
+    EXPECT_FALSE(log.IsEnabled("cached", ILog::Level::Debug));
+
+    boost::property_tree::ptree settings;
+    settings.put("logging.runtime_a", "DEBUG");
+    log.SetLevels(settings);
+
+    // runtime names: the same text at another address finds the entry, other text at a reused address doesn't
+    {
+        const std::string module("runtime_a");
+        EXPECT_TRUE(log.IsEnabled(module.c_str(), ILog::Level::Debug));
+    }
+    {
+        const std::string module("runtime_b");
+        EXPECT_FALSE(log.IsEnabled(module.c_str(), ILog::Level::Debug));
+    }
+    for (int i = 0; i < 100; ++i)
+    {
+        const std::unique_ptr<std::string> module(new std::string("runtime_a"));
+        EXPECT_TRUE(log.IsEnabled(module->c_str(), ILog::Level::Debug));
+    }
+
+    // more modules than cache slots, the rest ask the hierarchy
+    for (int i = 0; i < 1100; ++i)
+    {
+        const auto module = "module_" + std::to_string(i);
+        EXPECT_TRUE(log.IsEnabled(module.c_str(), ILog::Level::Info));
+        EXPECT_FALSE(log.IsEnabled(module.c_str(), ILog::Level::Debug));
+    }
+    EXPECT_TRUE(log.IsEnabled("module_1099", ILog::Level::Info));
+
+    // level changes reach cached snapshots
+    log.SetLevel(ILog::Level::Error);
+    EXPECT_FALSE(log.IsEnabled("cached", ILog::Level::Info));
+    EXPECT_FALSE(log.IsEnabled("module_1099", ILog::Level::Info));
+    EXPECT_TRUE(log.IsEnabled("runtime_a", ILog::Level::Debug));
+
+    settings.clear();
+    settings.put("logging.cached", "TRACE");
+    log.SetLevels(settings);
+    EXPECT_TRUE(log.IsEnabled("cached", ILog::Level::Trace));
+
+    log.SetLevel(ILog::Level::Info);
+    boost::filesystem::remove_all(folder);
+}
+#endif
+
+TEST(Logging, ClockTimestamps)
+{
+    const auto wall = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    const auto first = logging::Clock::Now();
+    const auto second = logging::Clock::Now();
+
+    EXPECT_LE(first, second);
+    EXPECT_LT(std::llabs(static_cast<long long>(first) - static_cast<long long>(wall)), 1000000000LL);
+
+    const auto path = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    {
+        logging::Std log(ILog::Level::Info, path.string().c_str());
+        ILog* logger = &log;
+        LINFO(logger, CURRENT_MODULE_ID, "first");
+        LINFO(logger, CURRENT_MODULE_ID, "second");
+    }
+
+    const std::regex line(R"(\[INFO\]\[\d{4}-[A-Z][a-z]{2}-\d{2} \d{2}:\d{2}:\d{2}\.\d{6}\]\[tests\] \[[0-9a-f]+\] (first|second)/\*.*)");
+    std::ifstream stream(path.string());
+    std::string text;
+    std::size_t matched = 0;
+    while (std::getline(stream, text))
+        matched += std::regex_match(text, line);
+    EXPECT_EQ(matched, 2u);
+    boost::filesystem::remove(path);
+}
+
+TEST(Logging, MappedFileRotation)
+{
+    const auto folder = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    const auto path = (folder / "mapped.log").string();
+    {
+        logging::MappedFile::Settings settings;
+        settings.segment = 4096;
+        settings.generations = 2;
+
+        logging::MappedFile log(ILog::Level::Info, path.c_str(), settings);
+        ILog* logger = &log;
+
+        std::vector<boost::thread> threads;
+        for (int i = 0; i < 4; ++i)
+            threads.emplace_back([logger](){
+                for (int j = 0; j < 500; ++j)
+                    LINFO(logger, CURRENT_MODULE_ID, "mapped record %1%", j);
+            });
+        for (auto& thread : threads)
+            thread.join();
+
+        LINFO(logger, CURRENT_MODULE_ID, "last");
+        EXPECT_EQ(log.GetDropped(), 0u);
+    }
+
+    EXPECT_TRUE(boost::filesystem::exists(path + ".1"));
+    EXPECT_TRUE(boost::filesystem::exists(path + ".2"));
+    EXPECT_FALSE(boost::filesystem::exists(path + ".3"));
+    EXPECT_FALSE(boost::filesystem::exists(path + ".next"));
+
+    for (const auto& file : { path, path + ".1", path + ".2" })
+    {
+        const auto content = ReadFile(file);
+        EXPECT_LE(content.size(), 4096u);
+        EXPECT_EQ(content.find('\0'), std::string::npos);
+        ASSERT_FALSE(content.empty());
+        EXPECT_EQ(content.back(), '\n');
+    }
+    EXPECT_NE(ReadFile(path).find("last"), std::string::npos);
+
+    boost::filesystem::remove_all(folder);
+}
+
+TEST(Logging, MappedFileLevels)
+{
+    const auto folder = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    const auto path = (folder / "mapped.log").string();
+    {
+        logging::MappedFile log(ILog::Level::Info, path.c_str());
+        ILog* logger = &log;
+
+        boost::property_tree::ptree settings;
+        settings.put("logging.root", "INFO");
+        settings.put("logging.net", "DEBUG");
+        log.SetLevels(settings);
+        EXPECT_TRUE(log.IsEnabled("net", ILog::Level::Debug));
+        EXPECT_FALSE(log.IsEnabled("net", ILog::Level::Trace));
+        EXPECT_FALSE(log.IsEnabled("db", ILog::Level::Debug));
+
+        // levels change while other threads check them
+        std::atomic<bool> stop(false);
+        boost::thread reader([&](){
+            while (!stop)
+                LDEBUG(logger, "net", "checked");
+        });
+        for (int i = 0; i < 100; ++i)
+            log.SetLevel(i % 2 ? ILog::Level::Debug : ILog::Level::Info);
+        stop = true;
+        reader.join();
+
+        log.SetLevel(ILog::Level::Error);
+        EXPECT_FALSE(log.IsEnabled("net", ILog::Level::Info));
+        LINFO(logger, "net", "dropped");
+    }
+
+    EXPECT_EQ(ReadFile(path).find("dropped"), std::string::npos);
+    boost::filesystem::remove_all(folder);
+}
+
+TEST(Logging, ShardedMerge)
+{
+    const auto folder = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    const auto path = (folder / "sharded.log").string();
+    std::vector<std::string> shards;
+    {
+        logging::Sharded log(ILog::Level::Info, path.c_str());
+        ILog* logger = &log;
+
+        // all threads hold a shard at once
+        boost::barrier started(4);
+        std::vector<boost::thread> threads;
+        for (int i = 0; i < 4; ++i)
+            threads.emplace_back([logger, i, &started](){
+                LINFO(logger, CURRENT_MODULE_ID, "thread %1% record %2%", i, 0);
+                started.wait();
+                for (int j = 1; j < 100; ++j)
+                    LINFO(logger, CURRENT_MODULE_ID, "thread %1% record %2%", i, j);
+            });
+        for (auto& thread : threads)
+            thread.join();
+
+        shards = log.GetShards();
+    }
+    ASSERT_EQ(shards.size(), 4u);
+
+    // multi-line records stay in one piece
+    const auto extra = (folder / "extra.log").string();
+    {
+        std::ofstream stream(extra);
+        stream << "[INFO][2000-Jan-01 00:00:00.000001][tests] [1] first\ncontinued/* f */\n";
+    }
+    shards.push_back(extra);
+
+    std::ostringstream merged;
+    logging::Merge(shards, merged);
+
+    std::istringstream lines(merged.str());
+    std::string line;
+    std::string previous;
+    std::size_t records = 0;
+    std::getline(lines, line);
+    EXPECT_EQ(line, "[INFO][2000-Jan-01 00:00:00.000001][tests] [1] first");
+    std::getline(lines, line);
+    EXPECT_EQ(line, "continued/* f */");
+    while (std::getline(lines, line))
+    {
+        // same day, the time field sorts as text
+        const auto time = line.substr(line.find("]["), 30);
+        EXPECT_LE(previous, time);
+        previous = time;
+        ++records;
+    }
+    EXPECT_EQ(records, 400u);
+
+    boost::filesystem::remove_all(folder);
+}
+
+TEST(Logging, ShardedReuse)
+{
+    const auto folder = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    const auto path = (folder / "sharded.log").string();
+    {
+        logging::RotationPolicy rotation;
+        rotation.size = 4096;
+        rotation.generations = 2;
+        logging::Sharded log(ILog::Level::Info, path.c_str(), logging::FlushPolicy(), rotation);
+        ILog* logger = &log;
+
+        // threads come and go, their shards are taken over
+        for (int i = 0; i < 20; ++i)
+        {
+            boost::thread([logger, i](){
+                for (int j = 0; j < 10; ++j)
+                    LINFO(logger, CURRENT_MODULE_ID, "thread %1% record %2%", i, j);
+            }).join();
+        }
+        EXPECT_EQ(log.GetShards().size(), 1u);
+
+        // per-module levels, as for Std
+        boost::property_tree::ptree settings;
+        settings.put("logging.root", "WARNING");
+        settings.put("logging.net", "DEBUG");
+        log.SetLevels(settings);
+        EXPECT_TRUE(log.IsEnabled("net", ILog::Level::Debug));
+        EXPECT_FALSE(log.IsEnabled("db", ILog::Level::Info));
+        EXPECT_TRUE(log.IsEnabled("db", ILog::Level::Warning));
+    }
+
+    // rotated by size like Std
+    EXPECT_TRUE(boost::filesystem::exists(path + ".shard0"));
+    EXPECT_TRUE(boost::filesystem::exists(path + ".shard0.1"));
+    EXPECT_TRUE(boost::filesystem::exists(path + ".shard0.2"));
+    EXPECT_FALSE(boost::filesystem::exists(path + ".shard0.3"));
+    EXPECT_FALSE(boost::filesystem::exists(path + ".shard1"));
+    EXPECT_LE(boost::filesystem::file_size(path + ".shard0.1"), 4096u + 200u);
+
+    boost::filesystem::remove_all(folder);
+}
+
+TEST(Logging, BinaryRoundTrip)
+{
+    const auto path = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+    const std::uint64_t start = 1500000000ull * 1000000000;
+    {
+        logging::FlushPolicy policy;
+        policy.interval = 0;
+        logging::Binary log(ILog::Level::Trace, path.c_str(), policy, 256);
+
+        for (unsigned i = 0; i < 100; ++i)
+        {
+            logging::Arguments arguments("binary %1% %2%");
+            arguments.Add(i);
+            arguments.Add(std::string("text"));
+            const auto time = start + i * 1000000000ull;
+
+            if (i % 2)
+                log.Write(ILog::Record{ CURRENT_MODULE_ID, ILog::Level::Info, "plain " + std::to_string(i), __FILE__, __LINE__, __FUNCTION__, time, boost::this_thread::get_id(), logging::Arguments(), nullptr, logging::ContextSnapshot() });
+            else
+                log.Write(ILog::Record{ CURRENT_MODULE_ID, ILog::Level::Debug, std::string(), __FILE__, __LINE__, __FUNCTION__, time, boost::this_thread::get_id(), arguments, nullptr, logging::ContextSnapshot() });
+        }
+
+        // per-module levels, as for Std
+        boost::property_tree::ptree settings;
+        settings.put("logging.root", "INFO");
+        settings.put("logging.net", "TRACE");
+        log.SetLevels(settings);
+        EXPECT_TRUE(log.IsEnabled("net", ILog::Level::Trace));
+        EXPECT_FALSE(log.IsEnabled("db", ILog::Level::Debug));
+    }
+    EXPECT_GT(boost::filesystem::file_size(path + ".idx"), 16u);
+
+    std::ostringstream all;
+    logging::Decode(path, all);
+    const auto text = all.str();
+    EXPECT_EQ(std::count(text.begin(), text.end(), '\n'), 100);
+    EXPECT_NE(text.find("[DEBUG]["), std::string::npos);
+    EXPECT_NE(text.find("][tests] ["), std::string::npos);
+    EXPECT_NE(text.find("binary 0 text/* " + std::string(__FUNCTION__) + " */\n"), std::string::npos);
+    EXPECT_NE(text.find("plain 99/*"), std::string::npos);
+
+    std::ostringstream window;
+    logging::Decode(path, window, start + 50 * 1000000000ull, start + 59 * 1000000000ull);
+    std::istringstream lines(window.str());
+    std::vector<std::string> records;
+    for (std::string line; std::getline(lines, line); )
+        records.push_back(line);
+    ASSERT_EQ(records.size(), 10u);
+    EXPECT_NE(records.front().find("binary 50 text"), std::string::npos);
+    EXPECT_NE(records.back().find("plain 59"), std::string::npos);
+
+    boost::filesystem::remove(path);
+    boost::filesystem::remove(path + ".idx");
+}
+
+TEST(Logging, BinaryDamaged)
+{
+    const auto path = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+    const std::uint64_t start = 1500000000ull * 1000000000;
+    {
+        logging::FlushPolicy policy;
+        policy.interval = 0;
+        logging::Binary log(ILog::Level::Trace, path.c_str(), policy, 256);
+        for (unsigned i = 0; i < 100; ++i)
+        {
+            logging::Arguments arguments("binary %1% %2%");
+            arguments.Add(i);
+            arguments.Add(std::string("text"));
+            log.Write(ILog::Record{ CURRENT_MODULE_ID, ILog::Level::Info, std::string(), __FILE__, __LINE__, __FUNCTION__, start + i * 1000000000ull, boost::this_thread::get_id(), arguments, nullptr, logging::ContextSnapshot() });
+        }
+    }
+
+    const auto decode = [&path]() {
+        std::ostringstream out;
+        logging::Decode(path, out);
+        std::vector<std::string> records;
+        std::istringstream lines(out.str());
+        for (std::string line; std::getline(lines, line); )
+            records.push_back(line);
+        return records;
+    };
+
+    std::vector<std::pair<std::uint64_t, std::uint64_t>> blocks;
+    {
+        std::ifstream index(path + ".idx", std::ios::binary);
+        std::uint64_t entry[2];
+        while (index.read(reinterpret_cast<char*>(entry), sizeof(entry)))
+            blocks.emplace_back(entry[0], entry[1]);
+    }
+    ASSERT_GT(blocks.size(), 4u);
+
+    // partial trailing record
+    boost::filesystem::resize_file(path, boost::filesystem::file_size(path) - 3);
+    auto records = decode();
+    ASSERT_EQ(records.size(), 99u);
+    EXPECT_NE(records.back().find("binary 98 text/*"), std::string::npos);
+
+    // a garbled block is dropped, the next one is found through the index
+    {
+        std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(static_cast<std::streamoff>(blocks[2].second));
+        file << std::string(static_cast<std::size_t>(blocks[3].second - blocks[2].second), '\xff');
+    }
+    const auto lost = (blocks[3].first - blocks[2].first) / 1000000000ull;
+    records = decode();
+    ASSERT_EQ(records.size(), 99u - lost);
+    const auto first = (blocks[2].first - start) / 1000000000ull;
+    EXPECT_NE(records[first - 1].find("binary " + std::to_string(first - 1) + " text/*"), std::string::npos);
+    EXPECT_NE(records[first].find("binary " + std::to_string(first + lost) + " text/*"), std::string::npos);
+    for (const auto& record : records)
+        EXPECT_NE(record.find("][tests] ["), std::string::npos);
+
+    // payloads read back are checked before they are visited
+    logging::Arguments arguments("%1% %2%");
+    arguments.Add(7);
+    arguments.Add(std::string("text"));
+    std::string payload(arguments.GetData(), arguments.GetSize());
+    EXPECT_TRUE(logging::Arguments::IsValid(payload.data(), payload.size()));
+    EXPECT_FALSE(logging::Arguments::IsValid(payload.data(), payload.size() - 1));
+    payload[1 + sizeof(std::int64_t) + 1] = 100;
+    EXPECT_FALSE(logging::Arguments::IsValid(payload.data(), payload.size()));
+    payload[0] = 42;
+    EXPECT_FALSE(logging::Arguments::IsValid(payload.data(), payload.size()));
+
+    boost::filesystem::remove(path);
+    boost::filesystem::remove(path + ".idx");
+}
+
+TEST(Logging, BinaryCallSites)
+{
+    const auto folder = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    const auto sites = (folder / "sites.bin").string();
+    const auto plain = (folder / "plain.bin").string();
+    {
+        logging::Binary bySite(ILog::Level::Trace, sites.c_str());
+        logging::Binary byName(ILog::Level::Trace, plain.c_str());
+        static logging::CallSite site(CURRENT_MODULE_ID, ILog::Level::Info, __FILE__, __LINE__, "site %1%");
+        site.Hit(__FUNCTION__);
+        for (int i = 0; i < 100; ++i)
+        {
+            // the site format is a literal, kept by address
+            logging::Arguments arguments(site.GetFormat());
+            arguments.Add(i);
+            bySite.Write(site, arguments);
+            byName.Write(CURRENT_MODULE_ID, ILog::Level::Info, arguments, __FILE__, __LINE__, __FUNCTION__);
+        }
+
+        ILog* logger = &bySite;
+        LSITE(logger, ILog::Level::Warning, "macro %1%", 1);
+        LSITE(logger, ILog::Level::Warning, "macro %1%", 2);
+    }
+
+    // level, module, function and format are written once per block
+    EXPECT_LT(boost::filesystem::file_size(sites), boost::filesystem::file_size(plain));
+
+    std::ostringstream decoded;
+    logging::Decode(sites, decoded);
+    const auto text = decoded.str();
+    EXPECT_EQ(std::count(text.begin(), text.end(), '\n'), 102);
+    EXPECT_NE(text.find("[INFO]["), std::string::npos);
+    EXPECT_NE(text.find("[WARN]["), std::string::npos);
+    EXPECT_NE(text.find("macro 1/*"), std::string::npos);
+    EXPECT_NE(text.find("macro 2/*"), std::string::npos);
+    EXPECT_NE(text.find("][tests] ["), std::string::npos);
+    EXPECT_NE(text.find("site 0/* " + std::string(__FUNCTION__) + " */\n"), std::string::npos);
+    EXPECT_NE(text.find("site 99/*"), std::string::npos);
+
+    boost::filesystem::remove_all(folder);
+}
+
+TEST(Logging, AsyncWritesAll)
+{
+    auto* log = new MockedLog();
+
+    EXPECT_CALL(*log, IsEnabled(CURRENT_MODULE_ID, ILog::Level::Info))
+        .WillRepeatedly(Return(true));
+    // modules reach the sink interned
+    EXPECT_CALL(*log, Write(StrEq(CURRENT_MODULE_ID), ILog::Level::Info, "async", _, _, _))
+        .Times(Exactly(400));
+
+    logging::AsyncLog async(std::unique_ptr<ILog>(log), 16);
+    ILog* logger = &async;
+
+    std::vector<boost::thread> threads;
+    for (int i = 0; i < 4; ++i)
+        threads.emplace_back([logger](){
+            for (int j = 0; j < 100; ++j)
+                LINFO(logger, CURRENT_MODULE_ID, "async");
+        });
+    for (auto& thread : threads)
+        thread.join();
+
+    async.Flush();
+    EXPECT_EQ(async.GetDropped(), 0u);
+}
+
+TEST(Logging, AsyncDeferredFormat)
+{
+    auto* log = new MockedLog();
+
+    EXPECT_CALL(*log, Write(StrEq(CURRENT_MODULE_ID), ILog::Level::Info, "deferred 1 2.5 text", _, _, _))
+        .Times(Exactly(1));
+
+    logging::AsyncLog async{ std::unique_ptr<ILog>(log) };
+    ILog* logger = &async;
+
+    LOG_MACRO_DEFERRED(logger, ILog::Level::Info, CURRENT_MODULE_ID, "deferred %1% %2% %3%", 1, 2.5, "text");
+    async.Flush();
+}
+
+TEST(Logging, AsyncRuntimeStrings)
+{
+    const auto path = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+    {
+        logging::AsyncLog async(std::unique_ptr<ILog>(new logging::Std(ILog::Level::Info, path.c_str())));
+
+        // module and format storage is gone, or reused, before the writer thread gets the records
+        char format[32];
+        for (int i = 0; i < 100; ++i)
+        {
+            std::unique_ptr<std::string> module(new std::string("runtime_" + std::to_string(i % 10)));
+            std::strcpy(format, "buffer %1%");
+            async.Write(module->c_str(), ILog::Level::Info, logging::Capture(format, i), __FILE__, __LINE__, __FUNCTION__);
+            async.Write(module->c_str(), ILog::Level::Info, "text " + std::to_string(i), __FILE__, __LINE__, __FUNCTION__);
+            std::strcpy(format, "garbage %1%");
+            module->assign("garbage_" + std::to_string(i));
+        }
+        async.Flush();
+    }
+
+    const auto content = ReadFile(path);
+    for (int i = 0; i < 100; ++i)
+    {
+        const auto module = "][runtime_" + std::to_string(i % 10) + "] [";
+        EXPECT_NE(content.find(module), std::string::npos);
+        EXPECT_NE(content.find("buffer " + std::to_string(i) + "/*"), std::string::npos);
+        EXPECT_NE(content.find("text " + std::to_string(i) + "/*"), std::string::npos);
+    }
+    EXPECT_EQ(content.find("garbage"), std::string::npos);
+    boost::filesystem::remove(path);
+}
+
+TEST(Logging, AsyncDropsOnOverflow)
+{
+    auto* log = new MockedLog();
+
+    std::promise<void> started;
+    std::promise<void> release;
+    auto released = release.get_future().share();
+
+    EXPECT_CALL(*log, Write(StrEq(CURRENT_MODULE_ID), ILog::Level::Error, "first", _, _, _))
+        .WillOnce(Invoke([&](const char*, ILog::Level::Value, const std::string&, const char*, unsigned, const char*){
+            started.set_value();
+            released.wait();
+        }));
+    EXPECT_CALL(*log, Write(StrEq(CURRENT_MODULE_ID), ILog::Level::Error, "queued", _, _, _))
+        .Times(Exactly(2));
+    EXPECT_CALL(*log, Write(StrEq(CURRENT_MODULE_ID), ILog::Level::Debug, _, _, _, _))
+        .Times(Exactly(0));
+
+    logging::AsyncLog async(std::unique_ptr<ILog>(log), 2, logging::AsyncLog::Overflow::DropBelow, ILog::Level::Info);
+
+    async.Write(CURRENT_MODULE_ID, ILog::Level::Error, "first", __FILE__, __LINE__, __FUNCTION__);
+    started.get_future().wait();
+
+    async.Write(CURRENT_MODULE_ID, ILog::Level::Error, "queued", __FILE__, __LINE__, __FUNCTION__);
+    async.Write(CURRENT_MODULE_ID, ILog::Level::Error, "queued", __FILE__, __LINE__, __FUNCTION__);
+    async.Write(CURRENT_MODULE_ID, ILog::Level::Debug, "dropped", __FILE__, __LINE__, __FUNCTION__);
+    EXPECT_EQ(async.GetDropped(), 1u);
+
+    release.set_value();
+    async.Flush();
+}
+
+TEST(Logging, AsyncWritesBatches)
+{
+    class BatchedStd : public logging::Std
+    {
+    public:
+        BatchedStd(const char* file, std::vector<std::size_t>& batches, std::promise<void>& started, const std::shared_future<void>& released)
+            : logging::Std(ILog::Level::Trace, file)
+            , m_Batches(batches)
+            , m_Started(started)
+            , m_Released(released)
+        {
+        }
+
+        virtual void WriteBatch(const Record* records, std::size_t count) override
+        {
+            m_Batches.push_back(count);
+            if (m_Batches.size() == 1)
+            {
+                m_Started.set_value();
+                m_Released.wait();
+            }
+            logging::Std::WriteBatch(records, count);
+        }
+
+    private:
+        std::vector<std::size_t>& m_Batches;
+        std::promise<void>& m_Started;
+        std::shared_future<void> m_Released;
+    };
+
+    const auto folder = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    const auto file = (folder / "batch.log").string();
+
+    std::vector<std::size_t> batches;
+    std::promise<void> started;
+    std::promise<void> release;
+    {
+        logging::AsyncLog async(std::unique_ptr<ILog>(new BatchedStd(file.c_str(), batches, started, release.get_future().share())), 64);
+        ILog* logger = &async;
+
+        LINFO(logger, CURRENT_MODULE_ID, "record %1%", 0);
+        started.get_future().wait();
+
+        // queued while the writer thread is busy, delivered in one call
+        for (int i = 1; i <= 10; ++i)
+            LINFO(logger, CURRENT_MODULE_ID, "record %1%", i);
+
+        release.set_value();
+        async.Flush();
+    }
+
+    ASSERT_EQ(batches.size(), 2u);
+    EXPECT_EQ(batches[0], 1u);
+    EXPECT_EQ(batches[1], 10u);
+
+    std::ifstream output(file);
+    std::vector<int> order;
+    for (std::string line; std::getline(output, line);)
+    {
+        const auto position = line.find("record ");
+        if (position != std::string::npos)
+            order.push_back(std::stoi(line.substr(position + 7)));
+    }
+    std::vector<int> expected(11);
+    std::iota(expected.begin(), expected.end(), 0);
+    EXPECT_EQ(order, expected);
+
+    boost::filesystem::remove_all(folder);
+}
+
 GTEST_API_ int main(int argc, char **argv) {
     std::cout << "Running main() from gtest_main.cc\n";
 
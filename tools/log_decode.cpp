@@ -0,0 +1,56 @@
+//! Renders a binary log written by logging::Binary in the Std text layout
+//!
+//! Usage: log_decode <file> ["YYYY-MM-DD HH:MM:SS" ["YYYY-MM-DD HH:MM:SS"]] > decoded.log
+//! The optional local times limit the output to a window, the file index is used to seek to its start.
+//!
+#include "log/binary_log.h"
+
+#include <ctime>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+namespace
+{
+
+std::uint64_t ParseTime(const char* text)
+{
+    std::tm local{};
+    std::istringstream stream(text);
+    stream >> std::get_time(&local, "%Y-%m-%d %H:%M:%S");
+    if (stream.fail())
+        throw std::runtime_error(std::string("invalid time, expected YYYY-MM-DD HH:MM:SS: ") + text);
+
+    local.tm_isdst = -1;
+    return static_cast<std::uint64_t>(std::mktime(&local)) * 1000000000;
+}
+
+} // anonymous namespace
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2 || argc > 4)
+    {
+        std::cerr << "usage: log_decode <file> [from [to]]" << std::endl;
+        return 1;
+    }
+
+    try
+    {
+        const auto from = argc > 2 ? ParseTime(argv[2]) : 0;
+        const auto to = argc > 3 ? ParseTime(argv[3]) : std::numeric_limits<std::uint64_t>::max();
+
+        std::ios::sync_with_stdio(false);
+        logging::Decode(argv[1], std::cout, from, to);
+        std::cout.flush();
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,30 @@
+//! Merges per-thread shard files written by logging::Sharded into one stream ordered by time
+//!
+//! Usage: log_merge <file>... > merged.log
+//!
+#include "log/merge.h"
+
+#include <exception>
+#include <iostream>
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        std::cerr << "usage: log_merge <file>..." << std::endl;
+        return 1;
+    }
+
+    try
+    {
+        std::ios::sync_with_stdio(false);
+        logging::Merge(std::vector<std::string>(argv + 1, argv + argc), std::cout);
+        std::cout.flush();
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}